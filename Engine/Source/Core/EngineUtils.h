@@ -9,7 +9,7 @@
 
 #define ASSERT_MSG(x, inMessage, ...)						\
   ((!!(x)) || ([&](){										\
-LOG_ERROR(inMessage, __VA_ARGS__);							\
+LOG_ERROR(inMessage, ##__VA_ARGS__);							\
  __debugbreak();											\
  return false;												\
   }()))		
@@ -20,7 +20,7 @@ static bool bExecuted = false;								\
   if(!bExecuted)									\
   {															\
 bExecuted = true;											\
-LOG_ERROR(inMessage, __VA_ARGS__);							\
+LOG_ERROR(inMessage, ##__VA_ARGS__);							\
  __debugbreak();}											\
  return false;												\
   }()))														\
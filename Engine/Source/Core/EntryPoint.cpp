@@ -1,8 +1,25 @@
+#if !OFFLINE_RENDER_ONLY
 #include "GameModeBase.h"
 #include "EngineCore.h"
+#endif
+#include "Renderer/OfflineRender.h"
 
 int main(int argc, char** argv)
 {
+	// Renders straight to files and exits, the engine and its window are never created
+	OfflineRenderSettings offlineSettings;
+	if (OfflineRender::ParseCommandLine(argc, argv, offlineSettings))
+	{
+		return OfflineRender::Run(offlineSettings) ? 0 : 1;
+	}
+
+#if OFFLINE_RENDER_ONLY
+	// Built without the engine, there is nothing else to run
+	OfflineRender::PrintUsage();
+
+	return 1;
+#else
 	EngineCore::Init();
 	GEngine->Run();
+#endif
 }
\ No newline at end of file
@@ -6,7 +6,7 @@
 #include "Core/EngineUtils.h"
 
 template<typename inRetType, typename... inParamTypes>
-class IFunctionContainer : IFunctionContainerBase
+class IFunctionContainer : public IFunctionContainerBase
 {
 public:
 	virtual inRetType Execute(inParamTypes&&...) const = 0;
@@ -29,6 +29,11 @@ public:
 		return Func(std::forward<inParamTypes>(inParams)...);
 	}
 
+	virtual bool IsBound() const override
+	{
+		return !!Func;
+	}
+
 	FreeFunctionType Func;
 };
 
@@ -6,7 +6,9 @@
 #include <type_traits>
 #include "Logger/Logger.h"
 #include "Core/EngineUtils.h"
+#ifdef _WIN32
 #include "Core/WindowsPlatform.h"
+#endif
 // Fmt logger is a good source for this
 
 Logger Logger::Instance;
@@ -40,15 +42,25 @@ void Logger::Print(const char* inFormat, Severity inSeverity, ...)
  
   	va_list argumentList;
   
-  	va_start(argumentList, &inSeverity);
+  	va_start(argumentList, inSeverity);
   
+#ifdef _WIN32
   	int32_t result = vsprintf_s(stackArray, bufferSize, inFormat, argumentList);
+#else
+	// Truncates instead of failing, reported the same way
+	int32_t result = vsnprintf(stackArray, bufferSize, inFormat, argumentList);
+	if (result >= bufferSize)
+	{
+		result = -1;
+	}
+#endif
   
   	va_end(argumentList);
   
     // Means our allocated buffer is not enough, the log to be printed is too big
     ASSERT(result != -1);
 
+#ifdef _WIN32
     switch (inSeverity)
     {
     case Severity::Info:
@@ -67,8 +79,11 @@ void Logger::Print(const char* inFormat, Severity inSeverity, ...)
         break;
     }
     }
+#endif
 
     std::cout << stackArray << std::endl;
 
+#ifdef _WIN32
 	WindowsPlatform::SetCLITextColor(CLITextColor::White);
+#endif
 }
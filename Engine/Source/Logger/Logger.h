@@ -2,9 +2,9 @@
 
 //#ifndef NDEBUG
 
-#define LOG_INFO(x, ...)	{Logger::Get().Print(x, Severity::Info,		__VA_ARGS__);}
-#define LOG_WARNING(x, ...)	{Logger::Get().Print(x, Severity::Warning,	__VA_ARGS__);}
-#define LOG_ERROR(x, ...)	{Logger::Get().Print(x, Severity::Error,	__VA_ARGS__);}
+#define LOG_INFO(x, ...)	{Logger::Get().Print(x, Severity::Info,		##__VA_ARGS__);}
+#define LOG_WARNING(x, ...)	{Logger::Get().Print(x, Severity::Warning,	##__VA_ARGS__);}
+#define LOG_ERROR(x, ...)	{Logger::Get().Print(x, Severity::Error,	##__VA_ARGS__);}
 
 #define LOG_ONCE_INFO(inMessage, ...)						\
   (([&](){										\
@@ -12,7 +12,7 @@ static bool bExecuted = false;								\
   if(!bExecuted)									\
   {															\
 bExecuted = true;											\
-LOG_INFO(inMessage, __VA_ARGS__);}							\
+LOG_INFO(inMessage, ##__VA_ARGS__);}							\
   }()))														\
 
 
@@ -22,7 +22,7 @@ static bool bExecuted = false;								\
   if(!bExecuted)									\
   {															\
 bExecuted = true;											\
-LOG_WARNING(inMessage, __VA_ARGS__);}							\
+LOG_WARNING(inMessage, ##__VA_ARGS__);}							\
   }()))														\
 
 #define LOG_ONCE_ERROR(inMessage, ...)						\
@@ -31,7 +31,7 @@ static bool bExecuted = false;								\
   if(!bExecuted)									\
   {															\
 bExecuted = true;											\
-LOG_ERROR(inMessage, __VA_ARGS__);}							\
+LOG_ERROR(inMessage, ##__VA_ARGS__);}							\
   }()))														\
 
 //#else
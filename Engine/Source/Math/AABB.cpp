@@ -63,5 +63,8 @@ eastl::array<glm::vec3, 8> AABB::GetVertices() const
 
 void AABB::DebugDraw() const
 {
+	// The offline render is built without the renderer the lines are drawn by
+#if !OFFLINE_RENDER_ONLY
 	DrawDebugHelpers::DrawBoxArray(GetVertices(), false);
+#endif
 }
@@ -24,6 +24,15 @@ struct AABB
 		outCenter = Min + outExtent;
 	}
 
+	inline float GetSurfaceArea() const
+	{
+		const glm::vec3 size = Max - Min;
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	// False until the first point or box is added
+	inline bool IsValid() const { return IsInitialized; }
+
 	eastl::array<glm::vec3, 8> GetVertices() const;
 
 	void DebugDraw() const;
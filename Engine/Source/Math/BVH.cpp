@@ -1,324 +1,1851 @@
 #include "Math/BVH.h"
 #include <float.h>
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <numeric>
+#include "glm/integer.hpp"
+#include "Math/BVHCache.h"
 #include "Renderer/DrawDebugHelpers.h"
 
-BVHNode::BVHNode() = default;
+// Upper bound on the number of chunks a large range is split into to be binned or sorted in parallel
+#define BVH_MAX_PARALLEL_CHUNKS 32
 
-BVHNode::~BVHNode()
+// Karras and Aila use 7, the 2^7 subsets are still cheap to search exhaustively
+#define BVH_TREELET_LEAVES 7
+
+// Intermediate node used during construction, flattened into BVHLinearNode once the tree is complete
+struct BVHBuildNode
+{
+	AABB BoundingBox;
+
+	// Indices into the build nodes array, -1 for leaves
+	int32_t LeftNode = -1;
+	int32_t RightNode = -1;
+
+	// Range in BVHBuildContext::Indices
+	uint32_t TrianglesOffset = 0;
+	uint32_t TrianglesCount = 0;
+
+	// Only kept up to date while treelets are optimized
+	float SubtreeCost = 0.f;
+	int32_t Height = 0;
+
+	inline bool IsLeaf() const { return LeftNode == -1; }
+};
+
+
+void BVH::DebugDraw() const
+{
+	for (const BVHLinearNode& node : Nodes)
+	{
+		AABB nodeAABB;
+		nodeAABB += node.Bounds[0];
+		nodeAABB += node.Bounds[1];
+
+		nodeAABB.DebugDraw();
+	}
+}
+
+
+// State shared by all build tasks. Triangles themselves are only touched again when the tree is flattened.
+struct BVHBuildContext
+{
+	BVHBuildSettings Settings;
+
+	// Per triangle, indexed by the triangle's position in the input array
+	eastl::vector<AABB> TriangleBounds;
+	eastl::vector<glm::vec3> TriangleCenters;
+
+	// Partitioned in place, every node owns a contiguous range. Sibling ranges never overlap, so tasks need no locking.
+	eastl::vector<uint32_t> Indices;
+
+	// LinearMorton only, sorted and indexed like Indices
+	eastl::vector<uint64_t> MortonCodes;
+
+	// SpatialSAH only. References are duplicated, so leaves are handed their ranges of Indices through IndicesCount instead
+	const PathTraceTriangle* SourceTriangles = nullptr;
+	std::atomic<uint32_t> IndicesCount = 0;
+	float RootArea = 0.f;
+
+	// Sized up front for the 2 * N - 1 nodes a tree with non empty leaves can have, tasks take slots through NodesCount
+	eastl::vector<BVHBuildNode> Nodes;
+	std::atomic<uint32_t> NodesCount = 0;
+
+	inline bool IsParallelRange(const uint32_t inCount) const { return inCount >= static_cast<uint32_t>(Settings.ParallelBuildMinSize); }
+};
+
+struct BVHRangeBounds
+{
+	AABB Bounds;
+	AABB CenterBounds;
+};
+
+// Default constructed bounds are the identity of the reduction
+static BVHRangeBounds CombineRangeBounds(BVHRangeBounds inA, const BVHRangeBounds& inB)
 {
-	delete LeftNode, RightNode;
+	if (inB.Bounds.IsValid())
+	{
+		inA.Bounds += inB.Bounds;
+		inA.CenterBounds += inB.CenterBounds;
+	}
+
+	return inA;
 }
 
-void BVHNode::DebugDraw() const
+static BVHRangeBounds ComputeRangeBounds(const BVHBuildContext& inContext, const uint32_t inBegin, const uint32_t inEnd)
 {
-	BoundingBox.DebugDraw();
+	auto toRangeBounds = [&inContext](const uint32_t inIndex)
+	{
+		BVHRangeBounds result;
+		result.Bounds = inContext.TriangleBounds[inIndex];
+		result.CenterBounds += inContext.TriangleCenters[inIndex];
+
+		return result;
+	};
 
-	if (LeftNode)
+	const uint32_t* first = inContext.Indices.data() + inBegin;
+	const uint32_t* last = inContext.Indices.data() + inEnd;
+
+	if (inContext.IsParallelRange(inEnd - inBegin))
 	{
-		LeftNode->DebugDraw();
+		return std::transform_reduce(std::execution::par, first, last, BVHRangeBounds(), CombineRangeBounds, toRangeBounds);
 	}
 
-	if (RightNode)
+	return std::transform_reduce(first, last, BVHRangeBounds(), CombineRangeBounds, toRangeBounds);
+}
+
+static int32_t GetLongestAxis(const AABB& inAABB)
+{
+	const glm::vec3 size = inAABB.Max - inAABB.Min;
+
+	if (size.y > size.x)
 	{
-		RightNode->DebugDraw();
+		return size.y > size.z ? 1 : 2;
 	}
+
+	return size.z > size.x ? 2 : 0;
 }
 
-BVH::BVH() = default;
+// Splits at the mean of the triangle centers along the longest axis of the node
+static bool SplitAtMeanCentroid(BVHBuildContext& inContext, const uint32_t inBegin, const uint32_t inEnd, const AABB& inNodeBounds, OUT uint32_t& outMid)
+{
+	const uint32_t* first = inContext.Indices.data() + inBegin;
+	const uint32_t* last = inContext.Indices.data() + inEnd;
+
+	auto toCenter = [&inContext](const uint32_t inIndex) { return inContext.TriangleCenters[inIndex]; };
+	const glm::vec3 zero = glm::vec3(0.f, 0.f, 0.f);
+
+	const glm::vec3 centersSum = inContext.IsParallelRange(inEnd - inBegin) ?
+		std::transform_reduce(std::execution::par, first, last, zero, std::plus<glm::vec3>(), toCenter) :
+		std::transform_reduce(first, last, zero, std::plus<glm::vec3>(), toCenter);
+
+	const int32_t axis = GetLongestAxis(inNodeBounds);
+	const float meanCenter = centersSum[axis] / static_cast<float>(inEnd - inBegin);
 
-BVH::~BVH()
+	uint32_t* const partitionPoint = std::partition(inContext.Indices.data() + inBegin, inContext.Indices.data() + inEnd, [&inContext, axis, meanCenter](const uint32_t inIndex)
+	{
+		return inContext.TriangleCenters[inIndex][axis] < meanCenter;
+	});
+
+	outMid = static_cast<uint32_t>(partitionPoint - inContext.Indices.data());
+
+	return outMid != inBegin && outMid != inEnd;
+}
+
+// Wide leaves are intersected a packet of lanes at a time, so a leaf costs 1 per packet rather than per triangle
+static inline float GetLeafCost(const int32_t inTrianglesCount, const int32_t inLanes)
 {
-	delete Root;
+	return static_cast<float>((inTrianglesCount + inLanes - 1) / inLanes);
 }
 
-#define TERMINATION_SIZE 2
+struct SAHBin
+{
+	AABB Bounds;
+	int32_t Count = 0;
+};
+
+struct SAHBinning
+{
+	SAHBin Bins[3][BVH_MAX_SAH_BINS];
+};
+
+// Maps centers to bins, shared by the evaluation and the partition so that both agree exactly
+struct SAHCenterBins
+{
+	glm::vec3 Min = glm::vec3(0.f, 0.f, 0.f);
+
+	// 0 on axes where all centers are on the same plane, binning can't separate them there
+	glm::vec3 Scale = glm::vec3(0.f, 0.f, 0.f);
+
+	int32_t Count = 2;
 
-void RecursivelyBuildBVH(BVHNode& inNode, const eastl::vector<PathTraceTriangle>& inTriangles, bool& continueRecursion)
+	inline int32_t GetBin(const glm::vec3& inCenter, const int32_t inAxis) const
+	{
+		return glm::min(static_cast<int32_t>((inCenter[inAxis] - Min[inAxis]) * Scale[inAxis]), Count - 1);
+	}
+};
+
+static SAHCenterBins MakeCenterBins(const BVHBuildSettings& inSettings, const AABB& inCenterBounds)
 {
-	if (inTriangles.size() <= TERMINATION_SIZE)
+	SAHCenterBins bins;
+	bins.Min = inCenterBounds.Min;
+	bins.Count = glm::clamp(inSettings.BinCount, 2, BVH_MAX_SAH_BINS);
+
+	const glm::vec3 centerExtent = inCenterBounds.Max - inCenterBounds.Min;
+	for (int32_t axis = 0; axis < 3; ++axis)
 	{
-		inNode.Triangles = inTriangles;
-		for (const PathTraceTriangle& triangle : inTriangles)
+		if (centerExtent[axis] > 0.f)
 		{
-			inNode.BoundingBox += triangle.GetBoundingBox();
+			bins.Scale[axis] = bins.Count / centerExtent[axis];
 		}
-
-		return;
 	}
 
-	eastl::vector<glm::vec3> triangleCenters;
-	triangleCenters.reserve(inTriangles.size());
+	return bins;
+}
 
-	const float invTriangleCount = 1.f / inTriangles.size();
+struct SAHObjectSplit
+{
+	float Cost = FLT_MAX;
 
-	eastl::vector<PathTraceTriangle> leftSideTriangles;
-	eastl::vector<PathTraceTriangle> rightSideTriangles;
+	// -1 if no split separates anything
+	int32_t Axis = -1;
 
-	bool validSplit = false;
-	int32_t tries = 1;
-	while (!validSplit && tries <= 2)
-	{
-		leftSideTriangles.clear();
-		rightSideTriangles.clear();
-		glm::vec3 combinedCenter = glm::vec3(0.f, 0.f, 0.f);
-		AABB comparisonAABB;
-		inNode.BoundingBox = AABB();
+	// Last bin of the left side
+	int32_t Bin = -1;
 
-		for (const PathTraceTriangle& triangle : inTriangles)
-		{
-			const glm::vec3 triangleCenter = (triangle.V[0] + triangle.V[1] + triangle.V[2]) * 0.3333333333333333333333f;
+	AABB LeftBounds;
+	AABB RightBounds;
+};
 
-			triangleCenters.push_back(triangleCenter);
+// Binned SAH, see "On fast Construction of SAH-based Bounding Volume Hierarchies", Wald 2007
+// Primitives are addressed by their position in [0, inCount), large counts are binned over chunks in parallel
+template<typename GetBoundsFuncType, typename GetCenterFuncType>
+static SAHObjectSplit FindObjectSplit(const BVHBuildContext& inContext, const uint32_t inCount, const AABB& inNodeBounds, const SAHCenterBins& inCenterBins,
+	const GetBoundsFuncType& inGetBounds, const GetCenterFuncType& inGetCenter)
+{
+	const BVHBuildSettings& settings = inContext.Settings;
+	const int32_t binCount = inCenterBins.Count;
+	const int32_t lanes = GetBVHWidthLanes(settings.TraversalWidth);
+	const int32_t count = static_cast<int32_t>(inCount);
+	const float invNodeArea = 1.f / glm::max(inNodeBounds.GetSurfaceArea(), FLT_MIN);
 
-			const AABB triangleAABB = triangle.GetBoundingBox();
-			inNode.BoundingBox += triangleAABB;
-			if (tries == 1)
-			{
-				comparisonAABB += triangleAABB;
-			}
-			else
+	auto binRange = [&](const uint32_t inRangeBegin, const uint32_t inRangeEnd, SAHBinning& outBinning)
+	{
+		for (uint32_t i = inRangeBegin; i < inRangeEnd; ++i)
+		{
+			const glm::vec3 center = inGetCenter(i);
+			for (int32_t axis = 0; axis < 3; ++axis)
 			{
-				comparisonAABB += triangleCenter;
-			}
+				if (inCenterBins.Scale[axis] == 0.f)
+				{
+					continue;
+				}
 
-			combinedCenter += triangleCenter * invTriangleCount;
+				SAHBin& bin = outBinning.Bins[axis][inCenterBins.GetBin(center, axis)];
+				bin.Bounds += inGetBounds(i);
+				++bin.Count;
+			}
 		}
-	
-		const float size_x = comparisonAABB.Max.x - comparisonAABB.Min.x;
-		const float size_y = comparisonAABB.Max.y - comparisonAABB.Min.y;
-		const float size_z = comparisonAABB.Max.z - comparisonAABB.Min.z;
-
-		auto getX = [](const glm::vec3& inVec) -> float {return inVec.x; };
-		auto getY = [](const glm::vec3& inVec) -> float {return inVec.y; };
-		auto getZ = [](const glm::vec3& inVec) -> float {return inVec.z; };
+	};
 
-		using getSizeType = float(*)(const glm::vec3& inVec);
+	SAHBinning binning;
+	if (inContext.IsParallelRange(inCount))
+	{
+		// Every chunk bins into its own set, the sets are merged afterwards
+		const uint32_t chunksCount = glm::min(inCount / static_cast<uint32_t>(settings.ParallelBuildMinSize), static_cast<uint32_t>(BVH_MAX_PARALLEL_CHUNKS));
+		eastl::vector<SAHBinning> chunkBinnings(chunksCount);
+		eastl::vector<uint32_t> chunks(chunksCount);
+		std::iota(chunks.begin(), chunks.end(), 0);
 
-		getSizeType getAxisFunc;
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](const uint32_t inChunk)
+		{
+			const uint32_t chunkBegin = static_cast<uint32_t>(static_cast<uint64_t>(inCount) * inChunk / chunksCount);
+			const uint32_t chunkEnd = static_cast<uint32_t>(static_cast<uint64_t>(inCount) * (inChunk + 1) / chunksCount);
+			binRange(chunkBegin, chunkEnd, chunkBinnings[inChunk]);
+		});
 
-		if (size_y > size_x) {
-			if (size_y > size_z) {
-				// Longest Axis Y
-				//LOG_INFO("Splitting using Y Axis.");
-				getAxisFunc = getY;
-			}
-			else {
-				// Longest axis Z
-				//LOG_INFO("Splitting using Z Axis.");
-				getAxisFunc = getZ;
+		for (const SAHBinning& chunkBinning : chunkBinnings)
+		{
+			for (int32_t axis = 0; axis < 3; ++axis)
+			{
+				for (int32_t i = 0; i < binCount; ++i)
+				{
+					const SAHBin& chunkBin = chunkBinning.Bins[axis][i];
+					if (chunkBin.Count != 0)
+					{
+						binning.Bins[axis][i].Bounds += chunkBin.Bounds;
+						binning.Bins[axis][i].Count += chunkBin.Count;
+					}
+				}
 			}
 		}
-		else if (size_z > size_x) {
-			// Longest axis Z
-			//LOG_INFO("Splitting using Z Axis.");
-			getAxisFunc = getZ;
-		}
-		else
+	}
+	else
+	{
+		binRange(0, inCount, binning);
+	}
+
+	SAHObjectSplit bestSplit;
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		if (inCenterBins.Scale[axis] == 0.f)
 		{
-			//LOG_INFO("Splitting using X Axis.");
-			getAxisFunc = getX;
+			continue;
 		}
 
-		// TODO: Nr of triangles at the end will be equal to inTriangles.size()
-		// Find a way to optimize this so one array is needed
+		const SAHBin* bins = binning.Bins[axis];
 
-		leftSideTriangles.reserve(inTriangles.size());
-		rightSideTriangles.reserve(inTriangles.size());
+		// Sweep from the right to get the cost of everything past each split plane
+		AABB rightBoundsPerBin[BVH_MAX_SAH_BINS];
+		float rightAreaTimesCost[BVH_MAX_SAH_BINS];
+		AABB rightBounds;
+		int32_t rightCount = 0;
+		for (int32_t i = binCount - 1; i > 0; --i)
+		{
+			if (bins[i].Count != 0)
+			{
+				rightBounds += bins[i].Bounds;
+				rightCount += bins[i].Count;
+			}
 
-		static bool drawSplitCentersDebug = false;
+			rightBoundsPerBin[i] = rightBounds;
+			rightAreaTimesCost[i] = rightCount != 0 ? rightBounds.GetSurfaceArea() * GetLeafCost(rightCount, lanes) : 0.f;
+		}
 
-		for (int32_t i = 0; i < inTriangles.size(); ++i)
+		// Then from the left, split plane i lies between bin i and bin i + 1
+		AABB leftBounds;
+		int32_t leftCount = 0;
+		for (int32_t i = 0; i < binCount - 1; ++i)
 		{
-			const PathTraceTriangle& currentTriangle = inTriangles[i];
-			const glm::vec3& triangleCenter = triangleCenters[i];
-
-			const float& comparisonValueTriangle = getAxisFunc(triangleCenter);
-			const float& comparisonValueCombinedCenter = getAxisFunc(combinedCenter);
-			if (comparisonValueTriangle < comparisonValueCombinedCenter)
+			if (bins[i].Count != 0)
 			{
-				leftSideTriangles.push_back(currentTriangle);
+				leftBounds += bins[i].Bounds;
+				leftCount += bins[i].Count;
+			}
 
-				if (drawSplitCentersDebug)
-				{
-					DrawDebugHelpers::DrawDebugPoint(triangleCenter, 0.05f, glm::vec3(1.f, 0.f, 0.f), true);
-				}
+			if (leftCount == 0 || leftCount == count)
+			{
+				continue;
 			}
-			else
+
+			const float cost = settings.TraversalCost + (leftBounds.GetSurfaceArea() * GetLeafCost(leftCount, lanes) + rightAreaTimesCost[i + 1]) * invNodeArea;
+			if (cost < bestSplit.Cost)
 			{
-				rightSideTriangles.push_back(currentTriangle);
-				if (drawSplitCentersDebug)
-				{
-					DrawDebugHelpers::DrawDebugPoint(triangleCenter, 0.05f, glm::vec3(0.f, 0.f, 1.f), true);
-				}
+				bestSplit.Cost = cost;
+				bestSplit.Axis = axis;
+				bestSplit.Bin = i;
+				bestSplit.LeftBounds = leftBounds;
+				bestSplit.RightBounds = rightBoundsPerBin[i + 1];
 			}
 		}
+	}
 
-		validSplit = leftSideTriangles.size() != inTriangles.size() && rightSideTriangles.size() != inTriangles.size();
+	return bestSplit;
+}
 
-		//if (!validSplit)
-		//{
-		//	if (tries == 1)
-		//	{
-		//		++tries;
-		//		LOG_WARNING("Partition by axis failed, attempting second method using centers instead of triangles AABB");
-		//	}
-		//	else if (tries == 2)
-		//	{
-		//		ASSERT_MSG(false, "Partition by axis failed, this would lead to infinite recursion, exiting.");
+// Returns false if no split is cheaper than keeping the node as a leaf or if all centers coincide
+static bool SplitBinnedSAH(BVHBuildContext& inContext, const uint32_t inBegin, const uint32_t inEnd, const BVHRangeBounds& inRangeBounds, OUT uint32_t& outMid)
+{
+	const BVHBuildSettings& settings = inContext.Settings;
+	const uint32_t count = inEnd - inBegin;
+	const uint32_t* const indices = inContext.Indices.data() + inBegin;
 
-		//		for (const glm::vec3& triangleCenter : triangleCenters)
-		//		{
-		//			DrawDebugHelpers::DrawDebugPoint(triangleCenter, 0.05f, glm::vec3(0.f, 1.f, 0.f), true);
-		//		}
+	const SAHCenterBins centerBins = MakeCenterBins(settings, inRangeBounds.CenterBounds);
+	const SAHObjectSplit split = FindObjectSplit(inContext, count, inRangeBounds.Bounds, centerBins,
+		[&inContext, indices](const uint32_t inPosition) -> const AABB& { return inContext.TriangleBounds[indices[inPosition]]; },
+		[&inContext, indices](const uint32_t inPosition) -> const glm::vec3& { return inContext.TriangleCenters[indices[inPosition]]; });
 
-		//		DrawDebugHelpers::DrawDebugPoint(combinedCenter, 0.1f, glm::vec3(1.f, 0.f, 0.f), true);
+	if (split.Axis == -1)
+	{
+		return false;
+	}
 
-		//		continueRecursion = false;
-		//		return;
-		//	}
-		//}
+	const float leafCost = GetLeafCost(static_cast<int32_t>(count), GetBVHWidthLanes(settings.TraversalWidth));
+	if (count <= static_cast<uint32_t>(settings.MaxLeafSize) && leafCost <= split.Cost)
+	{
+		return false;
 	}
 
+	// Kept sequential so that builds are reproducible, the order within each side decides the order of leaf triangles
+	uint32_t* const partitionPoint = std::partition(inContext.Indices.data() + inBegin, inContext.Indices.data() + inEnd, [&](const uint32_t inIndex)
+	{
+		return centerBins.GetBin(inContext.TriangleCenters[inIndex], split.Axis) <= split.Bin;
+	});
 
-	if (!continueRecursion)
-		return;
+	outMid = static_cast<uint32_t>(partitionPoint - inContext.Indices.data());
 
-	inNode.LeftNode = new BVHNode();
-	RecursivelyBuildBVH(*inNode.LeftNode, leftSideTriangles, continueRecursion);
+	return true;
+}
+
+struct BVHBuildTask
+{
+	uint32_t NodeIndex;
+	uint32_t Begin;
+	uint32_t End;
+};
 
-	if (!continueRecursion)
+static void RecursivelyBuildBVH(BVHBuildContext& inContext, const BVHBuildTask& inTask, const int32_t inDepth)
+{
+	const BVHBuildSettings& settings = inContext.Settings;
+	const uint32_t count = inTask.End - inTask.Begin;
+	const BVHRangeBounds rangeBounds = ComputeRangeBounds(inContext, inTask.Begin, inTask.End);
+
+	// Slots are never reallocated, so the reference stays valid while other tasks take theirs
+	BVHBuildNode& node = inContext.Nodes[inTask.NodeIndex];
+	node.BoundingBox = rangeBounds.Bounds;
+	node.TrianglesOffset = inTask.Begin;
+	node.TrianglesCount = count;
+
+	// Stays a leaf unless children are assigned below
+	if (count <= 1 || count <= static_cast<uint32_t>(settings.MinLeafSize) || inDepth >= BVH_MAX_DEPTH)
+	{
 		return;
+	}
+
+	uint32_t mid = inTask.Begin;
+	bool validSplit = false;
+	switch (settings.Strategy)
+	{
+	case EBVHBuildStrategy::MeanCentroid:
+	{
+		validSplit = SplitAtMeanCentroid(inContext, inTask.Begin, inTask.End, rangeBounds.Bounds, mid);
+		break;
+	}
+	case EBVHBuildStrategy::BinnedSAH:
+	{
+		validSplit = SplitBinnedSAH(inContext, inTask.Begin, inTask.End, rangeBounds, mid);
+		break;
+	}
+	default:
+	{
+		// LinearMorton and SpatialSAH have their own recursions
+		break;
+	}
+	}
+
+	if (!validSplit)
+	{
+		if (count <= static_cast<uint32_t>(settings.MaxLeafSize))
+		{
+			return;
+		}
+
+		// Fallback when the strategy could not separate the triangles, e.g. all of their centers coincide
+		mid = inTask.Begin + count / 2;
+	}
+
+	const uint32_t leftNode = inContext.NodesCount.fetch_add(2, std::memory_order_relaxed);
+	node.LeftNode = static_cast<int32_t>(leftNode);
+	node.RightNode = static_cast<int32_t>(leftNode + 1);
 
-	inNode.RightNode = new BVHNode();
-	RecursivelyBuildBVH(*inNode.RightNode, rightSideTriangles, continueRecursion);
+	const BVHBuildTask children[2] = { { leftNode, inTask.Begin, mid }, { leftNode + 1, mid, inTask.End } };
+
+	if (inContext.IsParallelRange(count))
+	{
+		std::for_each(std::execution::par, children, children + 2, [&inContext, inDepth](const BVHBuildTask& inChild)
+		{
+			RecursivelyBuildBVH(inContext, inChild, inDepth + 1);
+		});
+	}
+	else
+	{
+		RecursivelyBuildBVH(inContext, children[0], inDepth + 1);
+		RecursivelyBuildBVH(inContext, children[1], inDepth + 1);
+	}
 }
 
 
-void BVH::Build(const eastl::vector<PathTraceTriangle>& inTriangles)
+// Spreads the low 10 bits so that there are two zero bits between each of them
+static inline uint64_t ExpandMortonBits10(uint32_t inValue)
 {
-	LOG_INFO("Building BVH.");
-
-	Root = new BVHNode();
+	inValue = (inValue * 0x00010001u) & 0xFF0000FFu;
+	inValue = (inValue * 0x00000101u) & 0x0F00F00Fu;
+	inValue = (inValue * 0x00000011u) & 0xC30C30C3u;
+	inValue = (inValue * 0x00000005u) & 0x49249249u;
 
-	bool recurse = true;
-	RecursivelyBuildBVH(*Root, inTriangles, recurse);
+	return inValue;
+}
 
-	LOG_INFO("BVH Building done.");
+// Same for the low 21 bits
+static inline uint64_t ExpandMortonBits21(uint64_t inValue)
+{
+	inValue &= 0x1FFFFF;
+	inValue = (inValue | inValue << 32) & 0x1F00000000FFFF;
+	inValue = (inValue | inValue << 16) & 0x1F0000FF0000FF;
+	inValue = (inValue | inValue << 8) & 0x100F00F00F00F00F;
+	inValue = (inValue | inValue << 4) & 0x10C30C30C30C30C3;
+	inValue = (inValue | inValue << 2) & 0x1249249249249249;
+
+	return inValue;
 }
 
+// Computes the Morton code of every triangle center and sorts Indices by it.
+// LSD radix sort, 8 bits per pass. Chunks count their digits in parallel and then scatter to their own slots of each digit, so the sort stays stable.
+static void SortByMortonCode(BVHBuildContext& inContext, const AABB& inCenterBounds)
+{
+	const bool b63Bit = inContext.Settings.bUse63BitMortonCodes;
+	const int32_t codeBits = b63Bit ? 63 : 30;
+	const float cellsPerAxis = b63Bit ? static_cast<float>(1 << 21) : static_cast<float>(1 << 10);
+
+	const glm::vec3 centerExtent = inCenterBounds.Max - inCenterBounds.Min;
+	glm::vec3 cellScale = glm::vec3(0.f, 0.f, 0.f);
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		if (centerExtent[axis] > 0.f)
+		{
+			cellScale[axis] = cellsPerAxis / centerExtent[axis];
+		}
+	}
+
+	const uint32_t count = static_cast<uint32_t>(inContext.Indices.size());
+	const uint32_t chunksCount = inContext.IsParallelRange(count) ?
+		glm::min(count / static_cast<uint32_t>(inContext.Settings.ParallelBuildMinSize), static_cast<uint32_t>(BVH_MAX_PARALLEL_CHUNKS)) : 1;
+
+	eastl::vector<uint32_t> chunks(chunksCount);
+	std::iota(chunks.begin(), chunks.end(), 0);
+
+	auto forEachChunk = [&](auto&& inFunc)
+	{
+		if (chunksCount > 1)
+		{
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), inFunc);
+		}
+		else
+		{
+			std::for_each(chunks.begin(), chunks.end(), inFunc);
+		}
+	};
+
+	auto getChunkBegin = [count, chunksCount](const uint32_t inChunk)
+	{
+		return static_cast<uint32_t>(static_cast<uint64_t>(count) * inChunk / chunksCount);
+	};
+
+	// Indices is still in input order here, so codes can be indexed by either
+	eastl::vector<uint64_t> codes(count);
+	forEachChunk([&](const uint32_t inChunk)
+	{
+		for (uint32_t i = getChunkBegin(inChunk); i < getChunkBegin(inChunk + 1); ++i)
+		{
+			const glm::vec3 cell = glm::min((inContext.TriangleCenters[i] - inCenterBounds.Min) * cellScale, glm::vec3(cellsPerAxis - 1.f));
+			const uint32_t x = static_cast<uint32_t>(cell.x);
+			const uint32_t y = static_cast<uint32_t>(cell.y);
+			const uint32_t z = static_cast<uint32_t>(cell.z);
+
+			codes[i] = b63Bit ?
+				(ExpandMortonBits21(x) << 2) | (ExpandMortonBits21(y) << 1) | ExpandMortonBits21(z) :
+				(ExpandMortonBits10(x) << 2) | (ExpandMortonBits10(y) << 1) | ExpandMortonBits10(z);
+		}
+	});
+
+	eastl::vector<uint64_t> sortedCodes(count);
+	eastl::vector<uint32_t> sortedIndices(count);
+	eastl::vector<eastl::array<uint32_t, 256>> digitOffsets(chunksCount);
+
+	for (int32_t shift = 0; shift < codeBits; shift += 8)
+	{
+		forEachChunk([&](const uint32_t inChunk)
+		{
+			eastl::array<uint32_t, 256>& digitCounts = digitOffsets[inChunk];
+			digitCounts.fill(0);
+
+			for (uint32_t i = getChunkBegin(inChunk); i < getChunkBegin(inChunk + 1); ++i)
+			{
+				++digitCounts[(codes[i] >> shift) & 0xFF];
+			}
+		});
+
+		// Digits first then chunks, so that each chunk gets its own run of slots inside every digit
+		uint32_t offset = 0;
+		for (int32_t digit = 0; digit < 256; ++digit)
+		{
+			for (uint32_t chunk = 0; chunk < chunksCount; ++chunk)
+			{
+				const uint32_t digitCount = digitOffsets[chunk][digit];
+				digitOffsets[chunk][digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		forEachChunk([&](const uint32_t inChunk)
+		{
+			eastl::array<uint32_t, 256>& chunkOffsets = digitOffsets[inChunk];
+
+			for (uint32_t i = getChunkBegin(inChunk); i < getChunkBegin(inChunk + 1); ++i)
+			{
+				const uint32_t destination = chunkOffsets[(codes[i] >> shift) & 0xFF]++;
+				sortedCodes[destination] = codes[i];
+				sortedIndices[destination] = inContext.Indices[i];
+			}
+		});
+
+		codes.swap(sortedCodes);
+		inContext.Indices.swap(sortedIndices);
+	}
+
+	inContext.MortonCodes = std::move(codes);
+}
 
-// Slab Method
-// https://tavianator.com/2011/ray_box.html
-bool RayIntersectsAABB(const PathTracingRay& inRay, const AABB& inAABB)
+// Splits every range at the highest bit its first and last code differ in, which makes the tree an implicit radix tree over the codes.
+// Bounds are merged bottom up from the children instead of reduced over the range at every level.
+// See "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees", Karras 2012
+static void EmitMortonHierarchy(BVHBuildContext& inContext, const BVHBuildTask& inTask, const int32_t inDepth)
 {
-	const float inv_direction_x = 1.0f / inRay.Direction.x;
-	const float inv_direction_y = 1.0f / inRay.Direction.y;
-	const float inv_direction_z = 1.0f / inRay.Direction.z;
+	const BVHBuildSettings& settings = inContext.Settings;
+	const uint32_t count = inTask.End - inTask.Begin;
+
+	BVHBuildNode& node = inContext.Nodes[inTask.NodeIndex];
+	node.TrianglesOffset = inTask.Begin;
+	node.TrianglesCount = count;
+
+	auto makeLeaf = [&]()
+	{
+		AABB bounds;
+		for (uint32_t i = inTask.Begin; i < inTask.End; ++i)
+		{
+			bounds += inContext.TriangleBounds[inContext.Indices[i]];
+		}
 
-	float tmin = (inAABB.Min.x - inRay.Origin.x) * inv_direction_x;
-	float tmax = (inAABB.Max.x - inRay.Origin.x) * inv_direction_x;
+		node.BoundingBox = bounds;
+	};
 
-	if (tmin > tmax) std::swap(tmin, tmax);
+	if (count <= 1 || count <= static_cast<uint32_t>(settings.MinLeafSize) || inDepth >= BVH_MAX_DEPTH)
+	{
+		makeLeaf();
 
-	float tymin = (inAABB.Min.y - inRay.Origin.y) * inv_direction_y;
-	float tymax = (inAABB.Max.y - inRay.Origin.y) * inv_direction_y;
+		return;
+	}
 
-	if (tymin > tymax) std::swap(tymin, tymax);
+	const uint64_t firstCode = inContext.MortonCodes[inTask.Begin];
+	const uint64_t lastCode = inContext.MortonCodes[inTask.End - 1];
 
-	if ((tmin > tymax) || (tymin > tmax)) return false;
+	uint32_t mid = inTask.Begin + count / 2;
+	if (firstCode == lastCode)
+	{
+		// Centers in the same cell, nothing left to split them by
+		if (count <= static_cast<uint32_t>(settings.MaxLeafSize))
+		{
+			makeLeaf();
 
-	if (tymin > tmin) tmin = tymin;
-	if (tymax < tmax) tmax = tymax;
+			return;
+		}
+	}
+	else
+	{
+		// All codes of the range share the bits above splitBit, so the ones with it cleared come first
+		const uint64_t splitBit = uint64_t(1) << glm::findMSB(firstCode ^ lastCode);
+		const uint64_t* const codes = inContext.MortonCodes.data();
+		const uint64_t* const splitCode = std::partition_point(codes + inTask.Begin, codes + inTask.End, [splitBit](const uint64_t inCode)
+		{
+			return (inCode & splitBit) == 0;
+		});
 
-	float tzmin = (inAABB.Min.z - inRay.Origin.z) * inv_direction_z;
-	float tzmax = (inAABB.Max.z - inRay.Origin.z) * inv_direction_z;
+		mid = static_cast<uint32_t>(splitCode - codes);
+	}
 
-	if (tzmin > tzmax) std::swap(tzmin, tzmax);
+	const uint32_t leftNode = inContext.NodesCount.fetch_add(2, std::memory_order_relaxed);
+	node.LeftNode = static_cast<int32_t>(leftNode);
+	node.RightNode = static_cast<int32_t>(leftNode + 1);
 
-	if ((tmin > tzmax) || (tzmin > tmax)) return false;
+	const BVHBuildTask children[2] = { { leftNode, inTask.Begin, mid }, { leftNode + 1, mid, inTask.End } };
 
-	return true;
+	if (inContext.IsParallelRange(count))
+	{
+		std::for_each(std::execution::par, children, children + 2, [&inContext, inDepth](const BVHBuildTask& inChild)
+		{
+			EmitMortonHierarchy(inContext, inChild, inDepth + 1);
+		});
+	}
+	else
+	{
+		EmitMortonHierarchy(inContext, children[0], inDepth + 1);
+		EmitMortonHierarchy(inContext, children[1], inDepth + 1);
+	}
+
+	node.BoundingBox = inContext.Nodes[leftNode].BoundingBox;
+	node.BoundingBox += inContext.Nodes[leftNode + 1].BoundingBox;
 }
 
+// A triangle as seen by one node of a spatial split build, bounded by the part of the triangle that lies inside the node
+struct BVHReference
+{
+	AABB Bounds;
+	uint32_t TriangleIndex = 0;
+
+	inline glm::vec3 GetCenter() const { return (Bounds.Min + Bounds.Max) * 0.5f; }
+};
 
-bool BVH::Intersects(const PathTracingRay& inRay) const
+// Shrinks ioBounds to its overlap with inClip, returns false if they don't overlap
+static bool ClipBounds(AABB& ioBounds, const AABB& inClip)
 {
-	return Root->Intersects(inRay);
+	ioBounds.Min = glm::max(ioBounds.Min, inClip.Min);
+	ioBounds.Max = glm::min(ioBounds.Max, inClip.Max);
+
+	return ioBounds.Min.x <= ioBounds.Max.x && ioBounds.Min.y <= ioBounds.Max.y && ioBounds.Min.z <= ioBounds.Max.z;
 }
 
-bool BVHNode::Intersects(const PathTracingRay& inRay) const
+// Cuts the reference's triangle with the plane at inPosition on inAxis. Either side is left invalid if nothing of the reference is on it.
+static void SplitReference(const BVHBuildContext& inContext, const BVHReference& inReference, const int32_t inAxis, const float inPosition,
+	OUT BVHReference& outLeft, OUT BVHReference& outRight)
 {
-	if (RayIntersectsAABB(inRay, BoundingBox))
+	AABB leftBounds;
+	AABB rightBounds;
+
+	const PathTraceTriangle& triangle = inContext.SourceTriangles[inReference.TriangleIndex];
+	for (int32_t i = 0; i < 3; ++i)
 	{
-		if(LeftNode)
+		const glm::vec3& start = triangle.V[i];
+		const glm::vec3& end = triangle.V[(i + 1) % 3];
+		const float startPosition = start[inAxis];
+		const float endPosition = end[inAxis];
+
+		if (startPosition <= inPosition)
 		{
-			return LeftNode->Intersects(inRay) || RightNode->Intersects(inRay);
+			leftBounds += start;
 		}
-		else
+
+		if (startPosition >= inPosition)
 		{
-			for (const PathTraceTriangle& triangle : Triangles)
-			{
-				if (IntersectsTriangle(inRay, triangle))
-				{
-					return true;
-				}
-			}
+			rightBounds += start;
+		}
 
+		// Where an edge crosses the plane belongs to both sides
+		if ((startPosition < inPosition && endPosition > inPosition) || (startPosition > inPosition && endPosition < inPosition))
+		{
+			glm::vec3 crossing = glm::mix(start, end, glm::clamp((inPosition - startPosition) / (endPosition - startPosition), 0.f, 1.f));
+			crossing[inAxis] = inPosition;
+
+			leftBounds += crossing;
+			rightBounds += crossing;
 		}
+	}
+
+	outLeft = BVHReference();
+	outRight = BVHReference();
+	outLeft.TriangleIndex = inReference.TriangleIndex;
+	outRight.TriangleIndex = inReference.TriangleIndex;
 
+	// The reference may already be a piece of the triangle, so both halves are kept inside it
+	if (leftBounds.IsValid() && ClipBounds(leftBounds, inReference.Bounds))
+	{
+		leftBounds.Max[inAxis] = glm::min(leftBounds.Max[inAxis], inPosition);
+		outLeft.Bounds = leftBounds;
 	}
 
-	return false;
+	if (rightBounds.IsValid() && ClipBounds(rightBounds, inReference.Bounds))
+	{
+		rightBounds.Min[inAxis] = glm::max(rightBounds.Min[inAxis], inPosition);
+		outRight.Bounds = rightBounds;
+	}
 }
 
-bool BVHNode::Trace(const PathTracingRay& inRay, PathTracePayload& outPayload) const
+struct SpatialBin
 {
-	if (RayIntersectsAABB(inRay, BoundingBox))
+	AABB Bounds;
+
+	// References starting and ending in this bin
+	int32_t Entries = 0;
+	int32_t Exits = 0;
+};
+
+struct SAHSpatialSplit
+{
+	float Cost = FLT_MAX;
+
+	// -1 if no split fits the budget
+	int32_t Axis = -1;
+	float Position = 0.f;
+};
+
+// Bins along the node bounds instead of the centers. References are chopped at every bin boundary they cross, so each bin
+// is bounded by the pieces of the triangles inside it. Only splits creating at most inBudget duplicates are considered.
+// See "Spatial Splits in Bounding Volume Hierarchies", Stich, Friedrich and Dietrich 2009
+static SAHSpatialSplit FindSpatialSplit(const BVHBuildContext& inContext, const eastl::vector<BVHReference>& inReferences, const AABB& inNodeBounds, const uint32_t inBudget)
+{
+	const BVHBuildSettings& settings = inContext.Settings;
+	const int32_t binCount = glm::clamp(settings.BinCount, 2, BVH_MAX_SAH_BINS);
+	const int32_t lanes = GetBVHWidthLanes(settings.TraversalWidth);
+	const int32_t count = static_cast<int32_t>(inReferences.size());
+	const float invNodeArea = 1.f / glm::max(inNodeBounds.GetSurfaceArea(), FLT_MIN);
+	const glm::vec3 nodeExtent = inNodeBounds.Max - inNodeBounds.Min;
+
+	SAHSpatialSplit bestSplit;
+
+	for (int32_t axis = 0; axis < 3; ++axis)
 	{
-		if (LeftNode)
+		if (nodeExtent[axis] <= 0.f)
 		{
-			PathTracePayload leftPayload;
-			const bool leftHit = LeftNode->Trace(inRay, outPayload);
+			continue;
+		}
+
+		const float nodeMin = inNodeBounds.Min[axis];
+		const float binWidth = nodeExtent[axis] / binCount;
+		const float invBinWidth = binCount / nodeExtent[axis];
 
-			PathTracePayload rightPayload;
-			const bool rightHit = RightNode->Trace(inRay, rightPayload);
+		SpatialBin bins[BVH_MAX_SAH_BINS];
+		for (const BVHReference& reference : inReferences)
+		{
+			const int32_t firstBin = glm::clamp(static_cast<int32_t>((reference.Bounds.Min[axis] - nodeMin) * invBinWidth), 0, binCount - 1);
+			const int32_t lastBin = glm::clamp(static_cast<int32_t>((reference.Bounds.Max[axis] - nodeMin) * invBinWidth), firstBin, binCount - 1);
 
-			if (leftHit && leftPayload.Distance < outPayload.Distance)
+			BVHReference remaining = reference;
+			for (int32_t i = firstBin; i < lastBin && remaining.Bounds.IsValid(); ++i)
 			{
-				outPayload = leftPayload;
+				BVHReference left, right;
+				SplitReference(inContext, remaining, axis, nodeMin + binWidth * (i + 1), left, right);
+
+				if (left.Bounds.IsValid())
+				{
+					bins[i].Bounds += left.Bounds;
+				}
+
+				remaining = right;
 			}
 
-			if (rightHit && rightPayload.Distance < outPayload.Distance)
+			if (remaining.Bounds.IsValid())
 			{
-				outPayload = rightPayload;
+				bins[lastBin].Bounds += remaining.Bounds;
 			}
 
-			return leftHit || rightHit;
+			++bins[firstBin].Entries;
+			++bins[lastBin].Exits;
 		}
-		else
+
+		// Sweep from the right to get the cost of everything past each split plane
+		float rightAreaTimesCost[BVH_MAX_SAH_BINS];
+		int32_t rightCountPerBin[BVH_MAX_SAH_BINS];
+		AABB rightBounds;
+		int32_t rightCount = 0;
+		for (int32_t i = binCount - 1; i > 0; --i)
 		{
-			bool bHit = false;
-			for (const PathTraceTriangle& triangle : Triangles)
+			if (bins[i].Bounds.IsValid())
 			{
-				PathTracePayload currPayload;
-				if (TraceTriangle(inRay, triangle, currPayload))
-				{
-					bHit = true;
-					if (currPayload.Distance < outPayload.Distance)
-					{
-						outPayload = currPayload;
-					}
-				}
+				rightBounds += bins[i].Bounds;
 			}
 
-			return bHit;
+			rightCount += bins[i].Exits;
+			rightCountPerBin[i] = rightCount;
+			rightAreaTimesCost[i] = rightCount != 0 ? rightBounds.GetSurfaceArea() * GetLeafCost(rightCount, lanes) : 0.f;
 		}
-	}
+
+		// Then from the left, split plane i lies between bin i and bin i + 1
+		AABB leftBounds;
+		int32_t leftCount = 0;
+		for (int32_t i = 0; i < binCount - 1; ++i)
+		{
+			if (bins[i].Bounds.IsValid())
+			{
+				leftBounds += bins[i].Bounds;
+			}
+
+			leftCount += bins[i].Entries;
+
+			const int32_t duplicates = leftCount + rightCountPerBin[i + 1] - count;
+			if (leftCount == 0 || rightCountPerBin[i + 1] == 0 || duplicates > static_cast<int32_t>(inBudget))
+			{
+				continue;
+			}
+
+			const float cost = settings.TraversalCost + (leftBounds.GetSurfaceArea() * GetLeafCost(leftCount, lanes) + rightAreaTimesCost[i + 1]) * invNodeArea;
+			if (cost < bestSplit.Cost)
+			{
+				bestSplit.Cost = cost;
+				bestSplit.Axis = axis;
+				bestSplit.Position = nodeMin + binWidth * (i + 1);
+			}
+		}
+	}
+
+	return bestSplit;
+}
+
+struct BVHSpatialTask
+{
+	uint32_t NodeIndex = 0;
+	eastl::vector<BVHReference> References;
+
+	// Duplicates this subtree may still create. Handed down in proportion to the children's sizes, so the build does not depend on task order
+	uint32_t Budget = 0;
+};
+
+// Like RecursivelyBuildBVH, but nodes own lists of references instead of ranges, since a spatial split puts a triangle on both sides.
+// Leaves take their slots of Indices through IndicesCount.
+static void RecursivelyBuildSpatialBVH(BVHBuildContext& inContext, BVHSpatialTask& inTask, const int32_t inDepth)
+{
+	const BVHBuildSettings& settings = inContext.Settings;
+
+	eastl::vector<BVHReference> references;
+	references.swap(inTask.References);
+	const uint32_t count = static_cast<uint32_t>(references.size());
+
+	auto toRangeBounds = [](const BVHReference& inReference)
+	{
+		BVHRangeBounds result;
+		result.Bounds = inReference.Bounds;
+		result.CenterBounds += inReference.GetCenter();
+
+		return result;
+	};
+
+	const BVHRangeBounds rangeBounds = inContext.IsParallelRange(count) ?
+		std::transform_reduce(std::execution::par, references.begin(), references.end(), BVHRangeBounds(), CombineRangeBounds, toRangeBounds) :
+		std::transform_reduce(references.begin(), references.end(), BVHRangeBounds(), CombineRangeBounds, toRangeBounds);
+
+	// Slots are never reallocated, so the reference stays valid while other tasks take theirs
+	BVHBuildNode& node = inContext.Nodes[inTask.NodeIndex];
+	node.BoundingBox = rangeBounds.Bounds;
+	node.TrianglesCount = count;
+
+	auto makeLeaf = [&]()
+	{
+		node.TrianglesOffset = inContext.IndicesCount.fetch_add(count, std::memory_order_relaxed);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			inContext.Indices[node.TrianglesOffset + i] = references[i].TriangleIndex;
+		}
+	};
+
+	if (count <= 1 || count <= static_cast<uint32_t>(settings.MinLeafSize) || inDepth >= BVH_MAX_DEPTH)
+	{
+		makeLeaf();
+
+		return;
+	}
+
+	const SAHCenterBins centerBins = MakeCenterBins(settings, rangeBounds.CenterBounds);
+	const SAHObjectSplit objectSplit = FindObjectSplit(inContext, count, rangeBounds.Bounds, centerBins,
+		[&references](const uint32_t inPosition) -> const AABB& { return references[inPosition].Bounds; },
+		[&references](const uint32_t inPosition) { return references[inPosition].GetCenter(); });
+
+	// Only worth it where the sides of the object split overlap a lot. Measured against the root so that small nodes deep down are left alone
+	SAHSpatialSplit spatialSplit;
+	if (inTask.Budget > 0)
+	{
+		bool bTrySpatialSplit = objectSplit.Axis == -1;
+		if (!bTrySpatialSplit)
+		{
+			AABB overlap = objectSplit.LeftBounds;
+			bTrySpatialSplit = ClipBounds(overlap, objectSplit.RightBounds) && overlap.GetSurfaceArea() > settings.SpatialSplitOverlapThreshold * inContext.RootArea;
+		}
+
+		if (bTrySpatialSplit)
+		{
+			spatialSplit = FindSpatialSplit(inContext, references, rangeBounds.Bounds, inTask.Budget);
+		}
+	}
+
+	const float bestCost = glm::min(objectSplit.Cost, spatialSplit.Cost);
+	const float leafCost = GetLeafCost(static_cast<int32_t>(count), GetBVHWidthLanes(settings.TraversalWidth));
+	if (count <= static_cast<uint32_t>(settings.MaxLeafSize) && leafCost <= bestCost)
+	{
+		makeLeaf();
+
+		return;
+	}
+
+	const uint32_t leftNode = inContext.NodesCount.fetch_add(2, std::memory_order_relaxed);
+	node.LeftNode = static_cast<int32_t>(leftNode);
+	node.RightNode = static_cast<int32_t>(leftNode + 1);
+
+	BVHSpatialTask children[2];
+	children[0].NodeIndex = leftNode;
+	children[1].NodeIndex = leftNode + 1;
+	eastl::vector<BVHReference>& leftReferences = children[0].References;
+	eastl::vector<BVHReference>& rightReferences = children[1].References;
+
+	bool validSplit = false;
+	if (spatialSplit.Cost < objectSplit.Cost)
+	{
+		for (const BVHReference& reference : references)
+		{
+			if (reference.Bounds.Max[spatialSplit.Axis] <= spatialSplit.Position)
+			{
+				leftReferences.push_back(reference);
+			}
+			else if (reference.Bounds.Min[spatialSplit.Axis] >= spatialSplit.Position)
+			{
+				rightReferences.push_back(reference);
+			}
+			else
+			{
+				BVHReference left, right;
+				SplitReference(inContext, reference, spatialSplit.Axis, spatialSplit.Position, left, right);
+
+				if (left.Bounds.IsValid())
+				{
+					leftReferences.push_back(left);
+				}
+
+				if (right.Bounds.IsValid())
+				{
+					rightReferences.push_back(right);
+				}
+			}
+		}
+
+		// The binned estimate can be off by the references touching the plane
+		validSplit = !leftReferences.empty() && !rightReferences.empty() && leftReferences.size() + rightReferences.size() <= count + inTask.Budget;
+		if (!validSplit)
+		{
+			leftReferences.clear();
+			rightReferences.clear();
+		}
+	}
+
+	if (!validSplit && objectSplit.Axis != -1)
+	{
+		for (const BVHReference& reference : references)
+		{
+			if (centerBins.GetBin(reference.GetCenter(), objectSplit.Axis) <= objectSplit.Bin)
+			{
+				leftReferences.push_back(reference);
+			}
+			else
+			{
+				rightReferences.push_back(reference);
+			}
+		}
+
+		validSplit = true;
+	}
+
+	if (!validSplit)
+	{
+		// Fallback when neither kind of split could separate the references
+		leftReferences.assign(references.begin(), references.begin() + count / 2);
+		rightReferences.assign(references.begin() + count / 2, references.end());
+	}
+
+	const uint32_t childrenCount = static_cast<uint32_t>(leftReferences.size() + rightReferences.size());
+	const uint32_t remainingBudget = inTask.Budget - (childrenCount - count);
+	children[0].Budget = static_cast<uint32_t>(static_cast<uint64_t>(remainingBudget) * leftReferences.size() / childrenCount);
+	children[1].Budget = remainingBudget - children[0].Budget;
+
+	// Not needed anymore, the children own copies
+	eastl::vector<BVHReference>().swap(references);
+
+	if (inContext.IsParallelRange(count))
+	{
+		std::for_each(std::execution::par, children, children + 2, [&inContext, inDepth](BVHSpatialTask& inChild)
+		{
+			RecursivelyBuildSpatialBVH(inContext, inChild, inDepth + 1);
+		});
+	}
+	else
+	{
+		RecursivelyBuildSpatialBVH(inContext, children[0], inDepth + 1);
+		RecursivelyBuildSpatialBVH(inContext, children[1], inDepth + 1);
+	}
+}
+
+struct BVHTreelet
+{
+	// Subtrees hanging off the treelet, these are moved around but never modified
+	uint32_t Leaves[BVH_TREELET_LEAVES];
+	int32_t LeavesCount = 0;
+
+	// Nodes inside the treelet, the root first. Reused for the new topology
+	uint32_t Interiors[BVH_TREELET_LEAVES - 1];
+	int32_t InteriorsCount = 0;
+
+	// Per subset of Leaves, bit i set when Leaves[i] is in it
+	AABB SubsetBounds[1 << BVH_TREELET_LEAVES];
+	float SubsetCosts[1 << BVH_TREELET_LEAVES];
+	uint8_t SubsetPartitions[1 << BVH_TREELET_LEAVES];
+};
+
+static void UpdateBuildNodeCost(BVHBuildContext& inContext, BVHBuildNode& inOutNode)
+{
+	const float area = inOutNode.BoundingBox.GetSurfaceArea();
+
+	if (inOutNode.IsLeaf())
+	{
+		inOutNode.SubtreeCost = area * GetLeafCost(static_cast<int32_t>(inOutNode.TrianglesCount), GetBVHWidthLanes(inContext.Settings.TraversalWidth));
+		inOutNode.Height = 0;
+
+		return;
+	}
+
+	const BVHBuildNode& left = inContext.Nodes[inOutNode.LeftNode];
+	const BVHBuildNode& right = inContext.Nodes[inOutNode.RightNode];
+
+	inOutNode.SubtreeCost = inContext.Settings.TraversalCost * area + left.SubtreeCost + right.SubtreeCost;
+	inOutNode.Height = 1 + glm::max(left.Height, right.Height);
+}
+
+// Writes the best topology found for inSubset into the treelet's interior nodes, returns the node the subset ended up in
+static uint32_t AssignTreeletNodes(BVHBuildContext& inContext, const BVHTreelet& inTreelet, const uint32_t inSubset, int32_t& inOutNextInterior)
+{
+	if ((inSubset & (inSubset - 1)) == 0)
+	{
+		return inTreelet.Leaves[glm::findLSB(inSubset)];
+	}
+
+	const uint32_t nodeIndex = inTreelet.Interiors[inOutNextInterior++];
+	const uint32_t leftSubset = inTreelet.SubsetPartitions[inSubset];
+
+	const uint32_t leftNode = AssignTreeletNodes(inContext, inTreelet, leftSubset, inOutNextInterior);
+	const uint32_t rightNode = AssignTreeletNodes(inContext, inTreelet, inSubset ^ leftSubset, inOutNextInterior);
+
+	BVHBuildNode& node = inContext.Nodes[nodeIndex];
+	node.LeftNode = static_cast<int32_t>(leftNode);
+	node.RightNode = static_cast<int32_t>(rightNode);
+	node.BoundingBox = inTreelet.SubsetBounds[inSubset];
+	node.TrianglesCount = inContext.Nodes[leftNode].TrianglesCount + inContext.Nodes[rightNode].TrianglesCount;
+	UpdateBuildNodeCost(inContext, node);
+
+	return nodeIndex;
+}
+
+// Opens up to BVH_TREELET_LEAVES subtrees below inRootIndex, the largest ones first, and rebuilds the nodes above them
+// with the topology of lowest SAH cost, found by trying every partition of every subset.
+// See "Fast Parallel Construction of High-Quality Bounding Volume Hierarchies", Karras and Aila 2013
+static void RestructureTreelet(BVHBuildContext& inContext, const uint32_t inRootIndex, const int32_t inDepth)
+{
+	eastl::vector<BVHBuildNode>& nodes = inContext.Nodes;
+
+	BVHTreelet treelet;
+	treelet.Interiors[treelet.InteriorsCount++] = inRootIndex;
+	treelet.Leaves[treelet.LeavesCount++] = static_cast<uint32_t>(nodes[inRootIndex].LeftNode);
+	treelet.Leaves[treelet.LeavesCount++] = static_cast<uint32_t>(nodes[inRootIndex].RightNode);
+
+	while (treelet.LeavesCount < BVH_TREELET_LEAVES)
+	{
+		int32_t largest = -1;
+		float largestArea = -1.f;
+		for (int32_t i = 0; i < treelet.LeavesCount; ++i)
+		{
+			const BVHBuildNode& leaf = nodes[treelet.Leaves[i]];
+			const float area = leaf.BoundingBox.GetSurfaceArea();
+			if (!leaf.IsLeaf() && area > largestArea)
+			{
+				largest = i;
+				largestArea = area;
+			}
+		}
+
+		if (largest == -1)
+		{
+			break;
+		}
+
+		const BVHBuildNode& opened = nodes[treelet.Leaves[largest]];
+		treelet.Interiors[treelet.InteriorsCount++] = treelet.Leaves[largest];
+		treelet.Leaves[largest] = static_cast<uint32_t>(opened.LeftNode);
+		treelet.Leaves[treelet.LeavesCount++] = static_cast<uint32_t>(opened.RightNode);
+	}
+
+	// Two subtrees only have one way to be joined
+	if (treelet.LeavesCount < 3)
+	{
+		return;
+	}
+
+	// Every proper subset of a set is numerically smaller, so going up in order always finds them solved
+	const uint32_t fullSet = (1u << treelet.LeavesCount) - 1;
+	for (uint32_t subset = 1; subset <= fullSet; ++subset)
+	{
+		const uint32_t lowestBit = subset & (~subset + 1);
+		if (subset == lowestBit)
+		{
+			const BVHBuildNode& leaf = nodes[treelet.Leaves[glm::findLSB(subset)]];
+			treelet.SubsetBounds[subset] = leaf.BoundingBox;
+			treelet.SubsetCosts[subset] = leaf.SubtreeCost;
+
+			continue;
+		}
+
+		treelet.SubsetBounds[subset] = treelet.SubsetBounds[subset ^ lowestBit];
+		treelet.SubsetBounds[subset] += treelet.SubsetBounds[lowestBit];
+
+		// Only partitions holding the lowest bit on the left, the mirrored ones cost the same
+		float bestCost = FLT_MAX;
+		uint32_t bestPartition = lowestBit;
+		for (uint32_t left = (subset - 1) & subset; left != 0; left = (left - 1) & subset)
+		{
+			if ((left & lowestBit) == 0)
+			{
+				continue;
+			}
+
+			const float cost = treelet.SubsetCosts[left] + treelet.SubsetCosts[subset ^ left];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestPartition = left;
+			}
+		}
+
+		treelet.SubsetCosts[subset] = inContext.Settings.TraversalCost * treelet.SubsetBounds[subset].GetSurfaceArea() + bestCost;
+		treelet.SubsetPartitions[subset] = static_cast<uint8_t>(bestPartition);
+	}
+
+	if (treelet.SubsetCosts[fullSet] >= nodes[inRootIndex].SubtreeCost)
+	{
+		return;
+	}
+
+	BVHBuildNode previousInteriors[BVH_TREELET_LEAVES - 1];
+	for (int32_t i = 0; i < treelet.InteriorsCount; ++i)
+	{
+		previousInteriors[i] = nodes[treelet.Interiors[i]];
+	}
+
+	// The root is assigned first, so it keeps its index
+	int32_t nextInterior = 0;
+	AssignTreeletNodes(inContext, treelet, fullSet, nextInterior);
+
+	// A cheaper but more lopsided treelet can push leaves past what the traversal stacks are sized for
+	if (inDepth + nodes[inRootIndex].Height > BVH_MAX_DEPTH)
+	{
+		for (int32_t i = 0; i < treelet.InteriorsCount; ++i)
+		{
+			nodes[treelet.Interiors[i]] = previousInteriors[i];
+		}
+	}
+}
+
+// Post order, so every treelet is restructured after the ones below it
+static void OptimizeTreelets(BVHBuildContext& inContext, const uint32_t inNodeIndex, const int32_t inDepth)
+{
+	BVHBuildNode& node = inContext.Nodes[inNodeIndex];
+
+	if (!node.IsLeaf())
+	{
+		const uint32_t children[2] = { static_cast<uint32_t>(node.LeftNode), static_cast<uint32_t>(node.RightNode) };
+
+		if (inContext.IsParallelRange(node.TrianglesCount))
+		{
+			std::for_each(std::execution::par, children, children + 2, [&inContext, inDepth](const uint32_t inChild)
+			{
+				OptimizeTreelets(inContext, inChild, inDepth + 1);
+			});
+		}
+		else
+		{
+			OptimizeTreelets(inContext, children[0], inDepth + 1);
+			OptimizeTreelets(inContext, children[1], inDepth + 1);
+		}
+	}
+
+	UpdateBuildNodeCost(inContext, node);
+
+	if (!node.IsLeaf())
+	{
+		RestructureTreelet(inContext, inNodeIndex, inDepth);
+	}
+}
+
+// Writes the subtree in depth first order, returns the index of the written node
+static uint32_t FlattenBVH(const BVHBuildContext& inContext, const int32_t inNodeIndex, const eastl::vector<PathTraceTriangle>& inTriangles, BVH& outBVH)
+{
+	const BVHBuildNode& buildNode = inContext.Nodes[inNodeIndex];
+
+	const uint32_t linearIndex = static_cast<uint32_t>(outBVH.Nodes.size());
+	outBVH.Nodes.push_back(BVHLinearNode());
+
+	BVHLinearNode linearNode;
+	linearNode.Bounds[0] = buildNode.BoundingBox.Min;
+	linearNode.Bounds[1] = buildNode.BoundingBox.Max;
+	linearNode.Pad = 0;
+
+	if (buildNode.IsLeaf())
+	{
+		ASSERT(buildNode.TrianglesCount <= UINT16_MAX);
+
+		linearNode.TrianglesOffset = static_cast<uint32_t>(outBVH.Triangles.size());
+		linearNode.TrianglesCount = static_cast<uint16_t>(buildNode.TrianglesCount);
+
+		for (uint32_t i = buildNode.TrianglesOffset; i < buildNode.TrianglesOffset + buildNode.TrianglesCount; ++i)
+		{
+			const uint32_t sourceIndex = inContext.Indices[i];
+			outBVH.Triangles.push_back(inTriangles[sourceIndex]);
+			outBVH.Triangles.back().SourceIndex = sourceIndex;
+		}
+	}
+	else
+	{
+		linearNode.TrianglesCount = 0;
+
+		// First child is implicitly linearIndex + 1
+		FlattenBVH(inContext, buildNode.LeftNode, inTriangles, outBVH);
+		linearNode.SecondChildIndex = FlattenBVH(inContext, buildNode.RightNode, inTriangles, outBVH);
+	}
+
+	outBVH.Nodes[linearIndex] = linearNode;
+
+	return linearIndex;
+}
+
+void BVH::Build(const eastl::vector<PathTraceTriangle>& inTriangles, const BVHBuildSettings& inSettings)
+{
+	LOG_INFO("Building BVH.");
+
+	Nodes.clear();
+	Triangles.clear();
+	Wide4.Clear();
+	Wide8.Clear();
+	TraversalWidth = EBVHWidth::Binary;
+	TriangleTest = inSettings.TriangleTest;
+	BuildSettings = inSettings;
+	BuiltCost = 0.f;
+	SourceTrianglesCount = static_cast<uint32_t>(inTriangles.size());
+
+	if (inTriangles.size() == 0)
+	{
+		return;
+	}
+
+	uint64_t cacheKey = 0;
+	if (inSettings.bUseDiskCache)
+	{
+		cacheKey = BVHCache::ComputeKey(inTriangles, inSettings);
+		if (BVHCache::TryLoad(cacheKey, inSettings, *this))
+		{
+			LOG_INFO("BVH loaded from cache.");
+
+			return;
+		}
+	}
+
+	const uint32_t trianglesCount = static_cast<uint32_t>(inTriangles.size());
+
+	BVHBuildContext context;
+
+	// Resolved up front so that the SAH can cost leaves by the packets the wide layout splits them into
+	context.Settings = inSettings;
+	context.Settings.TraversalWidth = GetSupportedBVHWidth(inSettings.TraversalWidth);
+	context.Settings.ParallelBuildMinSize = glm::max(inSettings.ParallelBuildMinSize, 1);
+
+	context.TriangleBounds.resize(trianglesCount);
+	context.TriangleCenters.resize(trianglesCount);
+	context.Indices.resize(trianglesCount);
+	std::iota(context.Indices.begin(), context.Indices.end(), 0);
+
+	auto cacheTriangle = [&context, &inTriangles](const uint32_t inIndex)
+	{
+		context.TriangleBounds[inIndex] = inTriangles[inIndex].GetBoundingBox();
+		context.TriangleCenters[inIndex] = inTriangles[inIndex].GetCenter();
+	};
+
+	if (context.IsParallelRange(trianglesCount))
+	{
+		std::for_each(std::execution::par, context.Indices.begin(), context.Indices.end(), cacheTriangle);
+	}
+	else
+	{
+		std::for_each(context.Indices.begin(), context.Indices.end(), cacheTriangle);
+	}
+
+	context.Nodes.resize(2 * trianglesCount - 1);
+	context.NodesCount = 1;
+
+	if (context.Settings.Strategy == EBVHBuildStrategy::SpatialSAH)
+	{
+		const uint32_t budget = static_cast<uint32_t>(trianglesCount * glm::max(inSettings.SpatialSplitBudget, 0.f));
+
+		BVHSpatialTask rootTask;
+		rootTask.Budget = budget;
+		rootTask.References.resize(trianglesCount);
+		for (uint32_t i = 0; i < trianglesCount; ++i)
+		{
+			rootTask.References[i].Bounds = context.TriangleBounds[i];
+			rootTask.References[i].TriangleIndex = i;
+		}
+
+		context.SourceTriangles = inTriangles.data();
+		context.RootArea = ComputeRangeBounds(context, 0, trianglesCount).Bounds.GetSurfaceArea();
+
+		// Every duplicate adds at most one leaf, and so two nodes
+		context.Indices.resize(trianglesCount + budget);
+		context.Nodes.resize(2 * (trianglesCount + budget) - 1);
+
+		RecursivelyBuildSpatialBVH(context, rootTask, 0);
+	}
+	else if (context.Settings.Strategy == EBVHBuildStrategy::LinearMorton)
+	{
+		const BVHRangeBounds rootBounds = ComputeRangeBounds(context, 0, trianglesCount);
+		SortByMortonCode(context, rootBounds.CenterBounds);
+		EmitMortonHierarchy(context, { 0, 0, trianglesCount }, 0);
+	}
+	else
+	{
+		RecursivelyBuildBVH(context, { 0, 0, trianglesCount }, 0);
+	}
+
+	for (int32_t pass = 0; pass < inSettings.TreeletOptimizationPasses; ++pass)
+	{
+		OptimizeTreelets(context, 0, 0);
+	}
+
+	Nodes.reserve(context.NodesCount);
+	Triangles.reserve(context.Settings.Strategy == EBVHBuildStrategy::SpatialSAH ? context.IndicesCount.load() : trianglesCount);
+	FlattenBVH(context, 0, inTriangles, *this);
+
+	TraversalWidth = context.Settings.TraversalWidth;
+	BuildWide();
+
+	BuiltCost = ComputeSAHCost();
+
+	if (inSettings.bUseDiskCache)
+	{
+		BVHCache::Save(cacheKey, *this);
+	}
+
+	LOG_INFO("BVH Building done.");
+}
+
+void BVH::BuildWide()
+{
+	switch (TraversalWidth)
+	{
+	case EBVHWidth::Four:
+	{
+		Wide4.Build(*this, BuildSettings.bQuantizeWideNodes);
+		break;
+	}
+	case EBVHWidth::Eight:
+	{
+		Wide8.Build(*this, BuildSettings.bQuantizeWideNodes);
+		break;
+	}
+	default:
+	{
+		break;
+	}
+	}
+}
+
+static inline float GetNodeSurfaceArea(const BVHLinearNode& inNode)
+{
+	const glm::vec3 size = inNode.Bounds[1] - inNode.Bounds[0];
+	return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+// Expected cost of a random ray hitting the root, see "Heuristics for ray tracing using space subdivision", MacDonald and Booth 1990
+float BVH::ComputeSAHCost() const
+{
+	const float rootArea = GetNodeSurfaceArea(Nodes[0]);
+	if (rootArea <= 0.f)
+	{
+		return 0.f;
+	}
+
+	const int32_t lanes = GetBVHWidthLanes(TraversalWidth);
+
+	float cost = 0.f;
+	for (const BVHLinearNode& node : Nodes)
+	{
+		const float area = GetNodeSurfaceArea(node);
+		cost += area * (node.IsLeaf() ? GetLeafCost(node.TrianglesCount, lanes) : BuildSettings.TraversalCost);
+	}
+
+	return cost / rootArea;
+}
+
+bool BVH::Refit(const eastl::vector<PathTraceTriangle>& inTriangles)
+{
+	// Deformed meshes would fill the disk cache with poses that never come back
+	BVHBuildSettings rebuildSettings = BuildSettings;
+	rebuildSettings.bUseDiskCache = false;
+
+	// Refitting would grow the clipped bounds of duplicated triangles back to whole triangles, which undoes what the spatial splits won
+	if (!IsValid() || inTriangles.size() != SourceTrianglesCount || BuildSettings.Strategy == EBVHBuildStrategy::SpatialSAH)
+	{
+		Build(inTriangles, rebuildSettings);
+
+		return true;
+	}
+
+	for (PathTraceTriangle& triangle : Triangles)
+	{
+		const uint32_t sourceIndex = triangle.SourceIndex;
+		triangle = inTriangles[sourceIndex];
+		triangle.SourceIndex = sourceIndex;
+	}
+
+	// Children are always stored after their parent, so going backwards visits them first
+	for (int32_t i = static_cast<int32_t>(Nodes.size()) - 1; i >= 0; --i)
+	{
+		BVHLinearNode& node = Nodes[i];
+
+		AABB bounds;
+		if (node.IsLeaf())
+		{
+			for (uint32_t t = node.TrianglesOffset; t < node.TrianglesOffset + node.TrianglesCount; ++t)
+			{
+				bounds += Triangles[t].GetBoundingBox();
+			}
+		}
+		else
+		{
+			const BVHLinearNode& firstChild = Nodes[i + 1];
+			const BVHLinearNode& secondChild = Nodes[node.SecondChildIndex];
+			bounds += firstChild.Bounds[0];
+			bounds += firstChild.Bounds[1];
+			bounds += secondChild.Bounds[0];
+			bounds += secondChild.Bounds[1];
+		}
+
+		node.Bounds[0] = bounds.Min;
+		node.Bounds[1] = bounds.Max;
+	}
+
+	if (ComputeSAHCost() > BuiltCost * BuildSettings.MaxRefitCostGrowth)
+	{
+		LOG_INFO("BVH degraded past the refit threshold, rebuilding.");
+		Build(inTriangles, rebuildSettings);
+
+		return true;
+	}
+
+	// Packets hold copies of the vertices and the collapse picks children by area, so the wide layout is simply collapsed again
+	BuildWide();
+
+	return false;
+}
+
+
+struct BVHTraversalEntry
+{
+	uint32_t NodeIndex;
+	float EntryDistance;
+};
+
+TriangleTestSettings BVH::GetTriangleTest(const bool inFlipFacing) const
+{
+	TriangleTestSettings triangleTest = TriangleTest;
+	triangleTest.bFlipFacing = triangleTest.bFlipFacing != inFlipFacing;
+
+	return triangleTest;
+}
+
+bool BVH::IsOccluded(const PathTracingRay& inRay, const float inMaxDistance, const bool inFlipFacing) const
+{
+	const TriangleTestSettings triangleTest = GetTriangleTest(inFlipFacing);
+
+	switch (TraversalWidth)
+	{
+	case EBVHWidth::Four:
+	{
+		return Wide4.IsOccluded(*this, inRay, inMaxDistance, triangleTest);
+	}
+	case EBVHWidth::Eight:
+	{
+		return Wide8.IsOccluded(*this, inRay, inMaxDistance, triangleTest);
+	}
+	default:
+	{
+		return IsOccludedBinary(inRay, inMaxDistance, triangleTest);
+	}
+	}
+}
+
+bool BVH::Trace(const PathTracingRay& inRay, PathTracePayload& outPayload, const bool inFlipFacing) const
+{
+	const TriangleTestSettings triangleTest = GetTriangleTest(inFlipFacing);
+
+	bool bHit = false;
+	switch (TraversalWidth)
+	{
+	case EBVHWidth::Four:
+	{
+		bHit = Wide4.Trace(*this, inRay, outPayload, triangleTest);
+		break;
+	}
+	case EBVHWidth::Eight:
+	{
+		bHit = Wide8.Trace(*this, inRay, outPayload, triangleTest);
+		break;
+	}
+	default:
+	{
+		bHit = TraceBinary(inRay, outPayload, triangleTest);
+		break;
+	}
+	}
+
+	if (bHit)
+	{
+		// Flipped faces wind the other way round, their front side is the one WSNormal points away from
+		outPayload.Normal = triangleTest.bFlipFacing ? -outPayload.Triangle->WSNormalNormalized : outPayload.Triangle->WSNormalNormalized;
+		outPayload.InstanceIndex = -1;
+	}
+
+	return bHit;
+}
+
+bool BVH::IsOccludedBinary(const PathTracingRay& inRay, const float inMaxDistance, const TriangleTestSettings& inTriangleTest) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	const float maxDistance = glm::min(inMaxDistance, inRay.TMax);
+
+	// Depth is capped at build time so this can never overflow
+	uint32_t stack[BVH_MAX_DEPTH + 1];
+	int32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t nodeIndex = stack[--stackSize];
+		const BVHLinearNode& node = Nodes[nodeIndex];
+
+		float entryDistance;
+		if (!RayIntersectsAABB(inRay, node.Bounds, maxDistance, entryDistance))
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.TrianglesOffset; i < node.TrianglesOffset + node.TrianglesCount; ++i)
+			{
+				if (IntersectsTriangle(inRay, Triangles[i], maxDistance, inTriangleTest))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			// Any hit ends the query so order does not matter
+			stack[stackSize++] = node.SecondChildIndex;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
 
 	return false;
 }
 
-float BVH::Trace(const PathTracingRay& inRay, PathTracePayload& outPayload) const
+bool BVH::TraceBinary(const PathTracingRay& inRay, PathTracePayload& outPayload, const TriangleTestSettings& inTriangleTest) const
 {
-	return Root->Trace(inRay, outPayload);
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	float rootEntryDistance;
+	if (!RayIntersectsAABB(inRay, Nodes[0].Bounds, glm::min(outPayload.Distance, inRay.TMax), rootEntryDistance))
+	{
+		return false;
+	}
+
+	// Holds the farther child of every interior node on the current path, depth is capped at build time so this can never overflow
+	BVHTraversalEntry stack[BVH_MAX_DEPTH];
+	int32_t stackSize = 0;
+
+	uint32_t nodeIndex = 0;
+	bool bHit = false;
+
+	while (true)
+	{
+		const BVHLinearNode& node = Nodes[nodeIndex];
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.TrianglesOffset; i < node.TrianglesOffset + node.TrianglesCount; ++i)
+			{
+				PathTracePayload currPayload;
+				if (TraceTriangle(inRay, Triangles[i], currPayload, inTriangleTest) && currPayload.Distance < outPayload.Distance)
+				{
+					bHit = true;
+					outPayload = currPayload;
+				}
+			}
+		}
+		else
+		{
+			const float maxDistance = glm::min(outPayload.Distance, inRay.TMax);
+
+			uint32_t nearChild = nodeIndex + 1;
+			uint32_t farChild = node.SecondChildIndex;
+
+			float nearEntryDistance, farEntryDistance;
+			const bool nearHit = RayIntersectsAABB(inRay, Nodes[nearChild].Bounds, maxDistance, nearEntryDistance);
+			const bool farHit = RayIntersectsAABB(inRay, Nodes[farChild].Bounds, maxDistance, farEntryDistance);
+
+			if (nearHit && farHit)
+			{
+				if (farEntryDistance < nearEntryDistance)
+				{
+					std::swap(nearChild, farChild);
+					std::swap(nearEntryDistance, farEntryDistance);
+				}
+
+				stack[stackSize++] = { farChild, farEntryDistance };
+				nodeIndex = nearChild;
+
+				continue;
+			}
+			else if (nearHit)
+			{
+				nodeIndex = nearChild;
+
+				continue;
+			}
+			else if (farHit)
+			{
+				nodeIndex = farChild;
+
+				continue;
+			}
+		}
+
+		// Pop the next node, skipping the ones that start past the closest hit found since they were pushed
+		bool bFoundNode = false;
+		while (stackSize > 0)
+		{
+			const BVHTraversalEntry& entry = stack[--stackSize];
+			if (entry.EntryDistance < outPayload.Distance)
+			{
+				nodeIndex = entry.NodeIndex;
+				bFoundNode = true;
+
+				break;
+			}
+		}
+
+		if (!bFoundNode)
+		{
+			break;
+		}
+	}
+
+	return bHit;
+}
+
+int32_t BVH::TracePacket(const RayPacket<4>& inPacket, PathTracePayload outPayloads[4], const bool inFlipFacing) const
+{
+	return TracePacketBinary<4>(inPacket, outPayloads, GetTriangleTest(inFlipFacing));
+}
+
+int32_t BVH::TracePacket(const RayPacket<8>& inPacket, PathTracePayload outPayloads[8], const bool inFlipFacing) const
+{
+	return TracePacketBinary<8>(inPacket, outPayloads, GetTriangleTest(inFlipFacing));
+}
+
+template<int32_t Width>
+int32_t BVH::TracePacketBinary(const RayPacket<Width>& inPacket, PathTracePayload outPayloads[Width], const TriangleTestSettings& inTriangleTest) const
+{
+	if (!IsValid() || inPacket.ActiveMask == 0)
+	{
+		return 0;
+	}
+
+	// Closest hit of every lane so far, starts from what the payloads already hold like Trace does
+	alignas(32) float distances[Width];
+	alignas(32) float maxDistances[Width];
+	float us[Width];
+	float vs[Width];
+	const PathTraceTriangle* triangles[Width];
+
+	float packetMaxDistance = -INFINITY;
+	for (int32_t lane = 0; lane < Width; ++lane)
+	{
+		distances[lane] = outPayloads[lane].Distance;
+		maxDistances[lane] = glm::min(distances[lane], inPacket.TMax[lane]);
+		us[lane] = 0.f;
+		vs[lane] = 0.f;
+		triangles[lane] = nullptr;
+
+		if (((inPacket.ActiveMask >> lane) & 1) != 0)
+		{
+			packetMaxDistance = glm::max(packetMaxDistance, maxDistances[lane]);
+		}
+	}
+
+	// Depth is capped at build time so this can never overflow
+	uint32_t stack[BVH_MAX_DEPTH + 1];
+	int32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	int32_t hitMask = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t nodeIndex = stack[--stackSize];
+		const BVHLinearNode& node = Nodes[nodeIndex];
+
+		// One test for the whole packet first, most boxes are missed by all of its rays or by none
+		if (PacketMissesAABB(inPacket, node.Bounds, packetMaxDistance))
+		{
+			continue;
+		}
+
+		const int32_t lanesMask = IntersectPacketAABB(inPacket, node.Bounds, maxDistances, inPacket.ActiveMask);
+		if (lanesMask == 0)
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			int32_t leafHitMask = 0;
+			for (uint32_t i = node.TrianglesOffset; i < node.TrianglesOffset + node.TrianglesCount; ++i)
+			{
+				const int32_t triangleHitMask = TraceTriangleForPacket(inPacket, Triangles[i], inTriangleTest, lanesMask, distances, us, vs);
+				for (int32_t lane = 0; lane < Width; ++lane)
+				{
+					if (((triangleHitMask >> lane) & 1) != 0)
+					{
+						triangles[lane] = &Triangles[i];
+					}
+				}
+
+				leafHitMask |= triangleHitMask;
+			}
+
+			if (leafHitMask != 0)
+			{
+				hitMask |= leafHitMask;
+
+				packetMaxDistance = -INFINITY;
+				for (int32_t lane = 0; lane < Width; ++lane)
+				{
+					maxDistances[lane] = glm::min(distances[lane], inPacket.TMax[lane]);
+					if (((inPacket.ActiveMask >> lane) & 1) != 0)
+					{
+						packetMaxDistance = glm::max(packetMaxDistance, maxDistances[lane]);
+					}
+				}
+			}
+		}
+		else
+		{
+			// The rays' own entry distances differ per lane, the packet's mean direction decides which child is nearer for all of them
+			uint32_t nearChild = nodeIndex + 1;
+			uint32_t farChild = node.SecondChildIndex;
+
+			const glm::vec3 centersOffset = (Nodes[farChild].Bounds[0] + Nodes[farChild].Bounds[1]) - (Nodes[nearChild].Bounds[0] + Nodes[nearChild].Bounds[1]);
+			if (glm::dot(centersOffset, inPacket.MeanDirection) < 0.f)
+			{
+				std::swap(nearChild, farChild);
+			}
+
+			stack[stackSize++] = farChild;
+			stack[stackSize++] = nearChild;
+		}
+	}
+
+	for (int32_t lane = 0; lane < Width; ++lane)
+	{
+		if (((hitMask >> lane) & 1) != 0)
+		{
+			PathTracePayload& payload = outPayloads[lane];
+			payload.Distance = distances[lane];
+			payload.U = us[lane];
+			payload.V = vs[lane];
+			payload.Triangle = triangles[lane];
+			payload.Normal = inTriangleTest.bFlipFacing ? -triangles[lane]->WSNormalNormalized : triangles[lane]->WSNormalNormalized;
+			payload.InstanceIndex = -1;
+		}
+	}
+
+	return hitMask;
 }
@@ -5,38 +5,187 @@
 #include "EASTL/array.h"
 #include "AABB.h"
 #include "Math/PathTracing.h"
+#include "Math/RayPacket.h"
+#include "Math/WideBVH.h"
+#include "Utils/AlignedAllocator.h"
+#include <type_traits>
 
-struct BVHNode
+enum class EBVHBuildStrategy : uint8_t
 {
-	BVHNode();
-	~BVHNode();
+	// Split at the mean triangle center along the longest axis
+	MeanCentroid,
+	// Binned Surface Area Heuristic, evaluated on all three axes
+	BinnedSAH,
+	// Binned SAH that may also split space, a triangle crossing the plane goes to both sides clipped to each.
+	// Much better trees for long, slanted triangles at the cost of build time and some duplicated triangles
+	SpatialSAH,
+	// Linear BVH, triangles sorted along a Morton curve and split at the highest bit their codes differ in.
+	// Far faster to build than the SAH but the trees are worse, TreeletOptimizationPasses wins part of that back
+	LinearMorton
+};
 
-	AABB BoundingBox;
+struct BVHBuildSettings
+{
+	EBVHBuildStrategy Strategy = EBVHBuildStrategy::BinnedSAH;
 
-	struct BVHNode* LeftNode = nullptr;
-	struct BVHNode* RightNode = nullptr;
+	// Nodes with this many triangles or less always become leaves
+	int32_t MinLeafSize = 2;
 
-	eastl::vector<PathTraceTriangle> Triangles;
+	// SAH may stop splitting nodes up to this size if a leaf is cheaper than any split
+	int32_t MaxLeafSize = 8;
 
-	bool Intersects(const PathTracingRay& inRay) const;
-	bool Trace(const PathTracingRay& inRay, PathTracePayload& outPayload) const;
+	// Number of buckets per axis the SAH is evaluated at, clamped to [2, BVH_MAX_SAH_BINS]
+	int32_t BinCount = 16;
 
+	// Cost of visiting a node relative to a single triangle test
+	float TraversalCost = 1.f;
 
-	void DebugDraw() const;
+	// Layout traversed by Trace and IsOccluded, wide layouts are collapsed from the binary tree after it is built
+	EBVHWidth TraversalWidth = EBVHWidth::Auto;
+
+	// Wide layouts only, store child bounds as 8 bit offsets from their node's box. Nodes take half the memory
+	// so twice as many stay in cache, for slightly looser boxes and a few more instructions per node test
+	bool bQuantizeWideNodes = true;
+
+	// Kernel and culling used against the triangles by Trace and IsOccluded
+	TriangleTestSettings TriangleTest;
+
+	// SpatialSAH only, how many triangle duplicates the build may create, as a fraction of the triangle count
+	float SpatialSplitBudget = 0.3f;
+
+	// SpatialSAH only, spatial splits are tried where the sides of the best object split overlap by more than this fraction of the root's area
+	float SpatialSplitOverlapThreshold = 1e-5f;
+
+	// LinearMorton only, 21 bits per axis instead of 10. For large meshes where many centers would share a cell
+	bool bUse63BitMortonCodes = false;
+
+	// Treelet restructuring passes run over the built tree, each one rearranges groups of up to 7 subtrees into their best SAH topology
+	int32_t TreeletOptimizationPasses = 0;
+
+	// Nodes with at least this many triangles reduce their bounds, bin and build their two subtrees as parallel tasks
+	int32_t ParallelBuildMinSize = 4096;
 
+	// Load the built tree from BVHCache if a matching file exists, save it there otherwise
+	bool bUseDiskCache = false;
+
+	// Refit rebuilds instead once the SAH cost of the refitted tree exceeds the built one by this factor
+	float MaxRefitCostGrowth = 2.f;
 };
 
+#define BVH_MAX_SAH_BINS 32
+
+// Deeper nodes are forced to become leaves, which bounds the traversal stack
+#define BVH_MAX_DEPTH 64
+
+// Far slab distances of box tests are scaled by 1 + 2 * gamma(3), rounded up, so that float error can never cull a box
+// the ray only grazes. Without it rays going through shared vertices leak past leaves. See "Robust BVH Ray Traversal", Ize 2013
+#define BVH_ROBUST_EXIT_SCALE 1.0000008f
+
+// Node of the flattened tree. Nodes are stored in depth first order, so the first child of an interior node
+// is always the node right after it and only the second child needs to be addressed explicitly.
+struct alignas(32) BVHLinearNode
+{
+	// Min and Max
+	glm::vec3 Bounds[2];
+
+	union
+	{
+		// Leaf: index of the first triangle in BVH::Triangles
+		uint32_t TrianglesOffset;
+		// Interior: index of the second child in BVH::Nodes
+		uint32_t SecondChildIndex;
+	};
+
+	// 0 for interior nodes
+	uint16_t TrianglesCount;
+	uint16_t Pad;
+
+	inline bool IsLeaf() const { return TrianglesCount != 0; }
+};
+
+static_assert(sizeof(BVHLinearNode) == 32, "BVHLinearNode is expected to fit in half a cache line.");
+static_assert(std::is_trivially_copyable<BVHLinearNode>::value, "BVHLinearNode arrays are expected to be copyable as raw memory.");
+
+// Slab Method
+// https://tavianator.com/2011/ray_box.html
+// Branchless version, the ray's sign bits pick the near and far bound on each axis so no swaps are needed.
+// Outputs the distance at which the ray enters the box, boxes outside of [TMin, inMaxDistance] are rejected
+inline bool RayIntersectsAABB(const PathTracingRay& inRay, const glm::vec3 inBounds[2], const float inMaxDistance, OUT float& outEntryDistance)
+{
+	const float txMin = (inBounds[inRay.DirIsNegative[0]].x - inRay.Origin.x) * inRay.InvDirection.x;
+	const float txMax = (inBounds[1 - inRay.DirIsNegative[0]].x - inRay.Origin.x) * inRay.InvDirection.x;
+	const float tyMin = (inBounds[inRay.DirIsNegative[1]].y - inRay.Origin.y) * inRay.InvDirection.y;
+	const float tyMax = (inBounds[1 - inRay.DirIsNegative[1]].y - inRay.Origin.y) * inRay.InvDirection.y;
+	const float tzMin = (inBounds[inRay.DirIsNegative[2]].z - inRay.Origin.z) * inRay.InvDirection.z;
+	const float tzMax = (inBounds[1 - inRay.DirIsNegative[2]].z - inRay.Origin.z) * inRay.InvDirection.z;
+
+	// The interval goes first so a NaN slab (origin on a plane of a zero direction axis) is ignored instead of rejecting the box
+	const float tEntry = glm::max(glm::max(glm::max(inRay.TMin, txMin), tyMin), tzMin);
+	const float tExit = glm::min(glm::min(glm::min(inMaxDistance, txMax * BVH_ROBUST_EXIT_SCALE), tyMax * BVH_ROBUST_EXIT_SCALE), tzMax * BVH_ROBUST_EXIT_SCALE);
+
+	outEntryDistance = tEntry;
+
+	return tEntry <= tExit;
+}
+
 struct BVH
 {
-	BVH();
-	~BVH();
+	void Build(const eastl::vector<PathTraceTriangle>& inTriangles, const BVHBuildSettings& inSettings = BVHBuildSettings());
+
+	// Keeps the tree and only updates its bounds bottom up, for meshes whose vertices moved but whose triangles did not change.
+	// inTriangles must match the ones Build was given, same count and order. Returns true if the tree was rebuilt instead
+	// because refitting grew its SAH cost past BVHBuildSettings::MaxRefitCostGrowth. SpatialSAH trees are always rebuilt
+	bool Refit(const eastl::vector<PathTraceTriangle>& inTriangles);
+
+	// Closest hit, only returns true and fills outPayload if a hit closer than outPayload.Distance is found.
+	// inFlipFacing swaps front and back faces on top of TriangleTest, for a BLAS seen through a mirroring instance transform
+	bool Trace(const PathTracingRay& inRay, PathTracePayload& outPayload, const bool inFlipFacing = false) const;
+
+	// Any hit, for shadow and visibility rays. Stops at the first triangle hit closer than inMaxDistance
+	bool IsOccluded(const PathTracingRay& inRay, const float inMaxDistance = INFINITY, const bool inFlipFacing = false) const;
+
+	// Closest hits of a packet of coherent rays, each lane behaves like Trace with its own payload. Returns the lanes that found a closer hit.
+	// Packets always go down the binary nodes whatever the TraversalWidth, a node box per lane is what the SIMD registers are spent on
+	int32_t TracePacket(const RayPacket<4>& inPacket, PathTracePayload outPayloads[4], const bool inFlipFacing = false) const;
+	int32_t TracePacket(const RayPacket<8>& inPacket, PathTracePayload outPayloads[8], const bool inFlipFacing = false) const;
+
+	void DebugDraw() const;
+
+	inline bool IsValid() const { return !Nodes.empty(); }
+
+	// Binary, Four or Eight, never Auto once built
+	EBVHWidth TraversalWidth = EBVHWidth::Binary;
+
+	TriangleTestSettings TriangleTest;
+
+	// As given to Build, reused when Refit decides to rebuild
+	BVHBuildSettings BuildSettings;
+
+	// SAH cost of the tree when it was last built, relative to a single triangle test
+	float BuiltCost = 0.f;
+
+	// Depth first order, Nodes[0] is the root
+	eastl::vector<BVHLinearNode, AlignedAllocator> Nodes;
+
+	// All triangles of the mesh, ordered so that each leaf references a contiguous range
+	eastl::vector<PathTraceTriangle> Triangles;
+
+	// Size of the array Build was given, Triangles holds some of them more than once after spatial splits
+	uint32_t SourceTrianglesCount = 0;
+
+	// Only built for the matching TraversalWidth
+	WideBVH<4> Wide4;
+	WideBVH<8> Wide8;
 
-	void Build(const eastl::vector<PathTraceTriangle>& inTriangles);
+private:
+	void BuildWide();
+	float ComputeSAHCost() const;
 
-	bool Intersects(const PathTracingRay& inRay) const;
-	float Trace(const PathTracingRay& inRay, PathTracePayload& outPayload) const;
+	TriangleTestSettings GetTriangleTest(const bool inFlipFacing) const;
 
-	inline bool IsValid() { return Root != nullptr; }
+	bool TraceBinary(const PathTracingRay& inRay, PathTracePayload& outPayload, const TriangleTestSettings& inTriangleTest) const;
+	bool IsOccludedBinary(const PathTracingRay& inRay, const float inMaxDistance, const TriangleTestSettings& inTriangleTest) const;
 
-	BVHNode* Root = nullptr;
+	template<int32_t Width>
+	int32_t TracePacketBinary(const RayPacket<Width>& inPacket, PathTracePayload outPayloads[Width], const TriangleTestSettings& inTriangleTest) const;
 };
\ No newline at end of file
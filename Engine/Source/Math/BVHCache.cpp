@@ -0,0 +1,352 @@
+#include "Math/BVHCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+#include "EASTL/string.h"
+#include "Logger/Logger.h"
+#include "Math/BVH.h"
+#include "Utils/HashUtils.h"
+#include "Utils/IOUtils.h"
+#include "Utils/MappedFile.h"
+
+// Bump whenever anything written below changes meaning, older files are then ignored and rebuilt
+#define BVH_CACHE_VERSION 2
+
+// "BVHC"
+#define BVH_CACHE_MAGIC 0x43485642u
+
+static const char* const BVHCacheDirectory = "../Data/Cache/BVH/";
+static const char* const BVHCacheDescription = "BVH cache";
+
+static_assert(std::is_trivially_copyable<BVHLinearNode>::value, "Cached arrays are read and written as raw memory.");
+static_assert(std::is_trivially_copyable<PathTraceTriangle>::value, "Cached arrays are read and written as raw memory.");
+static_assert(std::is_trivially_copyable<BVHWideNode<8>>::value && std::is_trivially_copyable<TrianglePacket<8>>::value, "Cached arrays are read and written as raw memory.");
+static_assert(std::is_trivially_copyable<BVHQuantizedWideNode<8>>::value, "Cached arrays are read and written as raw memory.");
+
+struct BVHCacheHeader
+{
+	uint32_t Magic = BVH_CACHE_MAGIC;
+	uint32_t Version = BVH_CACHE_VERSION;
+	uint64_t Key = 0;
+
+	// Catches files written by a build where the structs are laid out differently
+	uint32_t NodeSize = 0;
+	uint32_t TriangleSize = 0;
+	uint32_t WideNodeSize = 0;
+	uint32_t PacketSize = 0;
+
+	uint32_t TraversalWidth = 0;
+	uint32_t SourceTrianglesCount = 0;
+	float BuiltCost = 0.f;
+
+	uint32_t NodesCount = 0;
+	uint32_t TrianglesCount = 0;
+	uint32_t WideNodesCount = 0;
+	uint32_t PacketsCount = 0;
+	uint32_t Pad = 0;
+};
+
+static eastl::string GetCacheFilePath(const uint64_t inKey)
+{
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "%016llx.bvh", static_cast<unsigned long long>(inKey));
+
+	return eastl::string(BVHCacheDirectory) + fileName;
+}
+
+// Copies inCount elements from inOutCursor and moves it past them, the file size was checked against the header counts beforehand
+template<typename VectorType>
+static void ReadArray(const uint8_t*& inOutCursor, const uint32_t inCount, OUT VectorType& outArray)
+{
+	const size_t size = static_cast<size_t>(inCount) * sizeof(typename VectorType::value_type);
+
+	outArray.resize(inCount);
+	memcpy(outArray.data(), inOutCursor, size);
+	inOutCursor += size;
+}
+
+// Wide nodes are whichever of the two layouts the settings asked for
+template<int32_t Width>
+static void SetWideSizes(const WideBVH<Width>& inWide, const bool inQuantized, OUT BVHCacheHeader& outHeader)
+{
+	outHeader.WideNodeSize = inQuantized ? sizeof(BVHQuantizedWideNode<Width>) : sizeof(BVHWideNode<Width>);
+	outHeader.PacketSize = sizeof(TrianglePacket<Width>);
+	outHeader.WideNodesCount = static_cast<uint32_t>(inQuantized ? inWide.QuantizedNodes.size() : inWide.Nodes.size());
+	outHeader.PacketsCount = static_cast<uint32_t>(inWide.Packets.size());
+}
+
+template<int32_t Width>
+static void ReadWide(const uint8_t*& inOutCursor, const BVHCacheHeader& inHeader, const bool inQuantized, OUT WideBVH<Width>& outWide)
+{
+	if (inQuantized)
+	{
+		ReadArray(inOutCursor, inHeader.WideNodesCount, outWide.QuantizedNodes);
+	}
+	else
+	{
+		ReadArray(inOutCursor, inHeader.WideNodesCount, outWide.Nodes);
+	}
+
+	ReadArray(inOutCursor, inHeader.PacketsCount, outWide.Packets);
+}
+
+// Files are only trusted to be laid out like the structs, not to be intact. Every index traversal follows has to stay inside its array
+// and children have to come after their parent, so that a corrupted file can never send traversal outside of the arrays or round in a loop
+static bool AreNodesValid(const BVH& inBVH)
+{
+	const uint32_t nodesCount = static_cast<uint32_t>(inBVH.Nodes.size());
+	const uint64_t trianglesCount = inBVH.Triangles.size();
+
+	for (uint32_t i = 0; i < nodesCount; ++i)
+	{
+		const BVHLinearNode& node = inBVH.Nodes[i];
+		if (node.IsLeaf())
+		{
+			if (static_cast<uint64_t>(node.TrianglesOffset) + node.TrianglesCount > trianglesCount)
+			{
+				return false;
+			}
+		}
+		else if (i + 1 >= nodesCount || node.SecondChildIndex <= i + 1 || node.SecondChildIndex >= nodesCount)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Empty children have inverted bounds, traversal never enters them whatever their index
+template<int32_t Width>
+static inline bool IsChildEmpty(const BVHWideNode<Width>& inNode, const int32_t inChild)
+{
+	return inNode.BoundsMin[0][inChild] > inNode.BoundsMax[0][inChild];
+}
+
+template<int32_t Width>
+static inline bool IsChildEmpty(const BVHQuantizedWideNode<Width>& inNode, const int32_t inChild)
+{
+	return inNode.QuantizedMin[0][inChild] > inNode.QuantizedMax[0][inChild];
+}
+
+template<int32_t Width, typename NodesType>
+static bool AreWideNodesValid(const NodesType& inNodes, const WideBVH<Width>& inWide, const uint64_t inTrianglesCount)
+{
+	const uint32_t nodesCount = static_cast<uint32_t>(inNodes.size());
+	const uint64_t packetsCount = inWide.Packets.size();
+
+	for (uint32_t i = 0; i < nodesCount; ++i)
+	{
+		for (int32_t child = 0; child < Width; ++child)
+		{
+			if (IsChildEmpty(inNodes[i], child))
+			{
+				continue;
+			}
+
+			const uint32_t childIndex = inNodes[i].ChildIndex[child];
+			const uint16_t childPacketsCount = inNodes[i].ChildPacketsCount[child];
+			if (childPacketsCount > 0 ? static_cast<uint64_t>(childIndex) + childPacketsCount > packetsCount : childIndex <= i || childIndex >= nodesCount)
+			{
+				return false;
+			}
+		}
+	}
+
+	for (const TrianglePacket<Width>& packet : inWide.Packets)
+	{
+		for (int32_t lane = 0; lane < Width; ++lane)
+		{
+			if (packet.TriangleIndex[lane] >= inTrianglesCount)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+template<int32_t Width>
+static bool IsWideValid(const WideBVH<Width>& inWide, const uint64_t inTrianglesCount)
+{
+	return inWide.IsQuantized() ? AreWideNodesValid(inWide.QuantizedNodes, inWide, inTrianglesCount) : AreWideNodesValid(inWide.Nodes, inWide, inTrianglesCount);
+}
+
+template<int32_t Width>
+static void AddWideBlocks(const WideBVH<Width>& inWide, eastl::vector<IOUtils::FileBlock>& inOutBlocks)
+{
+	if (inWide.IsQuantized())
+	{
+		inOutBlocks.push_back(IOUtils::GetArrayBlock(inWide.QuantizedNodes));
+	}
+	else
+	{
+		inOutBlocks.push_back(IOUtils::GetArrayBlock(inWide.Nodes));
+	}
+
+	inOutBlocks.push_back(IOUtils::GetArrayBlock(inWide.Packets));
+}
+
+namespace BVHCache
+{
+	uint64_t ComputeKey(const eastl::vector<PathTraceTriangle>& inTriangles, const BVHBuildSettings& inSettings)
+	{
+		uint64_t hash = HashUtils::FNVOffsetBasis;
+
+		// Only the vertices, everything else in a triangle is derived from them
+		for (const PathTraceTriangle& triangle : inTriangles)
+		{
+			HashUtils::HashBytes(hash, triangle.V, sizeof(triangle.V));
+		}
+
+		// Auto is hashed resolved, a file built for AVX must not be picked up on a CPU without it
+		HashUtils::HashValue(hash, GetSupportedBVHWidth(inSettings.TraversalWidth));
+		HashUtils::HashValue(hash, inSettings.Strategy);
+		HashUtils::HashValue(hash, inSettings.MinLeafSize);
+		HashUtils::HashValue(hash, inSettings.MaxLeafSize);
+		HashUtils::HashValue(hash, inSettings.BinCount);
+		HashUtils::HashValue(hash, inSettings.TraversalCost);
+		HashUtils::HashValue(hash, inSettings.SpatialSplitBudget);
+		HashUtils::HashValue(hash, inSettings.SpatialSplitOverlapThreshold);
+		HashUtils::HashValue(hash, inSettings.bUse63BitMortonCodes);
+		HashUtils::HashValue(hash, inSettings.TreeletOptimizationPasses);
+		HashUtils::HashValue(hash, inSettings.bQuantizeWideNodes);
+
+		return hash;
+	}
+
+	bool TryLoad(const uint64_t inKey, const BVHBuildSettings& inSettings, OUT BVH& outBVH)
+	{
+		const eastl::string filePath = GetCacheFilePath(inKey);
+
+		MappedFile file;
+		if (!IOUtils::TryMapCacheFile(filePath, BVH_CACHE_MAGIC, BVH_CACHE_VERSION, inKey, sizeof(BVHCacheHeader), BVHCacheDescription, file))
+		{
+			return false;
+		}
+
+		BVHCacheHeader header;
+		memcpy(&header, file.GetData(), sizeof(header));
+
+		const EBVHWidth width = static_cast<EBVHWidth>(header.TraversalWidth);
+		BVHCacheHeader expected;
+		switch (width)
+		{
+		case EBVHWidth::Four:
+		{
+			SetWideSizes(WideBVH<4>(), inSettings.bQuantizeWideNodes, expected);
+			break;
+		}
+		case EBVHWidth::Eight:
+		{
+			SetWideSizes(WideBVH<8>(), inSettings.bQuantizeWideNodes, expected);
+			break;
+		}
+		default:
+		{
+			break;
+		}
+		}
+
+		if (header.NodeSize != sizeof(BVHLinearNode) || header.TriangleSize != sizeof(PathTraceTriangle)
+			|| header.WideNodeSize != expected.WideNodeSize || header.PacketSize != expected.PacketSize)
+		{
+			LOG_WARNING("Ignoring outdated BVH cache file %s.", filePath.c_str());
+
+			return false;
+		}
+
+		// Sizes of binary files are 0 for the wide arrays
+		const uint64_t payloadSize = static_cast<uint64_t>(header.NodesCount) * header.NodeSize + static_cast<uint64_t>(header.TrianglesCount) * header.TriangleSize
+			+ static_cast<uint64_t>(header.WideNodesCount) * header.WideNodeSize + static_cast<uint64_t>(header.PacketsCount) * header.PacketSize;
+		if (!IOUtils::CheckCacheFileSize(filePath, file, sizeof(header), payloadSize, BVHCacheDescription))
+		{
+			return false;
+		}
+
+		BVH loaded;
+		const uint8_t* cursor = file.GetData() + sizeof(header);
+		ReadArray(cursor, header.NodesCount, loaded.Nodes);
+		ReadArray(cursor, header.TrianglesCount, loaded.Triangles);
+
+		bool bValid = AreNodesValid(loaded);
+
+		switch (width)
+		{
+		case EBVHWidth::Four:
+		{
+			ReadWide(cursor, header, inSettings.bQuantizeWideNodes, loaded.Wide4);
+			bValid = bValid && IsWideValid(loaded.Wide4, loaded.Triangles.size());
+			break;
+		}
+		case EBVHWidth::Eight:
+		{
+			ReadWide(cursor, header, inSettings.bQuantizeWideNodes, loaded.Wide8);
+			bValid = bValid && IsWideValid(loaded.Wide8, loaded.Triangles.size());
+			break;
+		}
+		default:
+		{
+			break;
+		}
+		}
+
+		if (!bValid)
+		{
+			LOG_WARNING("BVH cache file %s is corrupted.", filePath.c_str());
+
+			return false;
+		}
+
+		loaded.TraversalWidth = width;
+		loaded.TriangleTest = inSettings.TriangleTest;
+		loaded.BuildSettings = inSettings;
+		loaded.BuiltCost = header.BuiltCost;
+		loaded.SourceTrianglesCount = header.SourceTrianglesCount;
+
+		outBVH = std::move(loaded);
+
+		return true;
+	}
+
+	void Save(const uint64_t inKey, const BVH& inBVH)
+	{
+		BVHCacheHeader header;
+		header.Key = inKey;
+		header.NodeSize = sizeof(BVHLinearNode);
+		header.TriangleSize = sizeof(PathTraceTriangle);
+		header.TraversalWidth = static_cast<uint32_t>(inBVH.TraversalWidth);
+		header.SourceTrianglesCount = inBVH.SourceTrianglesCount;
+		header.BuiltCost = inBVH.BuiltCost;
+		header.NodesCount = static_cast<uint32_t>(inBVH.Nodes.size());
+		header.TrianglesCount = static_cast<uint32_t>(inBVH.Triangles.size());
+
+		eastl::vector<IOUtils::FileBlock> blocks;
+		blocks.push_back(IOUtils::FileBlock{ &header, sizeof(header) });
+		blocks.push_back(IOUtils::GetArrayBlock(inBVH.Nodes));
+		blocks.push_back(IOUtils::GetArrayBlock(inBVH.Triangles));
+
+		switch (inBVH.TraversalWidth)
+		{
+		case EBVHWidth::Four:
+		{
+			SetWideSizes(inBVH.Wide4, inBVH.Wide4.IsQuantized(), header);
+			AddWideBlocks(inBVH.Wide4, blocks);
+			break;
+		}
+		case EBVHWidth::Eight:
+		{
+			SetWideSizes(inBVH.Wide8, inBVH.Wide8.IsQuantized(), header);
+			AddWideBlocks(inBVH.Wide8, blocks);
+			break;
+		}
+		default:
+		{
+			break;
+		}
+		}
+
+		IOUtils::WriteFileAtomic(GetCacheFilePath(inKey), blocks, BVHCacheDescription);
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Core/EngineUtils.h"
+#include "EASTL/vector.h"
+
+struct BVH;
+struct BVHBuildSettings;
+struct PathTraceTriangle;
+
+// Built BVHs stored on disk, one file per key, so that later runs skip construction.
+// Files hold the flattened arrays exactly as they are laid out in memory and are read straight into them.
+namespace BVHCache
+{
+	// Hash of the vertices and of every setting that changes the built tree
+	uint64_t ComputeKey(const eastl::vector<PathTraceTriangle>& inTriangles, const BVHBuildSettings& inSettings);
+
+	// Fails without touching outBVH if there is no file for the key or if it was written by an incompatible build
+	bool TryLoad(const uint64_t inKey, const BVHBuildSettings& inSettings, OUT BVH& outBVH);
+
+	void Save(const uint64_t inKey, const BVH& inBVH);
+}
@@ -1,5 +1,38 @@
 #include "Math/PathTracing.h"
 
+PathTracingRay::PathTracingRay(const glm::vec3& inOrigin, const glm::vec3& inDirection, const float inTMin, const float inTMax)
+	: Origin(inOrigin), TMin(inTMin), TMax(inTMax)
+{
+	SetDirection(inDirection);
+}
+
+void PathTracingRay::SetDirection(const glm::vec3& inDirection)
+{
+	Direction = inDirection;
+	InvDirection = 1.f / inDirection;
+
+	DirIsNegative[0] = InvDirection.x < 0.f;
+	DirIsNegative[1] = InvDirection.y < 0.f;
+	DirIsNegative[2] = InvDirection.z < 0.f;
+
+	const glm::vec3 absDirection = glm::abs(inDirection);
+	const int32_t kz = absDirection.x > absDirection.y ? (absDirection.x > absDirection.z ? 0 : 2) : (absDirection.y > absDirection.z ? 1 : 2);
+	int32_t kx = (kz + 1) % 3;
+	int32_t ky = (kx + 1) % 3;
+	if (inDirection[kz] < 0.f)
+	{
+		std::swap(kx, ky);
+	}
+
+	ShearAxes[0] = kx;
+	ShearAxes[1] = ky;
+	ShearAxes[2] = kz;
+
+	Shear.x = inDirection[kx] / inDirection[kz];
+	Shear.y = inDirection[ky] / inDirection[kz];
+	Shear.z = 1.f / inDirection[kz];
+}
+
 PathTraceTriangle::PathTraceTriangle(glm::vec3 inVerts[3])
 {
 	V[0] = inVerts[0];
@@ -44,8 +77,84 @@ AABB PathTraceTriangle::GetBoundingBox() const
 	return res;
 }
 
-bool TraceTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri, OUT PathTracePayload& outPayload)
+void ComputeWatertightEdgesDouble(const glm::vec2& inA, const glm::vec2& inB, const glm::vec2& inC, OUT float& outU, OUT float& outV, OUT float& outW)
+{
+	outU = static_cast<float>(static_cast<double>(inC.x) * inB.y - static_cast<double>(inC.y) * inB.x);
+	outV = static_cast<float>(static_cast<double>(inA.x) * inC.y - static_cast<double>(inA.y) * inC.x);
+	outW = static_cast<float>(static_cast<double>(inB.x) * inA.y - static_cast<double>(inB.y) * inA.x);
+}
+
+// Watertight Ray/Triangle Intersection, Woop, Benthin, Wald 2013
+// https://jcgt.org/published/0002/01/05/
+// The vertices are moved into a space where the ray is the z axis, so hits are decided by the signs of 2D edge functions.
+// A shared edge gives the same function with opposite sign for both triangles, so a ray can not slip between them.
+static bool IntersectWatertight(const PathTracingRay& inRay, const PathTraceTriangle& inTri, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	OUT float& outDistance, OUT float& outU, OUT float& outV)
+{
+	const int32_t kx = inRay.ShearAxes[0];
+	const int32_t ky = inRay.ShearAxes[1];
+	const int32_t kz = inRay.ShearAxes[2];
+
+	const glm::vec3 A = inTri.V[0] - inRay.Origin;
+	const glm::vec3 B = inTri.V[1] - inRay.Origin;
+	const glm::vec3 C = inTri.V[2] - inRay.Origin;
+
+	const glm::vec2 shearedA = glm::vec2(A[kx] - inRay.Shear.x * A[kz], A[ky] - inRay.Shear.y * A[kz]);
+	const glm::vec2 shearedB = glm::vec2(B[kx] - inRay.Shear.x * B[kz], B[ky] - inRay.Shear.y * B[kz]);
+	const glm::vec2 shearedC = glm::vec2(C[kx] - inRay.Shear.x * C[kz], C[ky] - inRay.Shear.y * C[kz]);
+
+	float U = shearedC.x * shearedB.y - shearedC.y * shearedB.x;
+	float V = shearedA.x * shearedC.y - shearedA.y * shearedC.x;
+	float W = shearedB.x * shearedA.y - shearedB.y * shearedA.x;
+
+	// A zero edge function is the ray going through the edge, float can't tell which side it is on.
+	// All three being zero is a triangle seen edge on, which can never be hit.
+	const bool bAllZero = U == 0.f && V == 0.f && W == 0.f;
+	if (!bAllZero && (U == 0.f || V == 0.f || W == 0.f))
+	{
+		ComputeWatertightEdgesDouble(shearedA, shearedB, shearedC, U, V, W);
+	}
+
+	const bool bAnyNegative = U < 0.f || V < 0.f || W < 0.f;
+	const bool bAnyPositive = U > 0.f || V > 0.f || W > 0.f;
+	const bool bBackFacing = inSettings.bFlipFacing ? bAnyPositive : bAnyNegative;
+	if (inSettings.bTwoSided ? (bAnyNegative && bAnyPositive) : bBackFacing)
+	{
+		return false;
+	}
+
+	const float det = U + V + W;
+	if (det == 0.f)
+	{
+		return false;
+	}
+
+	// Scaled distance, divided by det together with the barycentrics
+	const float T = U * (inRay.Shear.z * A[kz]) + V * (inRay.Shear.z * B[kz]) + W * (inRay.Shear.z * C[kz]);
+	const float invDet = 1.f / det;
+
+	outDistance = T * invDet;
+	outU = V * invDet;
+	outV = W * invDet;
+
+	return outDistance >= inRay.TMin && outDistance <= inMaxDistance;
+}
+
+// Positive for the faces the settings let through, back faces have a negative determinant unless bFlipFacing swaps them
+static inline float GetFacingDeterminant(const float inDet, const TriangleTestSettings& inSettings)
 {
+	return inSettings.bTwoSided ? glm::abs(inDet) : (inSettings.bFlipFacing ? -inDet : inDet);
+}
+
+bool TraceTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri, OUT PathTracePayload& outPayload, const TriangleTestSettings& inSettings)
+{
+	if (inSettings.Intersection == ETriangleIntersection::Watertight)
+	{
+		outPayload.Triangle = &inTri;
+
+		return IntersectWatertight(inRay, inTri, inSettings, inRay.TMax, outPayload.Distance, outPayload.U, outPayload.V);
+	}
+
 	const glm::vec3& A = inTri.V[0];
 	const glm::vec3& E1 = inTri.E[0];
 	const glm::vec3& E2 = inTri.E[1];
@@ -63,12 +172,48 @@ bool TraceTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri,
 	outPayload.Triangle = &inTri;
 	//outPayload.Normal = inTri.WSNormalNormalized;
 
-	return (det >= 1e-6 && outPayload.Distance >= 0.0 && outPayload.U >= 0.0 && outPayload.V >= 0.0 && (outPayload.U + outPayload.V) <= 1.0);
+	const bool bFacing = GetFacingDeterminant(det, inSettings) >= 1e-6;
+
+	return (bFacing && outPayload.Distance >= inRay.TMin && outPayload.Distance <= inRay.TMax && outPayload.U >= 0.0 && outPayload.V >= 0.0 && (outPayload.U + outPayload.V) <= 1.0);
 }
 
-bool IntersectsTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri)
+bool IntersectsTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri, const float inMaxDistance, const TriangleTestSettings& inSettings)
 {
-	PathTracePayload payload;
-	return TraceTriangle(inRay, inTri, payload);
+	if (inSettings.Intersection == ETriangleIntersection::Watertight)
+	{
+		float distance, u, v;
+		return IntersectWatertight(inRay, inTri, inSettings, glm::min(inRay.TMax, inMaxDistance), distance, u, v);
+	}
+
+	const glm::vec3& A = inTri.V[0];
+	const glm::vec3& N = inTri.WSNormal;
+
+	const float det = -dot(inRay.Direction, N);
+	if (GetFacingDeterminant(det, inSettings) < 1e-6)
+	{
+		return false;
+	}
+
+	const float invdet = 1.f / det;
+	const glm::vec3 AO = inRay.Origin - A;
+
+	// Reject on distance first, barycentrics are only needed for hits in range
+	const float distance = dot(AO, N) * invdet;
+	if (distance < inRay.TMin || distance > glm::min(inRay.TMax, inMaxDistance))
+	{
+		return false;
+	}
+
+	const glm::vec3 DAO = glm::cross(AO, inRay.Direction);
+
+	const float u = dot(inTri.E[1], DAO) * invdet;
+	if (u < 0.f)
+	{
+		return false;
+	}
+
+	const float v = -dot(inTri.E[0], DAO) * invdet;
+
+	return v >= 0.f && (u + v) <= 1.f;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "glm/common.hpp"
+#include "glm/ext/vector_float2.hpp"
 #include "glm/ext/vector_float3.hpp"
 #include "Core/EngineUtils.h"
 #include "EASTL/array.h"
@@ -10,8 +11,30 @@
 
 struct PathTracingRay
 {
+	PathTracingRay() = default;
+	PathTracingRay(const glm::vec3& inOrigin, const glm::vec3& inDirection, const float inTMin = 0.f, const float inTMax = INFINITY);
+
+	// Direction should only be changed through this so the cached per ray data stays in sync
+	void SetDirection(const glm::vec3& inDirection);
+
 	glm::vec3 Origin = glm::vec3(0.f, 0.f, 0.f);
 	glm::vec3 Direction = glm::vec3(0.f, 0.f, 0.f);
+
+	// Cached once per ray, used by every box test
+	glm::vec3 InvDirection = glm::vec3(INFINITY, INFINITY, INFINITY);
+
+	// 1 if the direction is negative on that axis, indexes the near bound of a [Min, Max] pair
+	int32_t DirIsNegative[3] = { 0, 0, 0 };
+
+	// Watertight triangle test. The axis the direction is largest on goes last,
+	// the other two are swapped when it is negative so that the winding is kept.
+	int32_t ShearAxes[3] = { 0, 1, 2 };
+	// Shear that maps the direction onto the last of ShearAxes, z is 1 / Direction[ShearAxes[2]]
+	glm::vec3 Shear = glm::vec3(0.f, 0.f, 1.f);
+
+	// Valid hit interval along the ray
+	float TMin = 0.f;
+	float TMax = INFINITY;
 };
 
 struct PathTracePayload
@@ -20,11 +43,17 @@ struct PathTracePayload
 	float U;
 	float V;
 	const struct PathTraceTriangle* Triangle = nullptr;
-	//glm::vec3 Normal;
+
+	// World space and normalized. Triangle is in the space of the structure that was traced, which is object space for instances
+	glm::vec3 Normal = glm::vec3(0.f, 0.f, 0.f);
+
+	// Index in TLAS::Instances of the instance hit, -1 when a BVH is traced directly
+	int32_t InstanceIndex = -1;
 };
 
 struct PathTraceTriangle
 {
+	PathTraceTriangle() = default;
 	PathTraceTriangle(glm::vec3 inVerts[3]);
 
 	glm::vec3 V[3];
@@ -34,9 +63,41 @@ struct PathTraceTriangle
 	glm::vec3 WSNormal;
 	glm::vec3 WSNormalNormalized;
 
+	// Index in the array the owning BVH was built from, lets BVH::Refit match moved triangles to reordered ones
+	uint32_t SourceIndex = 0;
+
 	void Transform(const glm::mat4& inMatrix);
 	AABB GetBoundingBox() const;
+
+	inline glm::vec3 GetCenter() const
+	{
+		return (V[0] + V[1] + V[2]) * 0.3333333333333333333333f;
+	}
 };
 
-bool TraceTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri, OUT PathTracePayload& outPayload);
-bool IntersectsTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri);
+enum class ETriangleIntersection : uint8_t
+{
+	// Möller–Trumbore with an epsilon on the determinant, rays going through a shared edge can miss both triangles
+	MollerTrumbore,
+	// Woop, Benthin, Wald 2013. Shared edges are evaluated exactly the same for both triangles, so nothing leaks through
+	Watertight
+};
+
+struct TriangleTestSettings
+{
+	ETriangleIntersection Intersection = ETriangleIntersection::MollerTrumbore;
+
+	// Back faces, the ones whose WSNormal points along the ray, are ignored unless this is set
+	bool bTwoSided = false;
+
+	// Swaps front and back faces, for triangles seen through a mirroring transform which reverses their winding
+	bool bFlipFacing = false;
+};
+
+bool TraceTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri, OUT PathTracePayload& outPayload, const TriangleTestSettings& inSettings = TriangleTestSettings());
+// Any hit test for shadow rays, only checks for a hit closer than inMaxDistance without filling a payload
+bool IntersectsTriangle(const PathTracingRay& inRay, const PathTraceTriangle& inTri, const float inMaxDistance = INFINITY, const TriangleTestSettings& inSettings = TriangleTestSettings());
+
+// Edge functions of the watertight test recomputed in double, for rays going exactly through an edge or a vertex.
+// Inputs are the triangle's vertices already translated to the ray origin and sheared.
+void ComputeWatertightEdgesDouble(const glm::vec2& inA, const glm::vec2& inB, const glm::vec2& inC, OUT float& outU, OUT float& outV, OUT float& outW);
@@ -0,0 +1,403 @@
+#include "Math/RayPacket.h"
+#include "Math/BVH.h"
+#include "Utils/CPUFeatures.h"
+#include <math.h>
+
+#if PLATFORM_X64
+#include <immintrin.h>
+#endif
+
+template<int32_t Width>
+RayPacket<Width>::RayPacket(const PathTracingRay* inRays, const int32_t inLanesMask)
+	: ActiveMask(inLanesMask & ((1 << Width) - 1))
+{
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		OriginMin[axis] = INFINITY;
+		OriginMax[axis] = -INFINITY;
+		InvDirectionMin[axis] = INFINITY;
+		InvDirectionMax[axis] = -INFINITY;
+	}
+
+	OriginMin[3] = 0.f;
+	OriginMax[3] = 0.f;
+	InvDirectionMin[3] = 0.f;
+	InvDirectionMax[3] = 0.f;
+	MinTMin = INFINITY;
+
+	for (int32_t lane = 0; lane < Width; ++lane)
+	{
+		const PathTracingRay& ray = inRays[lane];
+		Rays[lane] = ray;
+
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			Origin[axis][lane] = ray.Origin[axis];
+			Direction[axis][lane] = ray.Direction[axis];
+			InvDirection[axis][lane] = ray.InvDirection[axis];
+		}
+
+		TMin[lane] = ray.TMin;
+		TMax[lane] = ray.TMax;
+
+		if (((ActiveMask >> lane) & 1) == 0)
+		{
+			continue;
+		}
+
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			NegativeLanes[axis] |= ray.DirIsNegative[axis] << lane;
+
+			OriginMin[axis] = glm::min(OriginMin[axis], ray.Origin[axis]);
+			OriginMax[axis] = glm::max(OriginMax[axis], ray.Origin[axis]);
+			InvDirectionMin[axis] = glm::min(InvDirectionMin[axis], ray.InvDirection[axis]);
+			InvDirectionMax[axis] = glm::max(InvDirectionMax[axis], ray.InvDirection[axis]);
+		}
+
+		MinTMin = glm::min(MinTMin, ray.TMin);
+		MeanDirection += ray.Direction;
+	}
+
+	bCoherent = ActiveMask != 0;
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		bCoherent = bCoherent && (NegativeLanes[axis] == 0 || NegativeLanes[axis] == ActiveMask);
+	}
+}
+
+template struct RayPacket<4>;
+template struct RayPacket<8>;
+
+template<int32_t Width>
+bool PacketMissesAABB(const RayPacket<Width>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistance)
+{
+	if (!inPacket.bCoherent)
+	{
+		return false;
+	}
+
+#if PLATFORM_X64
+	// One axis per lane, the last one is padding and left out of the reduction
+	const __m128 originMin = _mm_load_ps(inPacket.OriginMin);
+	const __m128 originMax = _mm_load_ps(inPacket.OriginMax);
+	const __m128 invDirectionMin = _mm_load_ps(inPacket.InvDirectionMin);
+	const __m128 invDirectionMax = _mm_load_ps(inPacket.InvDirectionMax);
+
+	// Coherent, so an axis is negative for all lanes or for none
+	const __m128 negative = _mm_cmplt_ps(invDirectionMax, _mm_setzero_ps());
+	const __m128 boundsMin = _mm_setr_ps(inBounds[0].x, inBounds[0].y, inBounds[0].z, 0.f);
+	const __m128 boundsMax = _mm_setr_ps(inBounds[1].x, inBounds[1].y, inBounds[1].z, 0.f);
+	const __m128 nearBound = _mm_or_ps(_mm_and_ps(negative, boundsMax), _mm_andnot_ps(negative, boundsMin));
+	const __m128 farBound = _mm_or_ps(_mm_and_ps(negative, boundsMin), _mm_andnot_ps(negative, boundsMax));
+
+	// Float rounding is monotonic, so the products of the interval ends still bound the distances every lane computes for itself
+	const __m128 nearA = _mm_sub_ps(nearBound, originMax);
+	const __m128 nearB = _mm_sub_ps(nearBound, originMin);
+	const __m128 farA = _mm_sub_ps(farBound, originMax);
+	const __m128 farB = _mm_sub_ps(farBound, originMin);
+
+	const __m128 near0 = _mm_mul_ps(nearA, invDirectionMin);
+	const __m128 near1 = _mm_mul_ps(nearA, invDirectionMax);
+	const __m128 near2 = _mm_mul_ps(nearB, invDirectionMin);
+	const __m128 near3 = _mm_mul_ps(nearB, invDirectionMax);
+	const __m128 far0 = _mm_mul_ps(farA, invDirectionMin);
+	const __m128 far1 = _mm_mul_ps(farA, invDirectionMax);
+	const __m128 far2 = _mm_mul_ps(farB, invDirectionMin);
+	const __m128 far3 = _mm_mul_ps(farB, invDirectionMax);
+
+	// NaN when an origin lies exactly on the plane of an axis some ray is parallel to, the bounds say nothing then
+	const __m128 nearNaN = _mm_or_ps(_mm_cmpunord_ps(near0, near1), _mm_cmpunord_ps(near2, near3));
+	const __m128 farNaN = _mm_or_ps(_mm_cmpunord_ps(far0, far1), _mm_cmpunord_ps(far2, far3));
+	if ((_mm_movemask_ps(_mm_or_ps(nearNaN, farNaN)) & 7) != 0)
+	{
+		return false;
+	}
+
+	alignas(16) float tNearMin[4];
+	alignas(16) float tFarMax[4];
+	_mm_store_ps(tNearMin, _mm_min_ps(_mm_min_ps(near0, near1), _mm_min_ps(near2, near3)));
+	_mm_store_ps(tFarMax, _mm_mul_ps(_mm_max_ps(_mm_max_ps(far0, far1), _mm_max_ps(far2, far3)), _mm_set1_ps(BVH_ROBUST_EXIT_SCALE)));
+
+	const float tEntry = glm::max(glm::max(glm::max(inPacket.MinTMin, tNearMin[0]), tNearMin[1]), tNearMin[2]);
+	const float tExit = glm::min(glm::min(glm::min(inMaxDistance, tFarMax[0]), tFarMax[1]), tFarMax[2]);
+
+	return tEntry > tExit;
+#else
+	// Only a shortcut, the per lane test alone gives the same result
+	return false;
+#endif
+}
+
+template bool PacketMissesAABB<4>(const RayPacket<4>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistance);
+template bool PacketMissesAABB<8>(const RayPacket<8>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistance);
+
+// Lanes the SIMD kernels do not cover, one ray at a time through the scalar tests
+template<int32_t Width>
+static int32_t TraceTriangleLanesScalar(const RayPacket<Width>& inPacket, const PathTraceTriangle& inTri, const TriangleTestSettings& inSettings, int32_t inLanesMask,
+	float inOutDistances[Width], float inOutU[Width], float inOutV[Width])
+{
+	int32_t hitMask = 0;
+	while (inLanesMask != 0)
+	{
+		int32_t lane = 0;
+		while (((inLanesMask >> lane) & 1) == 0)
+		{
+			++lane;
+		}
+		inLanesMask &= inLanesMask - 1;
+
+		PathTracePayload payload;
+		if (TraceTriangle(inPacket.Rays[lane], inTri, payload, inSettings) && payload.Distance < inOutDistances[lane])
+		{
+			inOutDistances[lane] = payload.Distance;
+			inOutU[lane] = payload.U;
+			inOutV[lane] = payload.V;
+			hitMask |= 1 << lane;
+		}
+	}
+
+	return hitMask;
+}
+
+#if PLATFORM_X64
+
+static inline __m128 Dot4(const __m128 inAX, const __m128 inAY, const __m128 inAZ, const __m128 inBX, const __m128 inBY, const __m128 inBZ)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(inAX, inBX), _mm_mul_ps(inAY, inBY)), _mm_mul_ps(inAZ, inBZ));
+}
+
+TARGET_AVX static inline __m256 Dot8(const __m256 inAX, const __m256 inAY, const __m256 inAZ, const __m256 inBX, const __m256 inBY, const __m256 inBZ)
+{
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(inAX, inBX), _mm256_mul_ps(inAY, inBY)), _mm256_mul_ps(inAZ, inBZ));
+}
+
+#endif
+
+int32_t IntersectPacketAABB(const RayPacket<4>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistances[4], const int32_t inLanesMask)
+{
+#if PLATFORM_X64
+	__m128 tEntry = _mm_load_ps(inPacket.TMin);
+	__m128 tExit = _mm_loadu_ps(inMaxDistances);
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const __m128 origin = _mm_load_ps(inPacket.Origin[axis]);
+		const __m128 invDirection = _mm_load_ps(inPacket.InvDirection[axis]);
+
+		// Each lane picks its own near and far bound, like DirIsNegative does for a single ray
+		const __m128 negative = _mm_cmplt_ps(invDirection, _mm_setzero_ps());
+		const __m128 minBound = _mm_set1_ps(inBounds[0][axis]);
+		const __m128 maxBound = _mm_set1_ps(inBounds[1][axis]);
+		const __m128 nearBound = _mm_or_ps(_mm_and_ps(negative, maxBound), _mm_andnot_ps(negative, minBound));
+		const __m128 farBound = _mm_or_ps(_mm_and_ps(negative, minBound), _mm_andnot_ps(negative, maxBound));
+
+		const __m128 tNear = _mm_mul_ps(_mm_sub_ps(nearBound, origin), invDirection);
+		const __m128 tFar = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(farBound, origin), invDirection), _mm_set1_ps(BVH_ROBUST_EXIT_SCALE));
+
+		// Accumulator as second operand, max/min return it when the slab is NaN
+		tEntry = _mm_max_ps(tNear, tEntry);
+		tExit = _mm_min_ps(tFar, tExit);
+	}
+
+	return _mm_movemask_ps(_mm_cmple_ps(tEntry, tExit)) & inLanesMask;
+#else
+	int32_t hitMask = 0;
+	for (int32_t lane = 0; lane < 4; ++lane)
+	{
+		float entryDistance;
+		if (((inLanesMask >> lane) & 1) != 0 && RayIntersectsAABB(inPacket.Rays[lane], inBounds, inMaxDistances[lane], entryDistance))
+		{
+			hitMask |= 1 << lane;
+		}
+	}
+
+	return hitMask;
+#endif
+}
+
+TARGET_AVX int32_t IntersectPacketAABB(const RayPacket<8>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistances[8], const int32_t inLanesMask)
+{
+#if PLATFORM_X64
+	__m256 tEntry = _mm256_load_ps(inPacket.TMin);
+	__m256 tExit = _mm256_loadu_ps(inMaxDistances);
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const __m256 origin = _mm256_load_ps(inPacket.Origin[axis]);
+		const __m256 invDirection = _mm256_load_ps(inPacket.InvDirection[axis]);
+
+		const __m256 negative = _mm256_cmp_ps(invDirection, _mm256_setzero_ps(), _CMP_LT_OQ);
+		const __m256 nearBound = _mm256_blendv_ps(_mm256_set1_ps(inBounds[0][axis]), _mm256_set1_ps(inBounds[1][axis]), negative);
+		const __m256 farBound = _mm256_blendv_ps(_mm256_set1_ps(inBounds[1][axis]), _mm256_set1_ps(inBounds[0][axis]), negative);
+
+		const __m256 tNear = _mm256_mul_ps(_mm256_sub_ps(nearBound, origin), invDirection);
+		const __m256 tFar = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(farBound, origin), invDirection), _mm256_set1_ps(BVH_ROBUST_EXIT_SCALE));
+
+		tEntry = _mm256_max_ps(tNear, tEntry);
+		tExit = _mm256_min_ps(tFar, tExit);
+	}
+
+	return _mm256_movemask_ps(_mm256_cmp_ps(tEntry, tExit, _CMP_LE_OQ)) & inLanesMask;
+#else
+	int32_t hitMask = 0;
+	for (int32_t lane = 0; lane < 8; ++lane)
+	{
+		float entryDistance;
+		if (((inLanesMask >> lane) & 1) != 0 && RayIntersectsAABB(inPacket.Rays[lane], inBounds, inMaxDistances[lane], entryDistance))
+		{
+			hitMask |= 1 << lane;
+		}
+	}
+
+	return hitMask;
+#endif
+}
+
+int32_t TraceTriangleForPacket(const RayPacket<4>& inPacket, const PathTraceTriangle& inTri, const TriangleTestSettings& inSettings, const int32_t inLanesMask,
+	float inOutDistances[4], float inOutU[4], float inOutV[4])
+{
+#if PLATFORM_X64
+	if (inSettings.Intersection == ETriangleIntersection::Watertight)
+	{
+		return TraceTriangleLanesScalar<4>(inPacket, inTri, inSettings, inLanesMask, inOutDistances, inOutU, inOutV);
+	}
+
+	// The triangle is broadcast and the rays are in the lanes, the other way around from TrianglePacket
+	const __m128 dirX = _mm_load_ps(inPacket.Direction[0]);
+	const __m128 dirY = _mm_load_ps(inPacket.Direction[1]);
+	const __m128 dirZ = _mm_load_ps(inPacket.Direction[2]);
+
+	const __m128 nX = _mm_set1_ps(inTri.WSNormal.x);
+	const __m128 nY = _mm_set1_ps(inTri.WSNormal.y);
+	const __m128 nZ = _mm_set1_ps(inTri.WSNormal.z);
+
+	const __m128 det = _mm_sub_ps(_mm_setzero_ps(), Dot4(dirX, dirY, dirZ, nX, nY, nZ));
+	const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+	const __m128 aoX = _mm_sub_ps(_mm_load_ps(inPacket.Origin[0]), _mm_set1_ps(inTri.V[0].x));
+	const __m128 aoY = _mm_sub_ps(_mm_load_ps(inPacket.Origin[1]), _mm_set1_ps(inTri.V[0].y));
+	const __m128 aoZ = _mm_sub_ps(_mm_load_ps(inPacket.Origin[2]), _mm_set1_ps(inTri.V[0].z));
+
+	// cross(AO, Direction)
+	const __m128 daoX = _mm_sub_ps(_mm_mul_ps(aoY, dirZ), _mm_mul_ps(aoZ, dirY));
+	const __m128 daoY = _mm_sub_ps(_mm_mul_ps(aoZ, dirX), _mm_mul_ps(aoX, dirZ));
+	const __m128 daoZ = _mm_sub_ps(_mm_mul_ps(aoX, dirY), _mm_mul_ps(aoY, dirX));
+
+	const __m128 u = _mm_mul_ps(Dot4(_mm_set1_ps(inTri.E[1].x), _mm_set1_ps(inTri.E[1].y), _mm_set1_ps(inTri.E[1].z), daoX, daoY, daoZ), invDet);
+	const __m128 v = _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), Dot4(_mm_set1_ps(inTri.E[0].x), _mm_set1_ps(inTri.E[0].y), _mm_set1_ps(inTri.E[0].z), daoX, daoY, daoZ)), invDet);
+	const __m128 distance = _mm_mul_ps(Dot4(aoX, aoY, aoZ, nX, nY, nZ), invDet);
+
+	// Back faces have a negative determinant, two sided tests only look at its magnitude
+	const __m128 signMask = _mm_set1_ps(-0.f);
+	const __m128 facingDet = inSettings.bTwoSided ? _mm_andnot_ps(signMask, det) : (inSettings.bFlipFacing ? _mm_xor_ps(signMask, det) : det);
+
+	const __m128 closestDistance = _mm_loadu_ps(inOutDistances);
+
+	__m128 hit = _mm_cmpge_ps(facingDet, _mm_set1_ps(1e-6f));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(distance, _mm_load_ps(inPacket.TMin)));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(distance, _mm_load_ps(inPacket.TMax)));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(distance, closestDistance));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(u, _mm_setzero_ps()));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(v, _mm_setzero_ps()));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+
+	const int32_t hitMask = _mm_movemask_ps(hit) & inLanesMask;
+	if (hitMask == 0)
+	{
+		return 0;
+	}
+
+	// Lanes outside inLanesMask may have passed the test, they must keep their values
+	alignas(16) float distances[4], us[4], vs[4];
+	_mm_store_ps(distances, distance);
+	_mm_store_ps(us, u);
+	_mm_store_ps(vs, v);
+
+	for (int32_t lane = 0; lane < 4; ++lane)
+	{
+		if (((hitMask >> lane) & 1) != 0)
+		{
+			inOutDistances[lane] = distances[lane];
+			inOutU[lane] = us[lane];
+			inOutV[lane] = vs[lane];
+		}
+	}
+
+	return hitMask;
+#else
+	return TraceTriangleLanesScalar<4>(inPacket, inTri, inSettings, inLanesMask, inOutDistances, inOutU, inOutV);
+#endif
+}
+
+TARGET_AVX int32_t TraceTriangleForPacket(const RayPacket<8>& inPacket, const PathTraceTriangle& inTri, const TriangleTestSettings& inSettings, const int32_t inLanesMask,
+	float inOutDistances[8], float inOutU[8], float inOutV[8])
+{
+#if PLATFORM_X64
+	if (inSettings.Intersection == ETriangleIntersection::Watertight)
+	{
+		return TraceTriangleLanesScalar<8>(inPacket, inTri, inSettings, inLanesMask, inOutDistances, inOutU, inOutV);
+	}
+
+	const __m256 dirX = _mm256_load_ps(inPacket.Direction[0]);
+	const __m256 dirY = _mm256_load_ps(inPacket.Direction[1]);
+	const __m256 dirZ = _mm256_load_ps(inPacket.Direction[2]);
+
+	const __m256 nX = _mm256_set1_ps(inTri.WSNormal.x);
+	const __m256 nY = _mm256_set1_ps(inTri.WSNormal.y);
+	const __m256 nZ = _mm256_set1_ps(inTri.WSNormal.z);
+
+	const __m256 det = _mm256_sub_ps(_mm256_setzero_ps(), Dot8(dirX, dirY, dirZ, nX, nY, nZ));
+	const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+
+	const __m256 aoX = _mm256_sub_ps(_mm256_load_ps(inPacket.Origin[0]), _mm256_set1_ps(inTri.V[0].x));
+	const __m256 aoY = _mm256_sub_ps(_mm256_load_ps(inPacket.Origin[1]), _mm256_set1_ps(inTri.V[0].y));
+	const __m256 aoZ = _mm256_sub_ps(_mm256_load_ps(inPacket.Origin[2]), _mm256_set1_ps(inTri.V[0].z));
+
+	const __m256 daoX = _mm256_sub_ps(_mm256_mul_ps(aoY, dirZ), _mm256_mul_ps(aoZ, dirY));
+	const __m256 daoY = _mm256_sub_ps(_mm256_mul_ps(aoZ, dirX), _mm256_mul_ps(aoX, dirZ));
+	const __m256 daoZ = _mm256_sub_ps(_mm256_mul_ps(aoX, dirY), _mm256_mul_ps(aoY, dirX));
+
+	const __m256 u = _mm256_mul_ps(Dot8(_mm256_set1_ps(inTri.E[1].x), _mm256_set1_ps(inTri.E[1].y), _mm256_set1_ps(inTri.E[1].z), daoX, daoY, daoZ), invDet);
+	const __m256 v = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), Dot8(_mm256_set1_ps(inTri.E[0].x), _mm256_set1_ps(inTri.E[0].y), _mm256_set1_ps(inTri.E[0].z), daoX, daoY, daoZ)), invDet);
+	const __m256 distance = _mm256_mul_ps(Dot8(aoX, aoY, aoZ, nX, nY, nZ), invDet);
+
+	const __m256 signMask = _mm256_set1_ps(-0.f);
+	const __m256 facingDet = inSettings.bTwoSided ? _mm256_andnot_ps(signMask, det) : (inSettings.bFlipFacing ? _mm256_xor_ps(signMask, det) : det);
+
+	const __m256 closestDistance = _mm256_loadu_ps(inOutDistances);
+
+	__m256 hit = _mm256_cmp_ps(facingDet, _mm256_set1_ps(1e-6f), _CMP_GE_OQ);
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(distance, _mm256_load_ps(inPacket.TMin), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(distance, _mm256_load_ps(inPacket.TMax), _CMP_LE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(distance, closestDistance, _CMP_LT_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, _mm256_setzero_ps(), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), _mm256_set1_ps(1.f), _CMP_LE_OQ));
+
+	const int32_t hitMask = _mm256_movemask_ps(hit) & inLanesMask;
+	if (hitMask == 0)
+	{
+		return 0;
+	}
+
+	alignas(32) float distances[8], us[8], vs[8];
+	_mm256_store_ps(distances, distance);
+	_mm256_store_ps(us, u);
+	_mm256_store_ps(vs, v);
+
+	for (int32_t lane = 0; lane < 8; ++lane)
+	{
+		if (((hitMask >> lane) & 1) != 0)
+		{
+			inOutDistances[lane] = distances[lane];
+			inOutU[lane] = us[lane];
+			inOutV[lane] = vs[lane];
+		}
+	}
+
+	return hitMask;
+#else
+	return TraceTriangleLanesScalar<8>(inPacket, inTri, inSettings, inLanesMask, inOutDistances, inOutU, inOutV);
+#endif
+}
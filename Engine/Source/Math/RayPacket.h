@@ -0,0 +1,62 @@
+#pragma once
+#include "glm/ext/vector_float3.hpp"
+#include "Core/EngineUtils.h"
+#include "Math/PathTracing.h"
+
+// Width coherent rays, e.g. the camera rays of a 2x2 or 4x2 block of pixels, in SoA layout so that each component of all of them fits one SIMD register.
+// A packet goes through the tree once for all of its rays, each node is fetched once and tested against every lane at the same time.
+template<int32_t Width>
+struct alignas(32) RayPacket
+{
+	RayPacket() = default;
+
+	// Lanes not set in inLanesMask are inactive and never report hits, inRays is still read for all Width of them
+	RayPacket(const PathTracingRay* inRays, const int32_t inLanesMask);
+
+	// [Axis][Lane]
+	float Origin[3][Width];
+	float Direction[3][Width];
+	float InvDirection[3][Width];
+
+	float TMin[Width];
+	float TMax[Width];
+
+	// Per axis, bit mask of the lanes whose direction is negative on it
+	int32_t NegativeLanes[3] = { 0, 0, 0 };
+
+	// Bit mask of the lanes in use
+	int32_t ActiveMask = 0;
+
+	// All active lanes share the sign of each direction component, only then are the intervals below tight enough to cull anything
+	bool bCoherent = false;
+
+	// Intervals of the active lanes, a box missed by every ray they contain is missed by the whole packet.
+	// Padded to 4 so that all three axes fit one SSE register
+	alignas(16) float OriginMin[4];
+	alignas(16) float OriginMax[4];
+	alignas(16) float InvDirectionMin[4];
+	alignas(16) float InvDirectionMax[4];
+	float MinTMin = 0.f;
+
+	// Sum of the active lanes' directions, orders children front to back for the packet as a whole
+	glm::vec3 MeanDirection = glm::vec3(0.f, 0.f, 0.f);
+
+	// For kernels that are only written for single rays, like the watertight triangle test
+	PathTracingRay Rays[Width];
+};
+
+// Interval arithmetic over the packet's origins and inverse directions. True only if no ray of the packet can hit the box
+// closer than inMaxDistance, so whole subtrees are skipped with one test instead of one per lane
+template<int32_t Width>
+bool PacketMissesAABB(const RayPacket<Width>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistance);
+
+// Same slab test as RayIntersectsAABB for every lane set in inLanesMask, against that lane's inMaxDistances. Returns the lanes hit
+int32_t IntersectPacketAABB(const RayPacket<4>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistances[4], const int32_t inLanesMask);
+int32_t IntersectPacketAABB(const RayPacket<8>& inPacket, const glm::vec3 inBounds[2], const float inMaxDistances[8], const int32_t inLanesMask);
+
+// Same math as TraceTriangle for every lane set in inLanesMask against one triangle. Lanes hitting it closer than their inOutDistances
+// get their distance and barycentrics overwritten. Returns the lanes updated
+int32_t TraceTriangleForPacket(const RayPacket<4>& inPacket, const PathTraceTriangle& inTri, const TriangleTestSettings& inSettings, const int32_t inLanesMask,
+	float inOutDistances[4], float inOutU[4], float inOutV[4]);
+int32_t TraceTriangleForPacket(const RayPacket<8>& inPacket, const PathTraceTriangle& inTri, const TriangleTestSettings& inSettings, const int32_t inLanesMask,
+	float inOutDistances[8], float inOutU[8], float inOutV[8]);
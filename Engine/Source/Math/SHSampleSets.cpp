@@ -0,0 +1,164 @@
+#include "Math/SHSampleSets.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <type_traits>
+#include "EASTL/string.h"
+#include "EASTL/unordered_map.h"
+#include "Logger/Logger.h"
+#include "Utils/HashUtils.h"
+#include "Utils/IOUtils.h"
+#include "Utils/MappedFile.h"
+
+// Bump whenever the generation or the file layout changes, older files are then ignored and regenerated
+#define SH_SAMPLE_SET_VERSION 1
+
+// "SHSS"
+#define SH_SAMPLE_SET_MAGIC 0x53534853u
+
+static const char* const SHSampleSetDirectory = "../Data/Cache/SH/";
+static const char* const SHSampleSetDescription = "SH sample set";
+
+struct SHSampleSetHeader
+{
+	uint32_t Magic = SH_SAMPLE_SET_MAGIC;
+	uint32_t Version = SH_SAMPLE_SET_VERSION;
+	uint64_t Key = 0;
+
+	// Catches files written by a build where SHSample is laid out differently
+	uint32_t SampleSize = 0;
+	uint32_t SamplesCount = 0;
+};
+
+// Everything that changes the generated samples
+template<int32_t Bands>
+static uint64_t ComputeKey(const SHSampleSetSettings& inSettings)
+{
+	uint64_t hash = HashUtils::FNVOffsetBasis;
+
+	HashUtils::HashValue(hash, Bands);
+	HashUtils::HashValue(hash, inSettings.Distribution);
+	HashUtils::HashValue(hash, inSettings.SqrtSamplesCount);
+
+	// Hammersley sets have nothing random about them
+	const uint32_t seed = inSettings.Distribution == ESHSampleDistribution::Hammersley ? 0 : inSettings.Seed;
+	HashUtils::HashValue(hash, seed);
+
+	return hash;
+}
+
+static eastl::string GetSampleSetFilePath(const uint64_t inKey)
+{
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "%016llx.shs", static_cast<unsigned long long>(inKey));
+
+	return eastl::string(SHSampleSetDirectory) + fileName;
+}
+
+template<int32_t Bands>
+static bool TryLoad(const uint64_t inKey, const uint32_t inSamplesCount, OUT eastl::vector<SHSample<Bands>>& outSamples)
+{
+	const eastl::string filePath = GetSampleSetFilePath(inKey);
+
+	MappedFile file;
+	if (!IOUtils::TryMapCacheFile(filePath, SH_SAMPLE_SET_MAGIC, SH_SAMPLE_SET_VERSION, inKey, sizeof(SHSampleSetHeader), SHSampleSetDescription, file))
+	{
+		return false;
+	}
+
+	SHSampleSetHeader header;
+	memcpy(&header, file.GetData(), sizeof(header));
+
+	if (header.SampleSize != sizeof(SHSample<Bands>) || header.SamplesCount != inSamplesCount)
+	{
+		LOG_WARNING("Ignoring outdated SH sample set file %s.", filePath.c_str());
+
+		return false;
+	}
+
+	const uint64_t samplesSize = static_cast<uint64_t>(header.SamplesCount) * sizeof(SHSample<Bands>);
+	if (!IOUtils::CheckCacheFileSize(filePath, file, sizeof(header), samplesSize, SHSampleSetDescription))
+	{
+		return false;
+	}
+
+	outSamples.resize(header.SamplesCount);
+	memcpy(outSamples.data(), file.GetData() + sizeof(header), static_cast<size_t>(samplesSize));
+
+	return true;
+}
+
+template<int32_t Bands>
+static void Save(const uint64_t inKey, const eastl::vector<SHSample<Bands>>& inSamples)
+{
+	SHSampleSetHeader header;
+	header.Key = inKey;
+	header.SampleSize = sizeof(SHSample<Bands>);
+	header.SamplesCount = static_cast<uint32_t>(inSamples.size());
+
+	const eastl::vector<IOUtils::FileBlock> blocks = { IOUtils::FileBlock{ &header, sizeof(header) }, IOUtils::GetArrayBlock(inSamples) };
+	IOUtils::WriteFileAtomic(GetSampleSetFilePath(inKey), blocks, SHSampleSetDescription);
+}
+
+// Sets handed out so far, one map per band count
+template<int32_t Bands>
+struct SHSampleSetStorage
+{
+	static_assert(std::is_trivially_copyable<SHSample<Bands>>::value, "Sample sets are read and written as raw memory.");
+
+	std::mutex Mutex;
+	eastl::unordered_map<uint64_t, SHSampleSetPtr<Bands>> Sets;
+};
+
+template<int32_t Bands>
+static SHSampleSetStorage<Bands>& GetStorage()
+{
+	static SHSampleSetStorage<Bands> storage;
+
+	return storage;
+}
+
+namespace SHSampleSets
+{
+	template<int32_t Bands>
+	SHSampleSetPtr<Bands> Get(const SHSampleSetSettings& inSettings)
+	{
+		ASSERT(inSettings.SqrtSamplesCount > 0);
+
+		const uint64_t key = ComputeKey<Bands>(inSettings);
+
+		SHSampleSetStorage<Bands>& storage = GetStorage<Bands>();
+
+		// Held while generating, a second renderer asking for the same set waits for it instead of generating it again
+		std::lock_guard<std::mutex> lock(storage.Mutex);
+
+		const auto iter = storage.Sets.find(key);
+		if (iter != storage.Sets.end())
+		{
+			return iter->second;
+		}
+
+		const uint32_t samplesCount = static_cast<uint32_t>(inSettings.SqrtSamplesCount * inSettings.SqrtSamplesCount);
+
+		eastl::shared_ptr<eastl::vector<SHSample<Bands>>> samples = eastl::make_shared<eastl::vector<SHSample<Bands>>>();
+		if (!inSettings.bUseDiskCache || !TryLoad<Bands>(key, samplesCount, *samples))
+		{
+			SphericalHarmonics::InitSamples<Bands>(*samples, inSettings.SqrtSamplesCount, inSettings.Distribution, inSettings.Seed);
+
+			if (inSettings.bUseDiskCache)
+			{
+				Save<Bands>(key, *samples);
+			}
+		}
+
+		storage.Sets[key] = samples;
+
+		return samples;
+	}
+
+	template SHSampleSetPtr<1> Get<1>(const SHSampleSetSettings& inSettings);
+	template SHSampleSetPtr<2> Get<2>(const SHSampleSetSettings& inSettings);
+	template SHSampleSetPtr<3> Get<3>(const SHSampleSetSettings& inSettings);
+	template SHSampleSetPtr<4> Get<4>(const SHSampleSetSettings& inSettings);
+	template SHSampleSetPtr<5> Get<5>(const SHSampleSetSettings& inSettings);
+}
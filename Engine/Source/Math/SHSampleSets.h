@@ -0,0 +1,29 @@
+#pragma once
+#include "Core/EngineUtils.h"
+#include "EASTL/shared_ptr.h"
+#include "EASTL/vector.h"
+#include "Math/SphericalHarmonics.h"
+
+struct SHSampleSetSettings
+{
+	ESHSampleDistribution Distribution = ESHSampleDistribution::Hammersley;
+	int32_t SqrtSamplesCount = SH_DEFAULT_SQRT_SAMPLE_COUNT;
+
+	// Picks the jitter of Jittered sets and the scrambling of Sobol ones
+	uint32_t Seed = 0;
+
+	// Generated sets are written to disk and read back by later runs, so bakes keep the exact same samples
+	// even when the trigonometry of another build rounds differently
+	bool bUseDiskCache = true;
+};
+
+template<int32_t Bands>
+using SHSampleSetPtr = eastl::shared_ptr<const eastl::vector<SHSample<Bands>>>;
+
+// Read only SH sample sets, shared by everything asking for the same configuration.
+// A set is loaded from the disk cache or generated the first time it is asked for, then handed out from memory.
+namespace SHSampleSets
+{
+	template<int32_t Bands>
+	SHSampleSetPtr<Bands> Get(const SHSampleSetSettings& inSettings);
+}
@@ -0,0 +1,165 @@
+#include "Math/Sampling.h"
+#include <float.h>
+
+// "Hash Prospector" lowbias32, Wellons 2018
+static inline uint32_t HashUint(uint32_t inValue)
+{
+	inValue ^= inValue >> 16;
+	inValue *= 0x7FEB352Du;
+	inValue ^= inValue >> 15;
+	inValue *= 0x846CA68Bu;
+	inValue ^= inValue >> 16;
+
+	return inValue;
+}
+
+static inline uint32_t HashCombine(const uint32_t inSeed, const uint32_t inValue)
+{
+	return HashUint(inSeed ^ (inValue + 0x9E3779B9u + (inSeed << 6) + (inSeed >> 2)));
+}
+
+static inline uint32_t ReverseBits(uint32_t inValue)
+{
+	inValue = (inValue << 16) | (inValue >> 16);
+	inValue = ((inValue & 0x00FF00FFu) << 8) | ((inValue & 0xFF00FF00u) >> 8);
+	inValue = ((inValue & 0x0F0F0F0Fu) << 4) | ((inValue & 0xF0F0F0F0u) >> 4);
+	inValue = ((inValue & 0x33333333u) << 2) | ((inValue & 0xCCCCCCCCu) >> 2);
+	inValue = ((inValue & 0x55555555u) << 1) | ((inValue & 0xAAAAAAAAu) >> 1);
+
+	return inValue;
+}
+
+// Owen scrambling as a hash over the reversed bits, each bit is only flipped based on the bits above it.
+// See "Practical Hash-based Owen Scrambling", Burley 2020
+static inline uint32_t OwenScramble(uint32_t inValue, const uint32_t inSeed)
+{
+	inValue = ReverseBits(inValue);
+
+	inValue += inSeed;
+	inValue ^= inValue * 0x6C50B47Cu;
+	inValue ^= inValue * 0xB82F1E52u;
+	inValue ^= inValue * 0xC7AFE638u;
+	inValue ^= inValue * 0x8D22F6E6u;
+
+	return ReverseBits(inValue);
+}
+
+// First two Sobol dimensions, the first is the van der Corput sequence and the second has the direction numbers of x + 1
+static inline uint32_t SobolDimension0(const uint32_t inIndex)
+{
+	return ReverseBits(inIndex);
+}
+
+static inline uint32_t SobolDimension1(uint32_t inIndex)
+{
+	uint32_t result = 0;
+	for (uint32_t direction = 1u << 31; inIndex != 0; inIndex >>= 1, direction ^= direction >> 1)
+	{
+		if (inIndex & 1)
+		{
+			result ^= direction;
+		}
+	}
+
+	return result;
+}
+
+// Bijection of [0, inCount), see "Correlated Multi-Jittered Sampling", Kensler 2013
+static uint32_t PermuteIndex(uint32_t inIndex, const uint32_t inCount, const uint32_t inSeed)
+{
+	uint32_t mask = inCount - 1;
+	mask |= mask >> 1;
+	mask |= mask >> 2;
+	mask |= mask >> 4;
+	mask |= mask >> 8;
+	mask |= mask >> 16;
+
+	// Cycle walking, values that land outside of the range are permuted again until they fall inside
+	do
+	{
+		inIndex ^= inSeed;
+		inIndex *= 0xE170893Du;
+		inIndex ^= inSeed >> 16;
+		inIndex ^= (inIndex & mask) >> 4;
+		inIndex ^= inSeed >> 8;
+		inIndex *= 0x0929EB3Fu;
+		inIndex ^= inSeed >> 23;
+		inIndex ^= (inIndex & mask) >> 1;
+		inIndex *= 1 | inSeed >> 27;
+		inIndex *= 0x6935FA69u;
+		inIndex ^= (inIndex & mask) >> 11;
+		inIndex *= 0x74DCB303u;
+		inIndex ^= (inIndex & mask) >> 2;
+		inIndex *= 0x9E501CC3u;
+		inIndex ^= (inIndex & mask) >> 2;
+		inIndex *= 0xC860A3DFu;
+		inIndex &= mask;
+		inIndex ^= inIndex >> 5;
+	} while (inIndex >= inCount);
+
+	return (inIndex + inSeed) % inCount;
+}
+
+// Top 24 bits, so that 1 can never come out of the rounding
+static inline float ToUnitFloat(const uint32_t inValue)
+{
+	return static_cast<float>(inValue >> 8) * (1.f / 16777216.f);
+}
+
+PathTraceSampler::PathTraceSampler(const ESamplerType inType, const uint32_t inPixelIndex, const uint32_t inSampleIndex, const uint32_t inSeed)
+	: Type(inType), PixelSeed(HashCombine(HashUint(inPixelIndex), inSeed)), SampleIndex(inSampleIndex),
+	Random(HashCombine(PixelSeed, inSampleIndex), PixelSeed)
+{
+}
+
+glm::vec2 PathTraceSampler::Get2D()
+{
+	const uint32_t dimensionSeed = HashCombine(PixelSeed, Dimension++);
+
+	switch (Type)
+	{
+	case ESamplerType::Stratified:
+	{
+		const uint32_t strataCount = SAMPLER_STRATA_PER_AXIS * SAMPLER_STRATA_PER_AXIS;
+
+		// A new cell order for every pass over the grid, so consecutive passes do not repeat the same pattern
+		const uint32_t pass = SampleIndex / strataCount;
+		const uint32_t stratum = PermuteIndex(SampleIndex % strataCount, strataCount, HashCombine(dimensionSeed, pass));
+
+		const float x = (static_cast<float>(stratum % SAMPLER_STRATA_PER_AXIS) + Random.NextFloat()) / SAMPLER_STRATA_PER_AXIS;
+		const float y = (static_cast<float>(stratum / SAMPLER_STRATA_PER_AXIS) + Random.NextFloat()) / SAMPLER_STRATA_PER_AXIS;
+
+		// Jitter of the last cell may round up to exactly 1
+		return glm::min(glm::vec2(x, y), glm::vec2(1.f - FLT_EPSILON * 0.5f));
+	}
+	case ESamplerType::Sobol:
+	{
+		// Shuffling the index with a different seed per pair is what keeps pairs from being correlated with each other
+		const uint32_t shuffledIndex = OwenScramble(SampleIndex, dimensionSeed);
+
+		const uint32_t x = OwenScramble(SobolDimension0(shuffledIndex), HashCombine(dimensionSeed, 0));
+		const uint32_t y = OwenScramble(SobolDimension1(shuffledIndex), HashCombine(dimensionSeed, 1));
+
+		return glm::vec2(ToUnitFloat(x), ToUnitFloat(y));
+	}
+	default:
+	{
+		break;
+	}
+	}
+
+	return glm::vec2(Random.NextFloat(), Random.NextFloat());
+}
+
+glm::vec2 SampleHammersley(const uint32_t inIndex, const uint32_t inCount)
+{
+	return glm::vec2((static_cast<float>(inIndex) + 0.5f) / static_cast<float>(inCount), ToUnitFloat(ReverseBits(inIndex)));
+}
+
+glm::vec2 SampleSobol(const uint32_t inIndex, const uint32_t inSeed)
+{
+	const uint32_t x = OwenScramble(SobolDimension0(inIndex), HashCombine(inSeed, 0));
+	const uint32_t y = OwenScramble(SobolDimension1(inIndex), HashCombine(inSeed, 1));
+
+	return glm::vec2(ToUnitFloat(x), ToUnitFloat(y));
+}
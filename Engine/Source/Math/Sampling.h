@@ -0,0 +1,95 @@
+#pragma once
+#include "glm/ext/vector_float2.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "glm/exponential.hpp"
+#include "glm/trigonometric.hpp"
+#include "Core/EngineUtils.h"
+#include "Math/MathUtils.h"
+
+// PCG32, "PCG: A Family of Simple Fast Space-Efficient Statistically Good Algorithms for Random Number Generation", O'Neill 2014.
+// 16 bytes of state, so every pixel or task can own one instead of sharing a locked generator.
+struct PCG32
+{
+	PCG32() = default;
+	PCG32(const uint64_t inSeed, const uint64_t inStream)
+	{
+		Increment = (inStream << 1u) | 1u;
+		NextUint();
+		State += inSeed;
+		NextUint();
+	}
+
+	inline uint32_t NextUint()
+	{
+		const uint64_t oldState = State;
+		State = oldState * 6364136223846793005ull + Increment;
+
+		const uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+		const uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+
+		return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1u) & 31u));
+	}
+
+	// [0, 1), the top 24 bits so that every value is exactly representable
+	inline float NextFloat()
+	{
+		return static_cast<float>(NextUint() >> 8) * (1.f / 16777216.f);
+	}
+
+	uint64_t State = 0x853C49E6748FEA9Bull;
+	uint64_t Increment = 0xDA3E39CB94B95BDBull;
+};
+
+enum class ESamplerType : uint8_t
+{
+	// Independent PCG32 numbers
+	Random,
+	// Jittered cells of a SAMPLER_STRATA_PER_AXIS grid per dimension pair, visited in a shuffled order
+	Stratified,
+	// Owen scrambled 2D Sobol points, decorrelated per dimension pair by shuffling the sample index
+	Sobol
+};
+
+// Every 2D pair of the Stratified sampler is split in this many cells per axis, so the strata repeat every square of it samples
+#define SAMPLER_STRATA_PER_AXIS 16
+
+// Sample values for one path of one pixel. Built on the stack for every path, a sampler holds no shared state,
+// so the values only depend on the pixel, the sample index and the order dimensions are asked for, never on threads.
+// Dimensions are consumed in 2D pairs since all the sequences are at their best in 2D.
+class PathTraceSampler
+{
+public:
+	PathTraceSampler() = default;
+	PathTraceSampler(const ESamplerType inType, const uint32_t inPixelIndex, const uint32_t inSampleIndex, const uint32_t inSeed = 0);
+
+	// [0, 1)^2, next dimension pair
+	glm::vec2 Get2D();
+
+	// [0, 1), uses up a whole dimension pair
+	inline float Get1D() { return Get2D().x; }
+
+private:
+	ESamplerType Type = ESamplerType::Random;
+	uint32_t PixelSeed = 0;
+	uint32_t SampleIndex = 0;
+	uint32_t Dimension = 0;
+
+	// Random values and Stratified jitter
+	PCG32 Random;
+};
+
+// Point inIndex of the inCount points Hammersley set in [0, 1)^2, x is centred in its row so that no point sits on the border
+glm::vec2 SampleHammersley(const uint32_t inIndex, const uint32_t inCount);
+
+// Point inIndex of the first two Sobol dimensions, Owen scrambled with inSeed. Every power of two long prefix stays stratified
+glm::vec2 SampleSobol(const uint32_t inIndex, const uint32_t inSeed);
+
+// Uniform direction on the unit sphere
+inline glm::vec3 SampleUniformSphere(const glm::vec2& inSample)
+{
+	const float z = 1.f - 2.f * inSample.x;
+	const float radius = glm::sqrt(glm::max(0.f, 1.f - z * z));
+	const float phi = 2.f * PI * inSample.y;
+
+	return glm::vec3(radius * glm::cos(phi), radius * glm::sin(phi), z);
+}
@@ -1,74 +1,19 @@
 #include "Math/SphericalHarmonics.h"
 #include "Renderer/DrawDebugHelpers.h"
 #include "MathUtils.h"
-#include <random>
-
-float factorial[34] = {
-	1.0f,
-	1.0f,
-	2.0f,
-	6.0f,
-	24.0f,
-	120.0f,
-	720.0f,
-	5040.0f,
-	40320.0f,
-	362880.0f,
-	3628800.0f,
-	39916800.0f,
-	479001600.0f,
-	6227020800.0f,
-	87178291200.0f,
-	1307674368000.0f,
-	20922789888000.0f,
-	355687428096000.0f,
-	6402373705728000.0f,
-	121645100408832000.0f,
-	2432902008176640000.0f,
-	51090942171709440000.0f,
-	1124000727777607680000.0f,
-	25852016738884976640000.0f,
-	620448401733239439360000.0f,
-	15511210043330985984000000.0f,
-	403291461126605635584000000.0f,
-	10888869450418352160768000000.0f,
-	304888344611713860501504000000.0f,
-	8841761993739701954543616000000.0f,
-	265252859812191058636308480000000.0f,
-	8222838654177922817725562880000000.0f,
-	263130836933693530167218012160000000.0f,
-	8683317618811886495518194401280000000.0f
-};
-
-//double K(int l, int m)
-//{
-//	// renormalisation constant for SH function
-//	double temp = ((2.0 * l + 1.0) * factorial(l - m)) / (4.0 * PI * factorial(l + m));
-//	return sqrt(temp);
-//}
+#include "Math/Sampling.h"
+#include "Utils/CPUFeatures.h"
 
-float K[SH_COEFFICIENT_COUNT];
-
-// Renormalisation constant for SH function
-void init_K() {
-	for (int l = 0; l < SH_NUM_BANDS; l++)
-	{
-		for (int m = -l; m <= l; m++) 
-		{
-			K[l * (l + 1) + m] = sqrt(
-				((2.0f * l + 1.0f) * factorial[l - m]) /
-				(4.0f * PI * factorial[l + m])
-			);
-		}
-	}
-}
+#if PLATFORM_X64
+#include <immintrin.h>
+#endif
 
 // Evaluates the Associated Legendre Polynomial P(l,m,x) at x
-float P(int l, int m, float x) 
+static float P(int l, int m, float x)
 {
 	// Apply rule 2; P m m
 	float pmm = 1.0f;
-	if (m > 0) 
+	if (m > 0)
 	{
 		float somx2 = sqrt((1.0f - x) * (1.0f + x));  //(1 - x^2) = (1 - x)(1 + x)
 		float fact = 1.0f;
@@ -76,7 +21,7 @@ float P(int l, int m, float x)
 		// Raise to the power of M
 		// (2m - 1)!! has exactly m members in the product
 		// which means that with associativity, it can be grouped as this
-		for (int i = 1; i <= m; i++) 
+		for (int i = 1; i <= m; i++)
 		{
 			pmm *= (-fact) * somx2;
 			fact += 2.0f;
@@ -92,7 +37,7 @@ float P(int l, int m, float x)
 
 	// Iterate rule 1 until the right answer is found
 	float pll = 0.0f;
-	for (int ll = m + 2; ll <= l; ll++) 
+	for (int ll = m + 2; ll <= l; ll++)
 	{
 		pll = ((2.0f * ll - 1.0f) * x * pmmp1 - (ll + m - 1.0f) * pmm) / (ll - m);
 		pmm = pmmp1;
@@ -102,62 +47,375 @@ float P(int l, int m, float x)
 	return pll;
 }
 
+template<int32_t Bands>
+float SphericalHarmonics::Evaluate(const int32_t l, const int32_t m, const float inTheta, const float inPhi)
+{
+	static constexpr SHNormalization<Bands> normalization;
+	const float* K = normalization.K;
+
+	if (m == 0)
+	{
+		return K[SHIndex(l, 0)] * P(l, m, cos(inTheta));
+	}
+	else if (m > 0)
+	{
+		return sqrt(2.0f) * K[SHIndex(l, m)] * cos(m * inPhi) * P(l, m, cos(inTheta));
+	}
+	else
+	{
+		return sqrt(2.0f) * K[SHIndex(l, -m)] * sin(-m * inPhi) * P(l, -m, cos(inTheta));
+	}
+}
 
-float evaluate(int l, int m, float theta, float phi) 
+template<int32_t Bands>
+void SphericalHarmonics::EvaluateAll(const float inTheta, const float inPhi, float outCoeffs[SHCoefficientsCount(Bands)])
 {
-	if (m == 0) 
+	for (int32_t l = 0; l < Bands; ++l)
 	{
-		return K[l * (l + 1)] * P(l, m, cos(theta));
+		for (int32_t m = -l; m <= l; ++m)
+		{
+			outCoeffs[SHIndex(l, m)] = Evaluate<Bands>(l, m, inTheta, inPhi);
+		}
 	}
-	else if (m > 0) 
+}
+
+// Constants of the Cartesian form. With z = cos(theta) and (x + iy)^m = sin^m(theta) * (cos(m * phi) + i * sin(m * phi)),
+// every function is Scale(l, m) * Q(l, m)(z) times the real or imaginary part of (x + iy)^m, where Q(l, m) = P(l, m) / sin^m(theta)
+// is a polynomial of z following the same recurrence as P over l
+template<int32_t Bands>
+struct SHPolynomialTerms
+{
+	constexpr SHPolynomialTerms()
+		: Scale{}, A{}, B{}, Qmm{}
 	{
-		return sqrt(2.0f) * K[l * (l + 1) + m] * cos(m * phi) * P(l, m, cos(theta));
+		double qmm = 1.0;
+		for (int32_t m = 0; m < Bands; ++m)
+		{
+			// Q(m, m) = (-1)^m * (2m - 1)!!
+			Qmm[m] = static_cast<float>(qmm);
+			qmm *= -(2.0 * m + 1.0);
+
+			for (int32_t l = m; l < Bands; ++l)
+			{
+				const int32_t index = SHIndex(l, m);
+
+				// sqrt(2) of the m != 0 functions folded in
+				Scale[index] = static_cast<float>((m == 0 ? 1.0 : SHConstants::Sqrt(2.0)) * SHConstants::K(l, m));
+
+				// Q(l, m) = A * z * Q(l - 1, m) - B * Q(l - 2, m), Q(m - 1, m) being 0
+				if (l > m)
+				{
+					A[index] = static_cast<float>((2.0 * l - 1.0) / (l - m));
+					B[index] = static_cast<float>((l + m - 1.0) / (l - m));
+				}
+			}
+		}
 	}
-	else 
+
+	// Indexed with SHIndex(l, m), m >= 0
+	float Scale[SHCoefficientsCount(Bands)];
+	float A[SHCoefficientsCount(Bands)];
+	float B[SHCoefficientsCount(Bands)];
+
+	float Qmm[Bands];
+};
+
+template<int32_t Width>
+void SHDirectionPacket<Width>::SetLane(const int32_t inLane, const glm::vec3& inDirection)
+{
+	for (int32_t axis = 0; axis < 3; ++axis)
 	{
-		return sqrt(2.0f) * K[l * (l + 1) - m] * sin(-m * phi) * P(l, -m, cos(theta));
+		Direction[axis][inLane] = inDirection[axis];
 	}
 }
 
+template struct SHDirectionPacket<4>;
+template struct SHDirectionPacket<8>;
 
-void SphericalHarmonics::InitSamples(SHSample samples[SH_TOTAL_SAMPLE_COUNT])
+template<int32_t Bands>
+void SphericalHarmonics::EvaluateDirection(const glm::vec3& inDirection, float outCoeffs[SHCoefficientsCount(Bands)])
 {
-	const float inv_sqrt_n_samples = 1.0f / (float)SQRT_SAMPLE_COUNT;
+	static constexpr SHPolynomialTerms<Bands> terms;
 
-	std::random_device random_device;
-	std::mt19937 gen(random_device());
-	std::uniform_real_distribution<float> U01(0.0f, 1.0f);
+	const float x = inDirection.x;
+	const float y = inDirection.y;
+	const float z = inDirection.z;
 
-	init_K();
+	// Real and imaginary parts of (x + iy)^m
+	float re = 1.f;
+	float im = 0.f;
 
-	for (int i = 0; i < SQRT_SAMPLE_COUNT; i++) {
-		for (int j = 0; j < SQRT_SAMPLE_COUNT; j++) {
-			// Generate unbiased distribution of spherical coords
-			const float x = ((float)i + U01(gen)) * inv_sqrt_n_samples;
-			const float y = ((float)j + U01(gen)) * inv_sqrt_n_samples;
+	for (int32_t m = 0; m < Bands; ++m)
+	{
+		float qPrev = 0.f;
+		float q = terms.Qmm[m];
+
+		for (int32_t l = m; l < Bands; ++l)
+		{
+			const int32_t index = SHIndex(l, m);
+			if (l > m)
+			{
+				const float qNext = terms.A[index] * z * q - terms.B[index] * qPrev;
+				qPrev = q;
+				q = qNext;
+			}
+
+			const float scaled = terms.Scale[index] * q;
+			if (m == 0)
+			{
+				outCoeffs[index] = scaled;
+			}
+			else
+			{
+				outCoeffs[index] = scaled * re;
+				outCoeffs[SHIndex(l, -m)] = scaled * im;
+			}
+		}
 
-			// Convert x and y to Spherical Coordinates
-			const float theta = 2.0f * acos(sqrt(1.0f - x));
-			const float phi = 2.0f * PI * y;
+		const float nextRe = re * x - im * y;
+		im = re * y + im * x;
+		re = nextRe;
+	}
+}
 
-			const int index = i * SQRT_SAMPLE_COUNT + j;
+template<int32_t Bands>
+void SphericalHarmonics::EvaluateDirections(const SHDirectionPacket<4>& inPacket, float outCoeffs[SHCoefficientsCount(Bands)][4])
+{
+#if PLATFORM_X64
+	static constexpr SHPolynomialTerms<Bands> terms;
+
+	const __m128 x = _mm_load_ps(inPacket.Direction[0]);
+	const __m128 y = _mm_load_ps(inPacket.Direction[1]);
+	const __m128 z = _mm_load_ps(inPacket.Direction[2]);
 
-			// Store polar coords
-			samples[index].Theta = theta;
-			samples[index].Phi = phi;
+	__m128 re = _mm_set1_ps(1.f);
+	__m128 im = _mm_setzero_ps();
+
+	for (int32_t m = 0; m < Bands; ++m)
+	{
+		__m128 qPrev = _mm_setzero_ps();
+		__m128 q = _mm_set1_ps(terms.Qmm[m]);
 
-			// Convert spherical coords to unit vector
-			samples[index].Direction = glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+		for (int32_t l = m; l < Bands; ++l)
+		{
+			const int32_t index = SHIndex(l, m);
+			if (l > m)
+			{
+				const __m128 qNext = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(terms.A[index]), z), q), _mm_mul_ps(_mm_set1_ps(terms.B[index]), qPrev));
+				qPrev = q;
+				q = qNext;
+			}
 
-			//Precompute all SH coefficients for this sample
-			for (int l = 0; l < SH_NUM_BANDS; l++)
+			const __m128 scaled = _mm_mul_ps(_mm_set1_ps(terms.Scale[index]), q);
+			if (m == 0)
 			{
-				for (int m = -l; m <= l; m++)
-				{
-					const int32_t shIndex = l * (l + 1) + m;
-					samples[index].Coeffs[shIndex] = evaluate(l, m, theta, phi);
-				}
+				_mm_storeu_ps(outCoeffs[index], scaled);
 			}
+			else
+			{
+				_mm_storeu_ps(outCoeffs[index], _mm_mul_ps(scaled, re));
+				_mm_storeu_ps(outCoeffs[SHIndex(l, -m)], _mm_mul_ps(scaled, im));
+			}
+		}
+
+		const __m128 nextRe = _mm_sub_ps(_mm_mul_ps(re, x), _mm_mul_ps(im, y));
+		im = _mm_add_ps(_mm_mul_ps(re, y), _mm_mul_ps(im, x));
+		re = nextRe;
+	}
+#else
+	float coeffs[SHCoefficientsCount(Bands)];
+	for (int32_t lane = 0; lane < 4; ++lane)
+	{
+		EvaluateDirection<Bands>(glm::vec3(inPacket.Direction[0][lane], inPacket.Direction[1][lane], inPacket.Direction[2][lane]), coeffs);
+		for (int32_t c = 0; c < SHCoefficientsCount(Bands); ++c)
+		{
+			outCoeffs[c][lane] = coeffs[c];
 		}
 	}
-}
\ No newline at end of file
+#endif
+}
+
+template<int32_t Bands>
+TARGET_AVX void SphericalHarmonics::EvaluateDirections(const SHDirectionPacket<8>& inPacket, float outCoeffs[SHCoefficientsCount(Bands)][8])
+{
+#if PLATFORM_X64
+	static constexpr SHPolynomialTerms<Bands> terms;
+
+	const __m256 x = _mm256_load_ps(inPacket.Direction[0]);
+	const __m256 y = _mm256_load_ps(inPacket.Direction[1]);
+	const __m256 z = _mm256_load_ps(inPacket.Direction[2]);
+
+	__m256 re = _mm256_set1_ps(1.f);
+	__m256 im = _mm256_setzero_ps();
+
+	for (int32_t m = 0; m < Bands; ++m)
+	{
+		__m256 qPrev = _mm256_setzero_ps();
+		__m256 q = _mm256_set1_ps(terms.Qmm[m]);
+
+		for (int32_t l = m; l < Bands; ++l)
+		{
+			const int32_t index = SHIndex(l, m);
+			if (l > m)
+			{
+				const __m256 qNext = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(terms.A[index]), z), q), _mm256_mul_ps(_mm256_set1_ps(terms.B[index]), qPrev));
+				qPrev = q;
+				q = qNext;
+			}
+
+			const __m256 scaled = _mm256_mul_ps(_mm256_set1_ps(terms.Scale[index]), q);
+			if (m == 0)
+			{
+				_mm256_storeu_ps(outCoeffs[index], scaled);
+			}
+			else
+			{
+				_mm256_storeu_ps(outCoeffs[index], _mm256_mul_ps(scaled, re));
+				_mm256_storeu_ps(outCoeffs[SHIndex(l, -m)], _mm256_mul_ps(scaled, im));
+			}
+		}
+
+		const __m256 nextRe = _mm256_sub_ps(_mm256_mul_ps(re, x), _mm256_mul_ps(im, y));
+		im = _mm256_add_ps(_mm256_mul_ps(re, y), _mm256_mul_ps(im, x));
+		re = nextRe;
+	}
+#else
+	float coeffs[SHCoefficientsCount(Bands)];
+	for (int32_t lane = 0; lane < 8; ++lane)
+	{
+		EvaluateDirection<Bands>(glm::vec3(inPacket.Direction[0][lane], inPacket.Direction[1][lane], inPacket.Direction[2][lane]), coeffs);
+		for (int32_t c = 0; c < SHCoefficientsCount(Bands); ++c)
+		{
+			outCoeffs[c][lane] = coeffs[c];
+		}
+	}
+#endif
+}
+
+// Full packets of inDirections, the remaining directions are left to the caller
+template<int32_t Bands, int32_t Width>
+static int32_t EvaluateDirectionPackets(const glm::vec3* inDirections, const int32_t inCount, float* outCoeffs)
+{
+	constexpr int32_t coefficientsCount = SHCoefficientsCount(Bands);
+
+	SHDirectionPacket<Width> packet;
+	float packetCoeffs[coefficientsCount][Width];
+
+	int32_t first = 0;
+	for (; first + Width <= inCount; first += Width)
+	{
+		for (int32_t lane = 0; lane < Width; ++lane)
+		{
+			packet.SetLane(lane, inDirections[first + lane]);
+		}
+
+		SphericalHarmonics::EvaluateDirections<Bands>(packet, packetCoeffs);
+
+		float* directionCoeffs = outCoeffs + first * coefficientsCount;
+		for (int32_t lane = 0; lane < Width; ++lane)
+		{
+			for (int32_t c = 0; c < coefficientsCount; ++c)
+			{
+				directionCoeffs[c] = packetCoeffs[c][lane];
+			}
+			directionCoeffs += coefficientsCount;
+		}
+	}
+
+	return first;
+}
+
+template<int32_t Bands>
+void SphericalHarmonics::EvaluateDirections(const glm::vec3* inDirections, const int32_t inCount, float* outCoeffs)
+{
+	int32_t first = 0;
+
+#if PLATFORM_X64
+	if (CPUFeatures::HasAVX())
+	{
+		first = EvaluateDirectionPackets<Bands, 8>(inDirections, inCount, outCoeffs);
+	}
+	else
+	{
+		first = EvaluateDirectionPackets<Bands, 4>(inDirections, inCount, outCoeffs);
+	}
+#endif
+
+	for (int32_t i = first; i < inCount; ++i)
+	{
+		EvaluateDirection<Bands>(inDirections[i], outCoeffs + i * SHCoefficientsCount(Bands));
+	}
+}
+
+template<int32_t Bands>
+void SphericalHarmonics::InitSamples(eastl::vector<SHSample<Bands>>& outSamples, const int32_t inSqrtSamplesCount, const ESHSampleDistribution inDistribution,
+	const uint32_t inSeed)
+{
+	const int32_t samplesCount = inSqrtSamplesCount * inSqrtSamplesCount;
+	const float inv_sqrt_n_samples = 1.0f / (float)inSqrtSamplesCount;
+
+	PCG32 random(inSeed, 0);
+
+	outSamples.resize(samplesCount);
+
+	for (int32_t i = 0; i < samplesCount; i++)
+	{
+		glm::vec2 point(0.f, 0.f);
+		switch (inDistribution)
+		{
+		case ESHSampleDistribution::Jittered:
+		{
+			// Generate unbiased distribution of spherical coords
+			point.x = ((float)(i / inSqrtSamplesCount) + random.NextFloat()) * inv_sqrt_n_samples;
+			point.y = ((float)(i % inSqrtSamplesCount) + random.NextFloat()) * inv_sqrt_n_samples;
+			break;
+		}
+		case ESHSampleDistribution::Hammersley:
+		{
+			point = SampleHammersley(i, samplesCount);
+			break;
+		}
+		case ESHSampleDistribution::Sobol:
+		{
+			point = SampleSobol(i, inSeed);
+			break;
+		}
+		default:
+		{
+			break;
+		}
+		}
+
+		// Convert x and y to Spherical Coordinates
+		const float theta = 2.0f * acos(sqrt(1.0f - point.x));
+		const float phi = 2.0f * PI * point.y;
+
+		SHSample<Bands>& sample = outSamples[i];
+
+		// Store polar coords
+		sample.Theta = theta;
+		sample.Phi = phi;
+
+		// Convert spherical coords to unit vector
+		sample.Direction = glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+
+		//Precompute all SH coefficients for this sample
+		EvaluateDirection<Bands>(sample.Direction, sample.Coeffs);
+	}
+}
+
+#define INSTANTIATE_SH_BANDS(Bands)																						\
+	template float SphericalHarmonics::Evaluate<Bands>(const int32_t l, const int32_t m, const float inTheta, const float inPhi);			\
+	template void SphericalHarmonics::EvaluateAll<Bands>(const float inTheta, const float inPhi, float outCoeffs[SHCoefficientsCount(Bands)]);	\
+	template void SphericalHarmonics::EvaluateDirection<Bands>(const glm::vec3& inDirection, float outCoeffs[SHCoefficientsCount(Bands)]);		\
+	template void SphericalHarmonics::EvaluateDirections<Bands>(const SHDirectionPacket<4>& inPacket, float outCoeffs[SHCoefficientsCount(Bands)][4]);	\
+	template void SphericalHarmonics::EvaluateDirections<Bands>(const SHDirectionPacket<8>& inPacket, float outCoeffs[SHCoefficientsCount(Bands)][8]);	\
+	template void SphericalHarmonics::EvaluateDirections<Bands>(const glm::vec3* inDirections, const int32_t inCount, float* outCoeffs);	\
+	template void SphericalHarmonics::InitSamples<Bands>(eastl::vector<SHSample<Bands>>& outSamples, const int32_t inSqrtSamplesCount,				\
+		const ESHSampleDistribution inDistribution, const uint32_t inSeed);
+
+INSTANTIATE_SH_BANDS(1)
+INSTANTIATE_SH_BANDS(2)
+INSTANTIATE_SH_BANDS(3)
+INSTANTIATE_SH_BANDS(4)
+INSTANTIATE_SH_BANDS(5)
@@ -5,27 +5,154 @@
 #include "EASTL/vector.h"
 #include "glm/ext/vector_float3.hpp"
 
-// Number of Spherical Harmonic bands, commonly referred to with the letter l
-#define SH_NUM_BANDS 2
-#define SH_COEFFICIENT_COUNT (SH_NUM_BANDS * SH_NUM_BANDS)
+// Band counts the SH templates are instantiated for, a band is commonly referred to with the letter l
+#define SH_MIN_BANDS 1
+#define SH_MAX_BANDS 5
 
-// Amount of samples used for Monte Carlo integration
-#define SQRT_SAMPLE_COUNT 50
-#define SH_TOTAL_SAMPLE_COUNT (SQRT_SAMPLE_COUNT * SQRT_SAMPLE_COUNT)
+// Default amount of samples per axis of the grid used for Monte Carlo integration
+#define SH_DEFAULT_SQRT_SAMPLE_COUNT 50
+
+// Coefficients in the first inBandsCount bands, band l holds 2l + 1 of them
+constexpr int32_t SHCoefficientsCount(const int32_t inBandsCount)
+{
+	return inBandsCount * inBandsCount;
+}
+
+// Index of coefficient m of band l, with m in [-l, l]
+constexpr int32_t SHIndex(const int32_t l, const int32_t m)
+{
+	return l * (l + 1) + m;
+}
+
+namespace SHConstants
+{
+	// PI of MathUtils is a float and cannot be used at compile time
+	constexpr double Pi = 3.14159265358979323846;
+
+	constexpr double Factorial(const int32_t inValue)
+	{
+		double result = 1.0;
+		for (int32_t i = 2; i <= inValue; ++i)
+		{
+			result *= double(i);
+		}
+
+		return result;
+	}
+
+	// Newton iterations, std::sqrt is not constexpr
+	constexpr double Sqrt(const double inValue)
+	{
+		if (inValue <= 0.0)
+		{
+			return 0.0;
+		}
+
+		double result = inValue > 1.0 ? inValue : 1.0;
+		for (int32_t i = 0; i < 64; ++i)
+		{
+			const double next = 0.5 * (result + inValue / result);
+			if (next == result)
+			{
+				break;
+			}
+			result = next;
+		}
+
+		return result;
+	}
+
+	// Renormalisation constant of the SH function (l, m)
+	constexpr double K(const int32_t l, const int32_t m)
+	{
+		return Sqrt(((2.0 * l + 1.0) * Factorial(l - m)) / (4.0 * Pi * Factorial(l + m)));
+	}
+}
+
+// K(l, m) of every coefficient of the first Bands bands, built by the compiler
+template<int32_t Bands>
+struct SHNormalization
+{
+	constexpr SHNormalization()
+		: K{}
+	{
+		for (int32_t l = 0; l < Bands; ++l)
+		{
+			for (int32_t m = -l; m <= l; ++m)
+			{
+				K[SHIndex(l, m)] = static_cast<float>(SHConstants::K(l, m));
+			}
+		}
+	}
+
+	float K[SHCoefficientsCount(Bands)];
+};
+
+// How the points of a sample set are placed, all of them are mapped to the sphere with the same area preserving mapping
+enum class ESHSampleDistribution : uint8_t
+{
+	// One random point in every cell of a square grid
+	Jittered,
+	Hammersley,
+	// Owen scrambled, with a scrambling picked by the seed
+	Sobol
+};
+
+template<int32_t Bands>
+struct SHSample
+{
+	static_assert(Bands >= SH_MIN_BANDS && Bands <= SH_MAX_BANDS, "SH band count out of the instantiated range");
+
+	static constexpr int32_t BandsCount = Bands;
+	static constexpr int32_t CoefficientsCount = SHCoefficientsCount(Bands);
 
-struct SHSample {
 	// Sample direction, in sperical coordinates as well as cartesian coordinates
 	float Theta;
 	float Phi;
 	glm::vec3 Direction;
 
 	// SH coefficients that make up the sample
-	float Coeffs[SH_COEFFICIENT_COUNT];
+	float Coeffs[CoefficientsCount];
+};
+
+// Width unit directions in SoA layout, so that each component of all of them fits one SIMD register
+template<int32_t Width>
+struct alignas(32) SHDirectionPacket
+{
+	// [Axis][Lane]
+	float Direction[3][Width];
+
+	void SetLane(const int32_t inLane, const glm::vec3& inDirection);
 };
 
 struct SphericalHarmonics
 {
-	static void InitSamples(SHSample samples[SH_TOTAL_SAMPLE_COUNT]);
+	// Real SH function (l, m), l < Bands, in the direction given in spherical coordinates
+	template<int32_t Bands>
+	static float Evaluate(const int32_t l, const int32_t m, const float inTheta, const float inPhi);
+
+	// Every SH function of the first Bands bands in one direction
+	template<int32_t Bands>
+	static void EvaluateAll(const float inTheta, const float inPhi, float outCoeffs[SHCoefficientsCount(Bands)]);
 
+	// Same functions as EvaluateAll, from a unit direction (sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta)) instead of angles.
+	// Polynomials of the direction built with Sloan's recurrences, no trigonometry or Legendre recursion per function
+	template<int32_t Bands>
+	static void EvaluateDirection(const glm::vec3& inDirection, float outCoeffs[SHCoefficientsCount(Bands)]);
 
-};
\ No newline at end of file
+	// EvaluateDirection for every lane of the packet, outCoeffs is [Coefficient][Lane]. The 8 lane version needs AVX
+	template<int32_t Bands>
+	static void EvaluateDirections(const SHDirectionPacket<4>& inPacket, float outCoeffs[SHCoefficientsCount(Bands)][4]);
+	template<int32_t Bands>
+	static void EvaluateDirections(const SHDirectionPacket<8>& inPacket, float outCoeffs[SHCoefficientsCount(Bands)][8]);
+
+	// EvaluateDirection for inCount directions, outCoeffs holds SHCoefficientsCount(Bands) of them per direction.
+	// Goes through the widest packets the CPU supports
+	template<int32_t Bands>
+	static void EvaluateDirections(const glm::vec3* inDirections, const int32_t inCount, float* outCoeffs);
+
+	// inSqrtSamplesCount * inSqrtSamplesCount samples uniformly spread over the sphere. The same arguments always give the same samples
+	template<int32_t Bands>
+	static void InitSamples(eastl::vector<SHSample<Bands>>& outSamples, const int32_t inSqrtSamplesCount = SH_DEFAULT_SQRT_SAMPLE_COUNT,
+		const ESHSampleDistribution inDistribution = ESHSampleDistribution::Jittered, const uint32_t inSeed = 0);
+};
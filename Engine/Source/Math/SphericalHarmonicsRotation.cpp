@@ -4,6 +4,8 @@
 #include "SphericalHarmonicsRotation.h"
 #include "glm/gtc/quaternion.inl"
 
+// Rotation matrix of a single band, big enough for any band below Bands
+template<int32_t Bands>
 struct SHRotationMatrix
 {
 public:
@@ -43,7 +45,7 @@ private:
 	int32_t L = 0;
 	int32_t RowSize = 0; // Max (2 * l + 1), min 1
 
-	float Data[(2 * SH_NUM_BANDS + 1) * (2 * SH_NUM_BANDS + 1)];
+	float Data[(2 * Bands + 1) * (2 * Bands + 1)];
 };
 
 inline float KroneckerDelta(const int32_t inA, const int32_t inB)
@@ -106,7 +108,8 @@ inline float Calculate_small_w(const int32_t l, const int32_t m, const int32_t n
 }
 
 
-inline float Calculate_P(const SHRotationMatrix& R /*Base RotationMatrix*/, const SHRotationMatrix& M /*Prev Matrix*/, 
+template<int32_t Bands>
+inline float Calculate_P(const SHRotationMatrix<Bands>& R /*Base RotationMatrix*/, const SHRotationMatrix<Bands>& M /*Prev Matrix*/, 
 	const int32_t l, const int32_t i, const int32_t a, const int32_t b)
 {
 	if (abs(b) < l)
@@ -127,12 +130,14 @@ inline float Calculate_P(const SHRotationMatrix& R /*Base RotationMatrix*/, cons
 	return 0.f;
 }
 
-inline float Calculate_Big_U(const SHRotationMatrix& baseMatrix, const SHRotationMatrix& prevMatrix, const int32_t l, const int32_t m, const int32_t n)
+template<int32_t Bands>
+inline float Calculate_Big_U(const SHRotationMatrix<Bands>& baseMatrix, const SHRotationMatrix<Bands>& prevMatrix, const int32_t l, const int32_t m, const int32_t n)
 {
 	return Calculate_P(baseMatrix, prevMatrix, l, 0, m, n);
 }
 
-inline float Calculate_Big_V(const SHRotationMatrix& baseMatrix, const SHRotationMatrix& prevMatrix, const int32_t l, const int32_t m, const int32_t n)
+template<int32_t Bands>
+inline float Calculate_Big_V(const SHRotationMatrix<Bands>& baseMatrix, const SHRotationMatrix<Bands>& prevMatrix, const int32_t l, const int32_t m, const int32_t n)
 {
 	constexpr float sqrt_2 = 1.41421356237f; // Square root of 2
 
@@ -173,7 +178,8 @@ inline float Calculate_Big_V(const SHRotationMatrix& baseMatrix, const SHRotatio
 	return 0.f;
 }
 
-inline float Calculate_Big_W(const SHRotationMatrix& baseMatrix, const SHRotationMatrix& prevMatrix, const int32_t l, const int32_t m, const int32_t n)
+template<int32_t Bands>
+inline float Calculate_Big_W(const SHRotationMatrix<Bands>& baseMatrix, const SHRotationMatrix<Bands>& prevMatrix, const int32_t l, const int32_t m, const int32_t n)
 {
 	ASSERT(m != 0);
 
@@ -197,12 +203,15 @@ void SphericalHarmonicsRotation::Init()
 
 }
 
+template<int32_t Bands>
 void SphericalHarmonicsRotation::Rotate(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs)
 {
+	ASSERT(inCoeffs.size() == SHCoefficientsCount(Bands));
+
 	const glm::mat3 rotationMat = glm::mat3_cast(inRot);
 
 	// Base rotation matrix that all others are derived from
-	SHRotationMatrix R;
+	SHRotationMatrix<Bands> R;
 	R.SetOrder(1);
 
 	R.SetValue(-1, -1, rotationMat[1][1]); R.SetValue(-1, 0, rotationMat[2][1]); R.SetValue(-1, 1, rotationMat[0][1]);
@@ -214,7 +223,7 @@ void SphericalHarmonicsRotation::Rotate(const glm::quat& inRot, const eastl::vec
 	// First harmonic remains unchaged(rotation matrix for it is 1)
 	outRotatedCoeffs[0] = inCoeffs[0];
 
-	SHRotationMatrix matrices[2];
+	SHRotationMatrix<Bands> matrices[2];
 
 	// Initialize first matrix as a 1x1 matrix containing 1, because first harmonic remains unchanged
 	matrices[0].SetOrder(0);
@@ -223,7 +232,7 @@ void SphericalHarmonicsRotation::Rotate(const glm::quat& inRot, const eastl::vec
 
 	int32_t matrixIndex = 1;
 	int32_t previousMatrix = 0;
-	for (int32_t l = 1; l < SH_NUM_BANDS; ++l)
+	for (int32_t l = 1; l < Bands; ++l)
 	{
 		const int32_t matrixIndex = l & 1; // Equivalent to Modulo 2
 		//const int32_t previousMatrix = int32_t(!matrixIndex); // Basically other matrix
@@ -282,3 +291,8 @@ void SphericalHarmonicsRotation::Rotate(const glm::quat& inRot, const eastl::vec
 	}
 }
 
+template void SphericalHarmonicsRotation::Rotate<1>(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs);
+template void SphericalHarmonicsRotation::Rotate<2>(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs);
+template void SphericalHarmonicsRotation::Rotate<3>(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs);
+template void SphericalHarmonicsRotation::Rotate<4>(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs);
+template void SphericalHarmonicsRotation::Rotate<5>(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs);
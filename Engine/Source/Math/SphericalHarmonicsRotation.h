@@ -9,6 +9,9 @@
 struct SphericalHarmonicsRotation
 {
 	static void Init();
+
+	// inCoeffs holds the first Bands bands, SHCoefficientsCount(Bands) of them
+	template<int32_t Bands>
 	static void Rotate(const glm::quat& inRot, const eastl::vector<glm::vec4>& inCoeffs, eastl::vector<glm::vec4>& outRotatedCoeffs);
 
 
@@ -0,0 +1,358 @@
+#include "Math/TLAS.h"
+#include "glm/matrix.hpp"
+#include <algorithm>
+
+BVHInstance::BVHInstance(const BVH* inBLAS, const glm::mat4& inObjectToWorld, const uint32_t inUserIndex)
+	: BLAS(inBLAS), ObjectToWorld(inObjectToWorld), WorldToObject(glm::inverse(inObjectToWorld)),
+	bMirrored(glm::determinant(glm::mat3(inObjectToWorld)) < 0.f), UserIndex(inUserIndex)
+{
+	if (!BLAS || !BLAS->IsValid())
+	{
+		return;
+	}
+
+	const glm::vec3* rootBounds = BLAS->Nodes[0].Bounds;
+	for (int32_t i = 0; i < 8; ++i)
+	{
+		const glm::vec3 corner = glm::vec3(rootBounds[i & 1].x, rootBounds[(i >> 1) & 1].y, rootBounds[(i >> 2) & 1].z);
+		Bounds += glm::vec3(ObjectToWorld * glm::vec4(corner.x, corner.y, corner.z, 1.f));
+	}
+}
+
+struct TLASTraversalEntry
+{
+	uint32_t NodeIndex;
+	float EntryDistance;
+};
+
+// Direction is deliberately not normalized, t along the object space ray is the same t along the world space one
+static inline PathTracingRay TransformRay(const PathTracingRay& inRay, const glm::mat4& inMatrix)
+{
+	const glm::vec4 origin = inMatrix * glm::vec4(inRay.Origin.x, inRay.Origin.y, inRay.Origin.z, 1.f);
+	const glm::vec4 direction = inMatrix * glm::vec4(inRay.Direction.x, inRay.Direction.y, inRay.Direction.z, 0.f);
+
+	return PathTracingRay(glm::vec3(origin), glm::vec3(direction), inRay.TMin, inRay.TMax);
+}
+
+// Object space normal of the side the BLAS lets rays hit, the world space triangle of a mirrored instance winds the other way round
+static inline glm::vec3 GetFrontNormal(const BVHInstance& inInstance, const PathTraceTriangle& inTriangle)
+{
+	return inInstance.bMirrored != inInstance.BLAS->TriangleTest.bFlipFacing ? -inTriangle.WSNormal : inTriangle.WSNormal;
+}
+
+void TLAS::Build(eastl::vector<BVHInstance> inInstances)
+{
+	Nodes.clear();
+	InstanceIndices.clear();
+	Instances = std::move(inInstances);
+
+	for (uint32_t i = 0; i < Instances.size(); ++i)
+	{
+		// Instances of empty meshes are kept so that indices match but never end up in the tree
+		if (Instances[i].BLAS && Instances[i].BLAS->IsValid())
+		{
+			InstanceIndices.push_back(i);
+		}
+	}
+
+	if (InstanceIndices.empty())
+	{
+		return;
+	}
+
+	// Median splits halve the count each level, so the tree is always balanced
+	Nodes.reserve(2 * InstanceIndices.size());
+	BuildRecursive(0, static_cast<uint32_t>(InstanceIndices.size()));
+}
+
+uint32_t TLAS::BuildRecursive(const uint32_t inFirst, const uint32_t inCount)
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(Nodes.size());
+	Nodes.push_back(BVHLinearNode());
+
+	AABB bounds;
+	AABB centerBounds;
+	for (uint32_t i = inFirst; i < inFirst + inCount; ++i)
+	{
+		const AABB& instanceBounds = Instances[InstanceIndices[i]].Bounds;
+		bounds += instanceBounds;
+		centerBounds += (instanceBounds.Min + instanceBounds.Max) * 0.5f;
+	}
+
+	BVHLinearNode node;
+	node.Bounds[0] = bounds.Min;
+	node.Bounds[1] = bounds.Max;
+	node.Pad = 0;
+
+	if (inCount == 1)
+	{
+		node.TrianglesOffset = inFirst;
+		node.TrianglesCount = 1;
+	}
+	else
+	{
+		const glm::vec3 centerExtent = centerBounds.Max - centerBounds.Min;
+		const int32_t axis = centerExtent.x > centerExtent.y ? (centerExtent.x > centerExtent.z ? 0 : 2) : (centerExtent.y > centerExtent.z ? 1 : 2);
+
+		const uint32_t half = inCount / 2;
+		uint32_t* first = InstanceIndices.data() + inFirst;
+		std::nth_element(first, first + half, first + inCount, [this, axis](const uint32_t inA, const uint32_t inB)
+		{
+			const AABB& a = Instances[inA].Bounds;
+			const AABB& b = Instances[inB].Bounds;
+			return a.Min[axis] + a.Max[axis] < b.Min[axis] + b.Max[axis];
+		});
+
+		node.TrianglesCount = 0;
+
+		// First child is implicitly nodeIndex + 1
+		BuildRecursive(inFirst, half);
+		node.SecondChildIndex = BuildRecursive(inFirst + half, inCount - half);
+	}
+
+	Nodes[nodeIndex] = node;
+
+	return nodeIndex;
+}
+
+bool TLAS::Trace(const PathTracingRay& inRay, PathTracePayload& outPayload) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	// Balanced, so BVH_MAX_DEPTH is far more than any scene needs
+	TLASTraversalEntry stack[BVH_MAX_DEPTH];
+	int32_t stackSize = 0;
+	stack[stackSize++] = { 0, inRay.TMin };
+
+	bool bHit = false;
+
+	while (stackSize > 0)
+	{
+		const TLASTraversalEntry entry = stack[--stackSize];
+
+		const float maxDistance = glm::min(outPayload.Distance, inRay.TMax);
+		if (entry.EntryDistance > maxDistance)
+		{
+			continue;
+		}
+
+		const BVHLinearNode& node = Nodes[entry.NodeIndex];
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.TrianglesOffset; i < node.TrianglesOffset + node.TrianglesCount; ++i)
+			{
+				const uint32_t instanceIndex = InstanceIndices[i];
+				const BVHInstance& instance = Instances[instanceIndex];
+
+				// Only returns true for hits closer than the one already in the payload
+				// Mirrored instances swap the faces, so that the culled side and the normal are the ones of the world space triangle
+				if (instance.BLAS->Trace(TransformRay(inRay, instance.WorldToObject), outPayload, instance.bMirrored))
+				{
+					bHit = true;
+					outPayload.InstanceIndex = static_cast<int32_t>(instanceIndex);
+
+					// Normals go through the inverse transpose
+					const glm::vec3 worldNormal = glm::transpose(glm::mat3(instance.WorldToObject)) * GetFrontNormal(instance, *outPayload.Triangle);
+					outPayload.Normal = glm::normalize(worldNormal);
+				}
+			}
+
+			continue;
+		}
+
+		uint32_t nearChild = entry.NodeIndex + 1;
+		uint32_t farChild = node.SecondChildIndex;
+
+		float nearEntryDistance, farEntryDistance;
+		const bool nearHit = RayIntersectsAABB(inRay, Nodes[nearChild].Bounds, maxDistance, nearEntryDistance);
+		const bool farHit = RayIntersectsAABB(inRay, Nodes[farChild].Bounds, maxDistance, farEntryDistance);
+
+		if (nearHit && farHit)
+		{
+			if (farEntryDistance < nearEntryDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearEntryDistance, farEntryDistance);
+			}
+
+			// Far one first so that the near one is popped next
+			stack[stackSize++] = { farChild, farEntryDistance };
+			stack[stackSize++] = { nearChild, nearEntryDistance };
+		}
+		else if (nearHit)
+		{
+			stack[stackSize++] = { nearChild, nearEntryDistance };
+		}
+		else if (farHit)
+		{
+			stack[stackSize++] = { farChild, farEntryDistance };
+		}
+	}
+
+	return bHit;
+}
+
+bool TLAS::IsOccluded(const PathTracingRay& inRay, const float inMaxDistance) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	const float maxDistance = glm::min(inMaxDistance, inRay.TMax);
+
+	uint32_t stack[BVH_MAX_DEPTH + 1];
+	int32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t nodeIndex = stack[--stackSize];
+		const BVHLinearNode& node = Nodes[nodeIndex];
+
+		float entryDistance;
+		if (!RayIntersectsAABB(inRay, node.Bounds, maxDistance, entryDistance))
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.TrianglesOffset; i < node.TrianglesOffset + node.TrianglesCount; ++i)
+			{
+				const BVHInstance& instance = Instances[InstanceIndices[i]];
+				if (instance.BLAS->IsOccluded(TransformRay(inRay, instance.WorldToObject), maxDistance, instance.bMirrored))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.SecondChildIndex;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return false;
+}
+
+int32_t TLAS::TracePacket(const RayPacket<4>& inPacket, PathTracePayload outPayloads[4]) const
+{
+	return TracePacketInternal<4>(inPacket, outPayloads);
+}
+
+int32_t TLAS::TracePacket(const RayPacket<8>& inPacket, PathTracePayload outPayloads[8]) const
+{
+	return TracePacketInternal<8>(inPacket, outPayloads);
+}
+
+template<int32_t Width>
+int32_t TLAS::TracePacketInternal(const RayPacket<Width>& inPacket, PathTracePayload outPayloads[Width]) const
+{
+	if (!IsValid() || inPacket.ActiveMask == 0)
+	{
+		return 0;
+	}
+
+	alignas(32) float maxDistances[Width];
+	float packetMaxDistance = -INFINITY;
+	for (int32_t lane = 0; lane < Width; ++lane)
+	{
+		maxDistances[lane] = glm::min(outPayloads[lane].Distance, inPacket.TMax[lane]);
+		if (((inPacket.ActiveMask >> lane) & 1) != 0)
+		{
+			packetMaxDistance = glm::max(packetMaxDistance, maxDistances[lane]);
+		}
+	}
+
+	uint32_t stack[BVH_MAX_DEPTH + 1];
+	int32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	int32_t hitMask = 0;
+
+	while (stackSize > 0)
+	{
+		const uint32_t nodeIndex = stack[--stackSize];
+		const BVHLinearNode& node = Nodes[nodeIndex];
+
+		if (PacketMissesAABB(inPacket, node.Bounds, packetMaxDistance))
+		{
+			continue;
+		}
+
+		const int32_t lanesMask = IntersectPacketAABB(inPacket, node.Bounds, maxDistances, inPacket.ActiveMask);
+		if (lanesMask == 0)
+		{
+			continue;
+		}
+
+		if (!node.IsLeaf())
+		{
+			uint32_t nearChild = nodeIndex + 1;
+			uint32_t farChild = node.SecondChildIndex;
+
+			const glm::vec3 centersOffset = (Nodes[farChild].Bounds[0] + Nodes[farChild].Bounds[1]) - (Nodes[nearChild].Bounds[0] + Nodes[nearChild].Bounds[1]);
+			if (glm::dot(centersOffset, inPacket.MeanDirection) < 0.f)
+			{
+				std::swap(nearChild, farChild);
+			}
+
+			stack[stackSize++] = farChild;
+			stack[stackSize++] = nearChild;
+
+			continue;
+		}
+
+		for (uint32_t i = node.TrianglesOffset; i < node.TrianglesOffset + node.TrianglesCount; ++i)
+		{
+			const uint32_t instanceIndex = InstanceIndices[i];
+			const BVHInstance& instance = Instances[instanceIndex];
+
+			// Only the lanes that reached the leaf go on, the same transform keeps the object space packet as coherent as the world space one
+			PathTracingRay objectRays[Width];
+			for (int32_t lane = 0; lane < Width; ++lane)
+			{
+				if (((lanesMask >> lane) & 1) != 0)
+				{
+					objectRays[lane] = TransformRay(inPacket.Rays[lane], instance.WorldToObject);
+				}
+			}
+
+			const int32_t instanceHitMask = instance.BLAS->TracePacket(RayPacket<Width>(objectRays, lanesMask), outPayloads, instance.bMirrored);
+			if (instanceHitMask == 0)
+			{
+				continue;
+			}
+
+			hitMask |= instanceHitMask;
+
+			// Normals go through the inverse transpose
+			const glm::mat3 normalMatrix = glm::transpose(glm::mat3(instance.WorldToObject));
+
+			packetMaxDistance = -INFINITY;
+			for (int32_t lane = 0; lane < Width; ++lane)
+			{
+				if (((instanceHitMask >> lane) & 1) != 0)
+				{
+					PathTracePayload& payload = outPayloads[lane];
+					payload.InstanceIndex = static_cast<int32_t>(instanceIndex);
+					payload.Normal = glm::normalize(normalMatrix * GetFrontNormal(instance, *payload.Triangle));
+				}
+
+				maxDistances[lane] = glm::min(outPayloads[lane].Distance, inPacket.TMax[lane]);
+				if (((inPacket.ActiveMask >> lane) & 1) != 0)
+				{
+					packetMaxDistance = glm::max(packetMaxDistance, maxDistances[lane]);
+				}
+			}
+		}
+	}
+
+	return hitMask;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "glm/ext/matrix_float4x4.hpp"
+#include "Core/EngineUtils.h"
+#include "EASTL/vector.h"
+#include "Math/AABB.h"
+#include "Math/BVH.h"
+#include "Math/PathTracing.h"
+#include "Math/RayPacket.h"
+#include "Utils/AlignedAllocator.h"
+
+// A placement of an object space BVH in the world. Any number of instances can share the same BLAS.
+struct BVHInstance
+{
+	BVHInstance() = default;
+	BVHInstance(const BVH* inBLAS, const glm::mat4& inObjectToWorld, const uint32_t inUserIndex);
+
+	const BVH* BLAS = nullptr;
+
+	glm::mat4 ObjectToWorld = glm::mat4(1.f);
+	glm::mat4 WorldToObject = glm::mat4(1.f);
+
+	// BLAS root bounds transformed to world space
+	AABB Bounds;
+
+	// ObjectToWorld has a negative determinant, which reverses the winding of the BLAS triangles in world space
+	bool bMirrored = false;
+
+	// Free for the owner, e.g. the index of the render command the instance was made from
+	uint32_t UserIndex = 0;
+};
+
+// Top level acceleration structure, a BVH over instances instead of triangles.
+// Rays are moved into object space per instance without renormalizing the direction, so hit distances stay comparable across instances.
+struct TLAS
+{
+	// Instances keep the order they are given in, BLASes must already be built and must outlive the TLAS
+	void Build(eastl::vector<BVHInstance> inInstances);
+
+	// Closest hit over all instances, fills outPayload.InstanceIndex and a world space outPayload.Normal
+	bool Trace(const PathTracingRay& inRay, PathTracePayload& outPayload) const;
+
+	// Any hit over all instances
+	bool IsOccluded(const PathTracingRay& inRay, const float inMaxDistance = INFINITY) const;
+
+	// Closest hits of a packet of coherent rays over all instances, each lane behaves like Trace with its own payload.
+	// Returns the lanes that found a closer hit
+	int32_t TracePacket(const RayPacket<4>& inPacket, PathTracePayload outPayloads[4]) const;
+	int32_t TracePacket(const RayPacket<8>& inPacket, PathTracePayload outPayloads[8]) const;
+
+	inline bool IsValid() const { return !Nodes.empty(); }
+
+	eastl::vector<BVHInstance> Instances;
+
+	// Same layout as BVH::Nodes, leaves reference a range of InstanceIndices instead of triangles
+	eastl::vector<BVHLinearNode, AlignedAllocator> Nodes;
+
+	eastl::vector<uint32_t> InstanceIndices;
+
+private:
+	uint32_t BuildRecursive(const uint32_t inFirst, const uint32_t inCount);
+
+	template<int32_t Width>
+	int32_t TracePacketInternal(const RayPacket<Width>& inPacket, PathTracePayload outPayloads[Width]) const;
+};
@@ -0,0 +1,449 @@
+#include "Math/TrianglePacket.h"
+#include "Utils/CPUFeatures.h"
+
+#if PLATFORM_X64
+#include <immintrin.h>
+#endif
+
+template<int32_t Width>
+void TrianglePacket<Width>::Clear()
+{
+	for (int32_t lane = 0; lane < Width; ++lane)
+	{
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			V0[axis][lane] = 0.f;
+			V1[axis][lane] = 0.f;
+			V2[axis][lane] = 0.f;
+			N[axis][lane] = 0.f;
+		}
+
+		TriangleIndex[lane] = 0;
+	}
+}
+
+template<int32_t Width>
+void TrianglePacket<Width>::SetLane(const int32_t inLane, const PathTraceTriangle& inTri, const uint32_t inTriangleIndex)
+{
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		V0[axis][inLane] = inTri.V[0][axis];
+		V1[axis][inLane] = inTri.V[1][axis];
+		V2[axis][inLane] = inTri.V[2][axis];
+		N[axis][inLane] = inTri.WSNormal[axis];
+	}
+
+	TriangleIndex[inLane] = inTriangleIndex;
+}
+
+template struct TrianglePacket<4>;
+template struct TrianglePacket<8>;
+
+#if PLATFORM_X64
+
+// Nearest of the lanes set in inHitMask, hits are rare enough for this to not be worth vectorizing
+template<int32_t Width>
+static int32_t SelectNearestLane(int32_t inHitMask, const float inDistances[Width])
+{
+	int32_t nearestLane = -1;
+	while (inHitMask != 0)
+	{
+		int32_t lane = 0;
+		while (((inHitMask >> lane) & 1) == 0)
+		{
+			++lane;
+		}
+		inHitMask &= inHitMask - 1;
+
+		if (nearestLane == -1 || inDistances[lane] < inDistances[nearestLane])
+		{
+			nearestLane = lane;
+		}
+	}
+
+	return nearestLane;
+}
+
+// Lanes where the ray goes exactly through an edge get their edge functions recomputed in double, like the scalar test.
+// Lanes with all three functions at zero are degenerate or empty and are left to fail the determinant test.
+template<int32_t Width>
+static void FixWatertightEdgeLanes(int32_t inLanesMask, const float inAX[Width], const float inAY[Width], const float inBX[Width], const float inBY[Width],
+	const float inCX[Width], const float inCY[Width], float inOutU[Width], float inOutV[Width], float inOutW[Width])
+{
+	while (inLanesMask != 0)
+	{
+		int32_t lane = 0;
+		while (((inLanesMask >> lane) & 1) == 0)
+		{
+			++lane;
+		}
+		inLanesMask &= inLanesMask - 1;
+
+		ComputeWatertightEdgesDouble(glm::vec2(inAX[lane], inAY[lane]), glm::vec2(inBX[lane], inBY[lane]), glm::vec2(inCX[lane], inCY[lane]),
+			inOutU[lane], inOutV[lane], inOutW[lane]);
+	}
+}
+
+static inline __m128 Dot4(const __m128 inAX, const __m128 inAY, const __m128 inAZ, const __m128 inBX, const __m128 inBY, const __m128 inBZ)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(inAX, inBX), _mm_mul_ps(inAY, inBY)), _mm_mul_ps(inAZ, inBZ));
+}
+
+// Möller–Trumbore on 4 lanes, returns the bit mask of the lanes hit in [TMin, inMaxDistance] and closer than inClosestDistance
+static inline int32_t IntersectLanesMollerTrumbore(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	const float inClosestDistance, OUT __m128& outDistance, OUT __m128& outU, OUT __m128& outV)
+{
+	const __m128 dirX = _mm_set1_ps(inRay.Direction.x);
+	const __m128 dirY = _mm_set1_ps(inRay.Direction.y);
+	const __m128 dirZ = _mm_set1_ps(inRay.Direction.z);
+
+	const __m128 nX = _mm_load_ps(inPacket.N[0]);
+	const __m128 nY = _mm_load_ps(inPacket.N[1]);
+	const __m128 nZ = _mm_load_ps(inPacket.N[2]);
+
+	const __m128 det = _mm_sub_ps(_mm_setzero_ps(), Dot4(dirX, dirY, dirZ, nX, nY, nZ));
+	const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+	const __m128 v0X = _mm_load_ps(inPacket.V0[0]);
+	const __m128 v0Y = _mm_load_ps(inPacket.V0[1]);
+	const __m128 v0Z = _mm_load_ps(inPacket.V0[2]);
+
+	const __m128 e1X = _mm_sub_ps(_mm_load_ps(inPacket.V1[0]), v0X);
+	const __m128 e1Y = _mm_sub_ps(_mm_load_ps(inPacket.V1[1]), v0Y);
+	const __m128 e1Z = _mm_sub_ps(_mm_load_ps(inPacket.V1[2]), v0Z);
+	const __m128 e2X = _mm_sub_ps(_mm_load_ps(inPacket.V2[0]), v0X);
+	const __m128 e2Y = _mm_sub_ps(_mm_load_ps(inPacket.V2[1]), v0Y);
+	const __m128 e2Z = _mm_sub_ps(_mm_load_ps(inPacket.V2[2]), v0Z);
+
+	const __m128 aoX = _mm_sub_ps(_mm_set1_ps(inRay.Origin.x), v0X);
+	const __m128 aoY = _mm_sub_ps(_mm_set1_ps(inRay.Origin.y), v0Y);
+	const __m128 aoZ = _mm_sub_ps(_mm_set1_ps(inRay.Origin.z), v0Z);
+
+	// cross(AO, Direction)
+	const __m128 daoX = _mm_sub_ps(_mm_mul_ps(aoY, dirZ), _mm_mul_ps(aoZ, dirY));
+	const __m128 daoY = _mm_sub_ps(_mm_mul_ps(aoZ, dirX), _mm_mul_ps(aoX, dirZ));
+	const __m128 daoZ = _mm_sub_ps(_mm_mul_ps(aoX, dirY), _mm_mul_ps(aoY, dirX));
+
+	outU = _mm_mul_ps(Dot4(e2X, e2Y, e2Z, daoX, daoY, daoZ), invDet);
+	outV = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(Dot4(e1X, e1Y, e1Z, daoX, daoY, daoZ), invDet));
+	outDistance = _mm_mul_ps(Dot4(aoX, aoY, aoZ, nX, nY, nZ), invDet);
+
+	// Back faces have a negative determinant, two sided tests only look at its magnitude
+	const __m128 signMask = _mm_set1_ps(-0.f);
+	const __m128 facingDet = inSettings.bTwoSided ? _mm_andnot_ps(signMask, det) : (inSettings.bFlipFacing ? _mm_xor_ps(signMask, det) : det);
+
+	__m128 hit = _mm_cmpge_ps(facingDet, _mm_set1_ps(1e-6f));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(outDistance, _mm_set1_ps(inRay.TMin)));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(outDistance, _mm_set1_ps(inMaxDistance)));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(outDistance, _mm_set1_ps(inClosestDistance)));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(outU, _mm_setzero_ps()));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(outV, _mm_setzero_ps()));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(outU, outV), _mm_set1_ps(1.f)));
+
+	return _mm_movemask_ps(hit);
+}
+
+// Watertight test on 4 lanes, same math as the scalar IntersectWatertight in PathTracing.cpp
+static inline int32_t IntersectLanesWatertight(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	const float inClosestDistance, OUT __m128& outDistance, OUT __m128& outU, OUT __m128& outV)
+{
+	const int32_t kx = inRay.ShearAxes[0];
+	const int32_t ky = inRay.ShearAxes[1];
+	const int32_t kz = inRay.ShearAxes[2];
+
+	const __m128 originX = _mm_set1_ps(inRay.Origin[kx]);
+	const __m128 originY = _mm_set1_ps(inRay.Origin[ky]);
+	const __m128 originZ = _mm_set1_ps(inRay.Origin[kz]);
+	const __m128 shearX = _mm_set1_ps(inRay.Shear.x);
+	const __m128 shearY = _mm_set1_ps(inRay.Shear.y);
+	const __m128 shearZ = _mm_set1_ps(inRay.Shear.z);
+
+	const __m128 aZ = _mm_sub_ps(_mm_load_ps(inPacket.V0[kz]), originZ);
+	const __m128 bZ = _mm_sub_ps(_mm_load_ps(inPacket.V1[kz]), originZ);
+	const __m128 cZ = _mm_sub_ps(_mm_load_ps(inPacket.V2[kz]), originZ);
+
+	const __m128 aX = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(inPacket.V0[kx]), originX), _mm_mul_ps(shearX, aZ));
+	const __m128 aY = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(inPacket.V0[ky]), originY), _mm_mul_ps(shearY, aZ));
+	const __m128 bX = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(inPacket.V1[kx]), originX), _mm_mul_ps(shearX, bZ));
+	const __m128 bY = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(inPacket.V1[ky]), originY), _mm_mul_ps(shearY, bZ));
+	const __m128 cX = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(inPacket.V2[kx]), originX), _mm_mul_ps(shearX, cZ));
+	const __m128 cY = _mm_sub_ps(_mm_sub_ps(_mm_load_ps(inPacket.V2[ky]), originY), _mm_mul_ps(shearY, cZ));
+
+	__m128 U = _mm_sub_ps(_mm_mul_ps(cX, bY), _mm_mul_ps(cY, bX));
+	__m128 V = _mm_sub_ps(_mm_mul_ps(aX, cY), _mm_mul_ps(aY, cX));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(bX, aY), _mm_mul_ps(bY, aX));
+
+	const __m128 zero = _mm_setzero_ps();
+	const int32_t anyZeroMask = _mm_movemask_ps(_mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(U, zero), _mm_cmpeq_ps(V, zero)), _mm_cmpeq_ps(W, zero)));
+	const int32_t allZeroMask = _mm_movemask_ps(_mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(U, zero), _mm_cmpeq_ps(V, zero)), _mm_cmpeq_ps(W, zero)));
+	if ((anyZeroMask & ~allZeroMask) != 0)
+	{
+		alignas(16) float ax[4], ay[4], bx[4], by[4], cx[4], cy[4], u[4], v[4], w[4];
+		_mm_store_ps(ax, aX);
+		_mm_store_ps(ay, aY);
+		_mm_store_ps(bx, bX);
+		_mm_store_ps(by, bY);
+		_mm_store_ps(cx, cX);
+		_mm_store_ps(cy, cY);
+		_mm_store_ps(u, U);
+		_mm_store_ps(v, V);
+		_mm_store_ps(w, W);
+
+		FixWatertightEdgeLanes<4>(anyZeroMask & ~allZeroMask, ax, ay, bx, by, cx, cy, u, v, w);
+
+		U = _mm_load_ps(u);
+		V = _mm_load_ps(v);
+		W = _mm_load_ps(w);
+	}
+
+	const __m128 anyNegative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(U, zero), _mm_cmplt_ps(V, zero)), _mm_cmplt_ps(W, zero));
+	const __m128 anyPositive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(U, zero), _mm_cmpgt_ps(V, zero)), _mm_cmpgt_ps(W, zero));
+	const __m128 outside = inSettings.bTwoSided ? _mm_and_ps(anyNegative, anyPositive) : (inSettings.bFlipFacing ? anyPositive : anyNegative);
+
+	const __m128 det = _mm_add_ps(_mm_add_ps(U, V), W);
+	const __m128 T = _mm_add_ps(_mm_add_ps(_mm_mul_ps(U, _mm_mul_ps(shearZ, aZ)), _mm_mul_ps(V, _mm_mul_ps(shearZ, bZ))), _mm_mul_ps(W, _mm_mul_ps(shearZ, cZ)));
+	const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+	outDistance = _mm_mul_ps(T, invDet);
+	outU = _mm_mul_ps(V, invDet);
+	outV = _mm_mul_ps(W, invDet);
+
+	__m128 hit = _mm_andnot_ps(outside, _mm_cmpneq_ps(det, zero));
+	hit = _mm_and_ps(hit, _mm_cmpge_ps(outDistance, _mm_set1_ps(inRay.TMin)));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(outDistance, _mm_set1_ps(inMaxDistance)));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(outDistance, _mm_set1_ps(inClosestDistance)));
+
+	return _mm_movemask_ps(hit);
+}
+
+static inline int32_t IntersectLanes(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	const float inClosestDistance, OUT __m128& outDistance, OUT __m128& outU, OUT __m128& outV)
+{
+	if (inSettings.Intersection == ETriangleIntersection::Watertight)
+	{
+		return IntersectLanesWatertight(inPacket, inRay, inSettings, inMaxDistance, inClosestDistance, outDistance, outU, outV);
+	}
+
+	return IntersectLanesMollerTrumbore(inPacket, inRay, inSettings, inMaxDistance, inClosestDistance, outDistance, outU, outV);
+}
+
+// The 8 lane versions below only need AVX, which is also what selects the 8 wide layout.
+// FMA must stay off for them, contracting the watertight edge functions would make them differ between neighbouring triangles.
+
+TARGET_AVX static inline __m256 Dot8(const __m256 inAX, const __m256 inAY, const __m256 inAZ, const __m256 inBX, const __m256 inBY, const __m256 inBZ)
+{
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(inAX, inBX), _mm256_mul_ps(inAY, inBY)), _mm256_mul_ps(inAZ, inBZ));
+}
+
+TARGET_AVX static inline int32_t IntersectLanesMollerTrumbore(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	const float inClosestDistance, OUT __m256& outDistance, OUT __m256& outU, OUT __m256& outV)
+{
+	const __m256 dirX = _mm256_set1_ps(inRay.Direction.x);
+	const __m256 dirY = _mm256_set1_ps(inRay.Direction.y);
+	const __m256 dirZ = _mm256_set1_ps(inRay.Direction.z);
+
+	const __m256 nX = _mm256_load_ps(inPacket.N[0]);
+	const __m256 nY = _mm256_load_ps(inPacket.N[1]);
+	const __m256 nZ = _mm256_load_ps(inPacket.N[2]);
+
+	const __m256 det = _mm256_sub_ps(_mm256_setzero_ps(), Dot8(dirX, dirY, dirZ, nX, nY, nZ));
+	const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+
+	const __m256 v0X = _mm256_load_ps(inPacket.V0[0]);
+	const __m256 v0Y = _mm256_load_ps(inPacket.V0[1]);
+	const __m256 v0Z = _mm256_load_ps(inPacket.V0[2]);
+
+	const __m256 e1X = _mm256_sub_ps(_mm256_load_ps(inPacket.V1[0]), v0X);
+	const __m256 e1Y = _mm256_sub_ps(_mm256_load_ps(inPacket.V1[1]), v0Y);
+	const __m256 e1Z = _mm256_sub_ps(_mm256_load_ps(inPacket.V1[2]), v0Z);
+	const __m256 e2X = _mm256_sub_ps(_mm256_load_ps(inPacket.V2[0]), v0X);
+	const __m256 e2Y = _mm256_sub_ps(_mm256_load_ps(inPacket.V2[1]), v0Y);
+	const __m256 e2Z = _mm256_sub_ps(_mm256_load_ps(inPacket.V2[2]), v0Z);
+
+	const __m256 aoX = _mm256_sub_ps(_mm256_set1_ps(inRay.Origin.x), v0X);
+	const __m256 aoY = _mm256_sub_ps(_mm256_set1_ps(inRay.Origin.y), v0Y);
+	const __m256 aoZ = _mm256_sub_ps(_mm256_set1_ps(inRay.Origin.z), v0Z);
+
+	const __m256 daoX = _mm256_sub_ps(_mm256_mul_ps(aoY, dirZ), _mm256_mul_ps(aoZ, dirY));
+	const __m256 daoY = _mm256_sub_ps(_mm256_mul_ps(aoZ, dirX), _mm256_mul_ps(aoX, dirZ));
+	const __m256 daoZ = _mm256_sub_ps(_mm256_mul_ps(aoX, dirY), _mm256_mul_ps(aoY, dirX));
+
+	outU = _mm256_mul_ps(Dot8(e2X, e2Y, e2Z, daoX, daoY, daoZ), invDet);
+	outV = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(Dot8(e1X, e1Y, e1Z, daoX, daoY, daoZ), invDet));
+	outDistance = _mm256_mul_ps(Dot8(aoX, aoY, aoZ, nX, nY, nZ), invDet);
+
+	const __m256 signMask = _mm256_set1_ps(-0.f);
+	const __m256 facingDet = inSettings.bTwoSided ? _mm256_andnot_ps(signMask, det) : (inSettings.bFlipFacing ? _mm256_xor_ps(signMask, det) : det);
+
+	__m256 hit = _mm256_cmp_ps(facingDet, _mm256_set1_ps(1e-6f), _CMP_GE_OQ);
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outDistance, _mm256_set1_ps(inRay.TMin), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outDistance, _mm256_set1_ps(inMaxDistance), _CMP_LE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outDistance, _mm256_set1_ps(inClosestDistance), _CMP_LT_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outU, _mm256_setzero_ps(), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outV, _mm256_setzero_ps(), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(outU, outV), _mm256_set1_ps(1.f), _CMP_LE_OQ));
+
+	return _mm256_movemask_ps(hit);
+}
+
+TARGET_AVX static inline int32_t IntersectLanesWatertight(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	const float inClosestDistance, OUT __m256& outDistance, OUT __m256& outU, OUT __m256& outV)
+{
+	const int32_t kx = inRay.ShearAxes[0];
+	const int32_t ky = inRay.ShearAxes[1];
+	const int32_t kz = inRay.ShearAxes[2];
+
+	const __m256 originX = _mm256_set1_ps(inRay.Origin[kx]);
+	const __m256 originY = _mm256_set1_ps(inRay.Origin[ky]);
+	const __m256 originZ = _mm256_set1_ps(inRay.Origin[kz]);
+	const __m256 shearX = _mm256_set1_ps(inRay.Shear.x);
+	const __m256 shearY = _mm256_set1_ps(inRay.Shear.y);
+	const __m256 shearZ = _mm256_set1_ps(inRay.Shear.z);
+
+	const __m256 aZ = _mm256_sub_ps(_mm256_load_ps(inPacket.V0[kz]), originZ);
+	const __m256 bZ = _mm256_sub_ps(_mm256_load_ps(inPacket.V1[kz]), originZ);
+	const __m256 cZ = _mm256_sub_ps(_mm256_load_ps(inPacket.V2[kz]), originZ);
+
+	const __m256 aX = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(inPacket.V0[kx]), originX), _mm256_mul_ps(shearX, aZ));
+	const __m256 aY = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(inPacket.V0[ky]), originY), _mm256_mul_ps(shearY, aZ));
+	const __m256 bX = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(inPacket.V1[kx]), originX), _mm256_mul_ps(shearX, bZ));
+	const __m256 bY = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(inPacket.V1[ky]), originY), _mm256_mul_ps(shearY, bZ));
+	const __m256 cX = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(inPacket.V2[kx]), originX), _mm256_mul_ps(shearX, cZ));
+	const __m256 cY = _mm256_sub_ps(_mm256_sub_ps(_mm256_load_ps(inPacket.V2[ky]), originY), _mm256_mul_ps(shearY, cZ));
+
+	__m256 U = _mm256_sub_ps(_mm256_mul_ps(cX, bY), _mm256_mul_ps(cY, bX));
+	__m256 V = _mm256_sub_ps(_mm256_mul_ps(aX, cY), _mm256_mul_ps(aY, cX));
+	__m256 W = _mm256_sub_ps(_mm256_mul_ps(bX, aY), _mm256_mul_ps(bY, aX));
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 uZero = _mm256_cmp_ps(U, zero, _CMP_EQ_OQ);
+	const __m256 vZero = _mm256_cmp_ps(V, zero, _CMP_EQ_OQ);
+	const __m256 wZero = _mm256_cmp_ps(W, zero, _CMP_EQ_OQ);
+	const int32_t anyZeroMask = _mm256_movemask_ps(_mm256_or_ps(_mm256_or_ps(uZero, vZero), wZero));
+	const int32_t allZeroMask = _mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(uZero, vZero), wZero));
+	if ((anyZeroMask & ~allZeroMask) != 0)
+	{
+		alignas(32) float ax[8], ay[8], bx[8], by[8], cx[8], cy[8], u[8], v[8], w[8];
+		_mm256_store_ps(ax, aX);
+		_mm256_store_ps(ay, aY);
+		_mm256_store_ps(bx, bX);
+		_mm256_store_ps(by, bY);
+		_mm256_store_ps(cx, cX);
+		_mm256_store_ps(cy, cY);
+		_mm256_store_ps(u, U);
+		_mm256_store_ps(v, V);
+		_mm256_store_ps(w, W);
+
+		FixWatertightEdgeLanes<8>(anyZeroMask & ~allZeroMask, ax, ay, bx, by, cx, cy, u, v, w);
+
+		U = _mm256_load_ps(u);
+		V = _mm256_load_ps(v);
+		W = _mm256_load_ps(w);
+	}
+
+	const __m256 anyNegative = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_LT_OQ), _mm256_cmp_ps(V, zero, _CMP_LT_OQ)), _mm256_cmp_ps(W, zero, _CMP_LT_OQ));
+	const __m256 anyPositive = _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(U, zero, _CMP_GT_OQ), _mm256_cmp_ps(V, zero, _CMP_GT_OQ)), _mm256_cmp_ps(W, zero, _CMP_GT_OQ));
+	const __m256 outside = inSettings.bTwoSided ? _mm256_and_ps(anyNegative, anyPositive) : (inSettings.bFlipFacing ? anyPositive : anyNegative);
+
+	const __m256 det = _mm256_add_ps(_mm256_add_ps(U, V), W);
+	const __m256 T = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(U, _mm256_mul_ps(shearZ, aZ)), _mm256_mul_ps(V, _mm256_mul_ps(shearZ, bZ))), _mm256_mul_ps(W, _mm256_mul_ps(shearZ, cZ)));
+	const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.f), det);
+
+	outDistance = _mm256_mul_ps(T, invDet);
+	outU = _mm256_mul_ps(V, invDet);
+	outV = _mm256_mul_ps(W, invDet);
+
+	__m256 hit = _mm256_andnot_ps(outside, _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outDistance, _mm256_set1_ps(inRay.TMin), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outDistance, _mm256_set1_ps(inMaxDistance), _CMP_LE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(outDistance, _mm256_set1_ps(inClosestDistance), _CMP_LT_OQ));
+
+	return _mm256_movemask_ps(hit);
+}
+
+TARGET_AVX static inline int32_t IntersectLanes(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance,
+	const float inClosestDistance, OUT __m256& outDistance, OUT __m256& outU, OUT __m256& outV)
+{
+	if (inSettings.Intersection == ETriangleIntersection::Watertight)
+	{
+		return IntersectLanesWatertight(inPacket, inRay, inSettings, inMaxDistance, inClosestDistance, outDistance, outU, outV);
+	}
+
+	return IntersectLanesMollerTrumbore(inPacket, inRay, inSettings, inMaxDistance, inClosestDistance, outDistance, outU, outV);
+}
+
+#endif
+
+int32_t TracePacket(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inClosestDistance,
+	OUT float& outDistance, OUT float& outU, OUT float& outV)
+{
+#if PLATFORM_X64
+	__m128 distance, u, v;
+	const int32_t hitMask = IntersectLanes(inPacket, inRay, inSettings, inRay.TMax, inClosestDistance, distance, u, v);
+	if (hitMask == 0)
+	{
+		return -1;
+	}
+
+	float distances[4], us[4], vs[4];
+	_mm_storeu_ps(distances, distance);
+	_mm_storeu_ps(us, u);
+	_mm_storeu_ps(vs, v);
+
+	const int32_t lane = SelectNearestLane<4>(hitMask, distances);
+	outDistance = distances[lane];
+	outU = us[lane];
+	outV = vs[lane];
+
+	return lane;
+#else
+	return -1;
+#endif
+}
+
+TARGET_AVX int32_t TracePacket(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inClosestDistance,
+	OUT float& outDistance, OUT float& outU, OUT float& outV)
+{
+#if PLATFORM_X64
+	__m256 distance, u, v;
+	const int32_t hitMask = IntersectLanes(inPacket, inRay, inSettings, inRay.TMax, inClosestDistance, distance, u, v);
+	if (hitMask == 0)
+	{
+		return -1;
+	}
+
+	float distances[8], us[8], vs[8];
+	_mm256_storeu_ps(distances, distance);
+	_mm256_storeu_ps(us, u);
+	_mm256_storeu_ps(vs, v);
+
+	const int32_t lane = SelectNearestLane<8>(hitMask, distances);
+	outDistance = distances[lane];
+	outU = us[lane];
+	outV = vs[lane];
+
+	return lane;
+#else
+	return -1;
+#endif
+}
+
+bool IntersectsPacket(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance)
+{
+#if PLATFORM_X64
+	__m128 distance, u, v;
+	return IntersectLanes(inPacket, inRay, inSettings, glm::min(inRay.TMax, inMaxDistance), INFINITY, distance, u, v) != 0;
+#else
+	return false;
+#endif
+}
+
+TARGET_AVX bool IntersectsPacket(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance)
+{
+#if PLATFORM_X64
+	__m256 distance, u, v;
+	return IntersectLanes(inPacket, inRay, inSettings, glm::min(inRay.TMax, inMaxDistance), INFINITY, distance, u, v) != 0;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "Core/EngineUtils.h"
+#include "Math/PathTracing.h"
+
+// Width triangles stored in SoA layout so that each component of all of them fits one SIMD register.
+// Vertices are kept as is rather than as edges, the watertight test needs the exact vertices shared with neighbours.
+template<int32_t Width>
+struct alignas(32) TrianglePacket
+{
+	// [Axis][Lane]
+	float V0[3][Width];
+	float V1[3][Width];
+	float V2[3][Width];
+	// Not normalised, like PathTraceTriangle::WSNormal
+	float N[3][Width];
+
+	// Index of the source triangle in BVH::Triangles
+	uint32_t TriangleIndex[Width];
+
+	// Empty lanes are a degenerate triangle at the origin with a zero normal, which no kernel can hit
+	void Clear();
+	void SetLane(const int32_t inLane, const PathTraceTriangle& inTri, const uint32_t inTriangleIndex);
+};
+
+// Closest hit among the lanes of the packet, same math as TraceTriangle.
+// Only hits in [TMin, TMax] and closer than inClosestDistance are considered. Returns the lane hit or -1.
+int32_t TracePacket(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inClosestDistance,
+	OUT float& outDistance, OUT float& outU, OUT float& outV);
+int32_t TracePacket(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inClosestDistance,
+	OUT float& outDistance, OUT float& outU, OUT float& outV);
+
+// Any hit among the lanes of the packet closer than inMaxDistance, same math as IntersectsTriangle
+bool IntersectsPacket(const TrianglePacket<4>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance);
+bool IntersectsPacket(const TrianglePacket<8>& inPacket, const PathTracingRay& inRay, const TriangleTestSettings& inSettings, const float inMaxDistance);
@@ -0,0 +1,593 @@
+#include "Math/WideBVH.h"
+#include "Math/BVH.h"
+#include "Utils/CPUFeatures.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if PLATFORM_X64
+#include <immintrin.h>
+#endif
+
+// Every interior node visited leaves at most Width - 1 siblings behind on the stack
+#define WIDE_BVH_STACK_SIZE(Width) ((Width - 1) * BVH_MAX_DEPTH + Width)
+
+struct WideBVHTraversalEntry
+{
+	uint32_t Index;
+	uint32_t PacketsCount;
+	float EntryDistance;
+};
+
+EBVHWidth GetSupportedBVHWidth(const EBVHWidth inRequestedWidth)
+{
+#if PLATFORM_X64
+	switch (inRequestedWidth)
+	{
+	case EBVHWidth::Auto:
+	case EBVHWidth::Eight:
+	{
+		return CPUFeatures::HasAVX() ? EBVHWidth::Eight : EBVHWidth::Four;
+	}
+	default:
+	{
+		return inRequestedWidth;
+	}
+	}
+#else
+	return EBVHWidth::Binary;
+#endif
+}
+
+int32_t GetBVHWidthLanes(const EBVHWidth inWidth)
+{
+	switch (inWidth)
+	{
+	case EBVHWidth::Four:
+	{
+		return 4;
+	}
+	case EBVHWidth::Eight:
+	{
+		return 8;
+	}
+	default:
+	{
+		return 1;
+	}
+	}
+}
+
+#if PLATFORM_X64
+
+// Tests the ray against all children of the node at once, returns a bit mask of the children hit
+// and writes their entry distances. Same math as the scalar RayIntersectsAABB in BVH.cpp.
+template<int32_t Width>
+static int32_t IntersectChildren(const BVHWideNode<Width>& inNode, const PathTracingRay& inRay, const float inMaxDistance, float outEntryDistances[Width]);
+
+template<>
+int32_t IntersectChildren<4>(const BVHWideNode<4>& inNode, const PathTracingRay& inRay, const float inMaxDistance, float outEntryDistances[4])
+{
+	__m128 tEntry = _mm_set1_ps(inRay.TMin);
+	__m128 tExit = _mm_set1_ps(inMaxDistance);
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const float* nearBounds = inRay.DirIsNegative[axis] ? inNode.BoundsMax[axis] : inNode.BoundsMin[axis];
+		const float* farBounds = inRay.DirIsNegative[axis] ? inNode.BoundsMin[axis] : inNode.BoundsMax[axis];
+
+		const __m128 origin = _mm_set1_ps(inRay.Origin[axis]);
+		const __m128 invDirection = _mm_set1_ps(inRay.InvDirection[axis]);
+
+		const __m128 tNear = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearBounds), origin), invDirection);
+		const __m128 tFar = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(farBounds), origin), invDirection), _mm_set1_ps(BVH_ROBUST_EXIT_SCALE));
+
+		// Accumulator as second operand, max/min return it when the slab is NaN
+		tEntry = _mm_max_ps(tNear, tEntry);
+		tExit = _mm_min_ps(tFar, tExit);
+	}
+
+	_mm_storeu_ps(outEntryDistances, tEntry);
+
+	return _mm_movemask_ps(_mm_cmple_ps(tEntry, tExit));
+}
+
+template<>
+TARGET_AVX int32_t IntersectChildren<8>(const BVHWideNode<8>& inNode, const PathTracingRay& inRay, const float inMaxDistance, float outEntryDistances[8])
+{
+	__m256 tEntry = _mm256_set1_ps(inRay.TMin);
+	__m256 tExit = _mm256_set1_ps(inMaxDistance);
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const float* nearBounds = inRay.DirIsNegative[axis] ? inNode.BoundsMax[axis] : inNode.BoundsMin[axis];
+		const float* farBounds = inRay.DirIsNegative[axis] ? inNode.BoundsMin[axis] : inNode.BoundsMax[axis];
+
+		const __m256 origin = _mm256_set1_ps(inRay.Origin[axis]);
+		const __m256 invDirection = _mm256_set1_ps(inRay.InvDirection[axis]);
+
+		const __m256 tNear = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(nearBounds), origin), invDirection);
+		const __m256 tFar = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(farBounds), origin), invDirection), _mm256_set1_ps(BVH_ROBUST_EXIT_SCALE));
+
+		tEntry = _mm256_max_ps(tNear, tEntry);
+		tExit = _mm256_min_ps(tFar, tExit);
+	}
+
+	_mm256_storeu_ps(outEntryDistances, tEntry);
+
+	return _mm256_movemask_ps(_mm256_cmp_ps(tEntry, tExit, _CMP_LE_OQ));
+}
+
+// 2^inExponent built straight from its bits, inExponent is always a normal float exponent
+static inline __m128i GetExponentScaleBits(const int8_t inExponent)
+{
+	return _mm_set1_epi32((static_cast<int32_t>(inExponent) + 127) << 23);
+}
+
+// Decodes the bounds and then runs the exact same slab test as the full precision node,
+// Origin + Quantized * 2^Exponent is computed the same way the builder checked it against the real bounds
+template<int32_t Width>
+static int32_t IntersectChildren(const BVHQuantizedWideNode<Width>& inNode, const PathTracingRay& inRay, const float inMaxDistance, float outEntryDistances[Width]);
+
+static inline __m128 DecodeQuantized4(const uint8_t inQuantized[4], const __m128 inOrigin, const __m128 inScale)
+{
+	int32_t packed;
+	memcpy(&packed, inQuantized, sizeof(packed));
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i widened = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+	return _mm_add_ps(inOrigin, _mm_mul_ps(_mm_cvtepi32_ps(widened), inScale));
+}
+
+template<>
+int32_t IntersectChildren<4>(const BVHQuantizedWideNode<4>& inNode, const PathTracingRay& inRay, const float inMaxDistance, float outEntryDistances[4])
+{
+	__m128 tEntry = _mm_set1_ps(inRay.TMin);
+	__m128 tExit = _mm_set1_ps(inMaxDistance);
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const uint8_t* nearBounds = inRay.DirIsNegative[axis] ? inNode.QuantizedMax[axis] : inNode.QuantizedMin[axis];
+		const uint8_t* farBounds = inRay.DirIsNegative[axis] ? inNode.QuantizedMin[axis] : inNode.QuantizedMax[axis];
+
+		const __m128 nodeOrigin = _mm_set1_ps(inNode.Origin[axis]);
+		const __m128 scale = _mm_castsi128_ps(GetExponentScaleBits(inNode.Exponent[axis]));
+
+		const __m128 origin = _mm_set1_ps(inRay.Origin[axis]);
+		const __m128 invDirection = _mm_set1_ps(inRay.InvDirection[axis]);
+
+		const __m128 tNear = _mm_mul_ps(_mm_sub_ps(DecodeQuantized4(nearBounds, nodeOrigin, scale), origin), invDirection);
+		const __m128 tFar = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(DecodeQuantized4(farBounds, nodeOrigin, scale), origin), invDirection), _mm_set1_ps(BVH_ROBUST_EXIT_SCALE));
+
+		tEntry = _mm_max_ps(tNear, tEntry);
+		tExit = _mm_min_ps(tFar, tExit);
+	}
+
+	_mm_storeu_ps(outEntryDistances, tEntry);
+
+	return _mm_movemask_ps(_mm_cmple_ps(tEntry, tExit));
+}
+
+// AVX has no 256 bit integer widening, each half is widened on its own
+TARGET_AVX static inline __m256 DecodeQuantized8(const uint8_t inQuantized[8], const __m256 inOrigin, const __m256 inScale)
+{
+	const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(inQuantized));
+	const __m128 low = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes));
+	const __m128 high = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)));
+
+	return _mm256_add_ps(inOrigin, _mm256_mul_ps(_mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1), inScale));
+}
+
+template<>
+TARGET_AVX int32_t IntersectChildren<8>(const BVHQuantizedWideNode<8>& inNode, const PathTracingRay& inRay, const float inMaxDistance, float outEntryDistances[8])
+{
+	__m256 tEntry = _mm256_set1_ps(inRay.TMin);
+	__m256 tExit = _mm256_set1_ps(inMaxDistance);
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		const uint8_t* nearBounds = inRay.DirIsNegative[axis] ? inNode.QuantizedMax[axis] : inNode.QuantizedMin[axis];
+		const uint8_t* farBounds = inRay.DirIsNegative[axis] ? inNode.QuantizedMin[axis] : inNode.QuantizedMax[axis];
+
+		const __m256 nodeOrigin = _mm256_set1_ps(inNode.Origin[axis]);
+		const __m256 scale = _mm256_set1_ps(_mm_cvtss_f32(_mm_castsi128_ps(GetExponentScaleBits(inNode.Exponent[axis]))));
+
+		const __m256 origin = _mm256_set1_ps(inRay.Origin[axis]);
+		const __m256 invDirection = _mm256_set1_ps(inRay.InvDirection[axis]);
+
+		const __m256 tNear = _mm256_mul_ps(_mm256_sub_ps(DecodeQuantized8(nearBounds, nodeOrigin, scale), origin), invDirection);
+		const __m256 tFar = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(DecodeQuantized8(farBounds, nodeOrigin, scale), origin), invDirection), _mm256_set1_ps(BVH_ROBUST_EXIT_SCALE));
+
+		tEntry = _mm256_max_ps(tNear, tEntry);
+		tExit = _mm256_min_ps(tFar, tExit);
+	}
+
+	_mm256_storeu_ps(outEntryDistances, tEntry);
+
+	return _mm256_movemask_ps(_mm256_cmp_ps(tEntry, tExit, _CMP_LE_OQ));
+}
+
+#endif
+
+// Same expression as the traversal decode, the builder checks its rounding against it
+static inline float DecodeQuantized(const float inOrigin, const uint32_t inQuantized, const float inScale)
+{
+	return inOrigin + static_cast<float>(inQuantized) * inScale;
+}
+
+template<int32_t Width>
+static BVHQuantizedWideNode<Width> QuantizeNode(const BVHWideNode<Width>& inNode)
+{
+	BVHQuantizedWideNode<Width> quantized;
+	quantized.Pad = 0;
+
+	for (int32_t i = 0; i < Width; ++i)
+	{
+		quantized.ChildIndex[i] = inNode.ChildIndex[i];
+		quantized.ChildPacketsCount[i] = inNode.ChildPacketsCount[i];
+	}
+
+	for (int32_t axis = 0; axis < 3; ++axis)
+	{
+		float nodeMin = FLT_MAX;
+		float nodeMax = -FLT_MAX;
+		for (int32_t i = 0; i < Width; ++i)
+		{
+			if (inNode.BoundsMin[axis][i] <= inNode.BoundsMax[axis][i])
+			{
+				nodeMin = glm::min(nodeMin, inNode.BoundsMin[axis][i]);
+				nodeMax = glm::max(nodeMax, inNode.BoundsMax[axis][i]);
+			}
+		}
+
+		// Every node has at least one child
+		ASSERT(nodeMin <= nodeMax);
+
+		// Smallest power of two that spans the node in 255 steps, bumped until the decoded top really reaches nodeMax
+		int32_t exponent;
+		frexpf((nodeMax - nodeMin) / 255.f, &exponent);
+		exponent = glm::clamp(exponent, -126, 127);
+		while (exponent < 127 && DecodeQuantized(nodeMin, 255, ldexpf(1.f, exponent)) < nodeMax)
+		{
+			++exponent;
+		}
+
+		const float scale = ldexpf(1.f, exponent);
+		quantized.Origin[axis] = nodeMin;
+		quantized.Exponent[axis] = static_cast<int8_t>(exponent);
+
+		for (int32_t i = 0; i < Width; ++i)
+		{
+			const float childMin = inNode.BoundsMin[axis][i];
+			const float childMax = inNode.BoundsMax[axis][i];
+
+			if (childMin > childMax)
+			{
+				quantized.QuantizedMin[axis][i] = 255;
+				quantized.QuantizedMax[axis][i] = 0;
+				continue;
+			}
+
+			// Floor and ceil get close, the loops settle the last rounding of the decode so the box never shrinks
+			uint32_t quantizedMin = static_cast<uint32_t>(glm::clamp(floorf((childMin - nodeMin) / scale), 0.f, 255.f));
+			uint32_t quantizedMax = static_cast<uint32_t>(glm::clamp(ceilf((childMax - nodeMin) / scale), 0.f, 255.f));
+
+			while (quantizedMin > 0 && DecodeQuantized(nodeMin, quantizedMin, scale) > childMin)
+			{
+				--quantizedMin;
+			}
+
+			while (quantizedMax < 255 && DecodeQuantized(nodeMin, quantizedMax, scale) < childMax)
+			{
+				++quantizedMax;
+			}
+
+			quantized.QuantizedMin[axis][i] = static_cast<uint8_t>(quantizedMin);
+			quantized.QuantizedMax[axis][i] = static_cast<uint8_t>(quantizedMax);
+		}
+	}
+
+	return quantized;
+}
+
+template<int32_t Width>
+void WideBVH<Width>::Clear()
+{
+	Nodes.clear();
+	QuantizedNodes.clear();
+	Packets.clear();
+}
+
+template<int32_t Width>
+void WideBVH<Width>::Build(const BVH& inBVH, const bool inQuantize)
+{
+	Clear();
+
+	if (!inBVH.IsValid())
+	{
+		return;
+	}
+
+	// Each wide node replaces roughly Width - 1 binary interior nodes
+	Nodes.reserve(inBVH.Nodes.size() / (Width - 1) + 1);
+	Packets.reserve(inBVH.Triangles.size() / Width + inBVH.Nodes.size() / 2 + 1);
+
+	CollapseNode(inBVH, 0);
+
+	if (inQuantize)
+	{
+		// Collapsed at full precision first, a node only knows its own box once all of its children are placed
+		QuantizedNodes.resize(Nodes.size());
+		for (size_t i = 0; i < Nodes.size(); ++i)
+		{
+			QuantizedNodes[i] = QuantizeNode(Nodes[i]);
+		}
+
+		Nodes.clear();
+		Nodes.shrink_to_fit();
+	}
+}
+
+template<int32_t Width>
+uint32_t WideBVH<Width>::CollapseNode(const BVH& inBVH, const uint32_t inBinaryNodeIndex)
+{
+	uint32_t children[Width];
+	int32_t childrenCount = 0;
+
+	const BVHLinearNode& binaryNode = inBVH.Nodes[inBinaryNodeIndex];
+	if (binaryNode.IsLeaf())
+	{
+		// Only happens for a root that is a leaf
+		children[childrenCount++] = inBinaryNodeIndex;
+	}
+	else
+	{
+		children[childrenCount++] = inBinaryNodeIndex + 1;
+		children[childrenCount++] = binaryNode.SecondChildIndex;
+
+		// Pull up grandchildren, always opening the largest interior child since it is the most likely to be hit
+		while (childrenCount < Width)
+		{
+			int32_t bestChild = -1;
+			float bestArea = -1.f;
+
+			for (int32_t i = 0; i < childrenCount; ++i)
+			{
+				const BVHLinearNode& child = inBVH.Nodes[children[i]];
+				if (child.IsLeaf())
+				{
+					continue;
+				}
+
+				const glm::vec3 size = child.Bounds[1] - child.Bounds[0];
+				const float area = size.x * size.y + size.y * size.z + size.z * size.x;
+				if (area > bestArea)
+				{
+					bestArea = area;
+					bestChild = i;
+				}
+			}
+
+			if (bestChild == -1)
+			{
+				break;
+			}
+
+			const uint32_t openedNodeIndex = children[bestChild];
+			children[bestChild] = openedNodeIndex + 1;
+			children[childrenCount++] = inBVH.Nodes[openedNodeIndex].SecondChildIndex;
+		}
+	}
+
+	const uint32_t wideNodeIndex = static_cast<uint32_t>(Nodes.size());
+	Nodes.push_back(BVHWideNode<Width>());
+
+	BVHWideNode<Width> wideNode;
+	for (int32_t i = 0; i < Width; ++i)
+	{
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			wideNode.BoundsMin[axis][i] = FLT_MAX;
+			wideNode.BoundsMax[axis][i] = -FLT_MAX;
+		}
+
+		wideNode.ChildIndex[i] = 0;
+		wideNode.ChildPacketsCount[i] = 0;
+	}
+
+	for (int32_t i = 0; i < childrenCount; ++i)
+	{
+		const BVHLinearNode& child = inBVH.Nodes[children[i]];
+
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			wideNode.BoundsMin[axis][i] = child.Bounds[0][axis];
+			wideNode.BoundsMax[axis][i] = child.Bounds[1][axis];
+		}
+
+		if (child.IsLeaf())
+		{
+			wideNode.ChildIndex[i] = static_cast<uint32_t>(Packets.size());
+			wideNode.ChildPacketsCount[i] = static_cast<uint16_t>((child.TrianglesCount + Width - 1) / Width);
+
+			for (uint32_t triangleIndex = child.TrianglesOffset; triangleIndex < child.TrianglesOffset + child.TrianglesCount; triangleIndex += Width)
+			{
+				TrianglePacket<Width> packet;
+				packet.Clear();
+
+				const uint32_t lanesCount = glm::min<uint32_t>(Width, child.TrianglesOffset + child.TrianglesCount - triangleIndex);
+				for (uint32_t lane = 0; lane < lanesCount; ++lane)
+				{
+					packet.SetLane(lane, inBVH.Triangles[triangleIndex + lane], triangleIndex + lane);
+				}
+
+				Packets.push_back(packet);
+			}
+		}
+		else
+		{
+			// Nodes may reallocate here, the new node is only written at the end
+			wideNode.ChildIndex[i] = CollapseNode(inBVH, children[i]);
+		}
+	}
+
+	Nodes[wideNodeIndex] = wideNode;
+
+	return wideNodeIndex;
+}
+
+template<int32_t Width, typename NodeType>
+static bool TraceNodes(const eastl::vector<NodeType, AlignedAllocator>& inNodes, const eastl::vector<TrianglePacket<Width>, AlignedAllocator>& inPackets,
+	const BVH& inBVH, const PathTracingRay& inRay, PathTracePayload& outPayload, const TriangleTestSettings& inTriangleTest)
+{
+#if PLATFORM_X64
+
+	WideBVHTraversalEntry stack[WIDE_BVH_STACK_SIZE(Width)];
+	int32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0, inRay.TMin };
+
+	bool bHit = false;
+
+	while (stackSize > 0)
+	{
+		const WideBVHTraversalEntry entry = stack[--stackSize];
+
+		// Skip everything that starts past the closest hit found since it was pushed
+		const float maxDistance = glm::min(outPayload.Distance, inRay.TMax);
+		if (entry.EntryDistance > maxDistance)
+		{
+			continue;
+		}
+
+		if (entry.PacketsCount != 0)
+		{
+			for (uint32_t i = entry.Index; i < entry.Index + entry.PacketsCount; ++i)
+			{
+				const TrianglePacket<Width>& packet = inPackets[i];
+
+				float distance, u, v;
+				const int32_t lane = TracePacket(packet, inRay, inTriangleTest, outPayload.Distance, distance, u, v);
+				if (lane != -1)
+				{
+					bHit = true;
+					outPayload.Distance = distance;
+					outPayload.U = u;
+					outPayload.V = v;
+					outPayload.Triangle = &inBVH.Triangles[packet.TriangleIndex[lane]];
+				}
+			}
+
+			continue;
+		}
+
+		const NodeType& node = inNodes[entry.Index];
+
+		float entryDistances[Width];
+		int32_t hitMask = IntersectChildren<Width>(node, inRay, maxDistance, entryDistances);
+
+		// Push the children hit sorted in place by distance, farthest first so the nearest ends up on top of the stack
+		const int32_t firstChildEntry = stackSize;
+		while (hitMask != 0)
+		{
+			int32_t child = 0;
+			while (((hitMask >> child) & 1) == 0)
+			{
+				++child;
+			}
+			hitMask &= hitMask - 1;
+
+			const WideBVHTraversalEntry newEntry = { node.ChildIndex[child], node.ChildPacketsCount[child], entryDistances[child] };
+
+			int32_t insertIndex = stackSize++;
+			while (insertIndex > firstChildEntry && stack[insertIndex - 1].EntryDistance < newEntry.EntryDistance)
+			{
+				stack[insertIndex] = stack[insertIndex - 1];
+				--insertIndex;
+			}
+
+			stack[insertIndex] = newEntry;
+		}
+	}
+
+	return bHit;
+#else
+	return false;
+#endif
+}
+
+template<int32_t Width, typename NodeType>
+static bool IsOccludedNodes(const eastl::vector<NodeType, AlignedAllocator>& inNodes, const eastl::vector<TrianglePacket<Width>, AlignedAllocator>& inPackets,
+	const BVH& inBVH, const PathTracingRay& inRay, const float inMaxDistance, const TriangleTestSettings& inTriangleTest)
+{
+#if PLATFORM_X64
+
+	const float maxDistance = glm::min(inMaxDistance, inRay.TMax);
+
+	WideBVHTraversalEntry stack[WIDE_BVH_STACK_SIZE(Width)];
+	int32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0, inRay.TMin };
+
+	while (stackSize > 0)
+	{
+		const WideBVHTraversalEntry entry = stack[--stackSize];
+
+		if (entry.PacketsCount != 0)
+		{
+			for (uint32_t i = entry.Index; i < entry.Index + entry.PacketsCount; ++i)
+			{
+				if (IntersectsPacket(inPackets[i], inRay, inTriangleTest, maxDistance))
+				{
+					return true;
+				}
+			}
+
+			continue;
+		}
+
+		const NodeType& node = inNodes[entry.Index];
+
+		// Any hit ends the query so order does not matter
+		float entryDistances[Width];
+		int32_t hitMask = IntersectChildren<Width>(node, inRay, maxDistance, entryDistances);
+		while (hitMask != 0)
+		{
+			int32_t child = 0;
+			while (((hitMask >> child) & 1) == 0)
+			{
+				++child;
+			}
+			hitMask &= hitMask - 1;
+
+			stack[stackSize++] = { node.ChildIndex[child], node.ChildPacketsCount[child], entryDistances[child] };
+		}
+	}
+#endif
+
+	return false;
+}
+
+template<int32_t Width>
+bool WideBVH<Width>::Trace(const BVH& inBVH, const PathTracingRay& inRay, PathTracePayload& outPayload, const TriangleTestSettings& inTriangleTest) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	return IsQuantized() ? TraceNodes<Width>(QuantizedNodes, Packets, inBVH, inRay, outPayload, inTriangleTest) : TraceNodes<Width>(Nodes, Packets, inBVH, inRay, outPayload, inTriangleTest);
+}
+
+template<int32_t Width>
+bool WideBVH<Width>::IsOccluded(const BVH& inBVH, const PathTracingRay& inRay, const float inMaxDistance, const TriangleTestSettings& inTriangleTest) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	return IsQuantized() ? IsOccludedNodes<Width>(QuantizedNodes, Packets, inBVH, inRay, inMaxDistance, inTriangleTest) : IsOccludedNodes<Width>(Nodes, Packets, inBVH, inRay, inMaxDistance, inTriangleTest);
+}
+
+template struct WideBVH<4>;
+template struct WideBVH<8>;
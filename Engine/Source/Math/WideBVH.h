@@ -0,0 +1,88 @@
+#pragma once
+#include "Core/EngineUtils.h"
+#include "EASTL/vector.h"
+#include "Math/PathTracing.h"
+#include "Math/TrianglePacket.h"
+#include "Utils/AlignedAllocator.h"
+
+enum class EBVHWidth : uint8_t
+{
+	// Widest layout the CPU has SIMD support for
+	Auto,
+	// Scalar traversal of the binary tree
+	Binary,
+	// SSE, 4 children per node
+	Four,
+	// AVX, 8 children per node
+	Eight
+};
+
+// Node of a BVH with up to Width children, tested against the ray all at once.
+// Child bounds are stored in SoA layout so each axis of all children fits one SIMD register.
+template<int32_t Width>
+struct alignas(32) BVHWideNode
+{
+	// [Axis][Child]
+	float BoundsMin[3][Width];
+	float BoundsMax[3][Width];
+
+	// Interior child: index of its node. Leaf child: index of its first packet in WideBVH::Packets
+	uint32_t ChildIndex[Width];
+
+	// 0 for interior and empty children, empty children have inverted bounds so they are never hit
+	uint16_t ChildPacketsCount[Width];
+};
+
+// Same tree as BVHWideNode at half the size. Child bounds are 8 bit offsets from the node's own box, scaled per axis
+// by a power of two so that decoding them is exact. Quantization always rounds outwards, so children only get slightly looser.
+template<int32_t Width>
+struct alignas(16) BVHQuantizedWideNode
+{
+	// Child bound on an axis is Origin + Quantized * 2^Exponent
+	float Origin[3];
+	int8_t Exponent[3];
+	uint8_t Pad;
+
+	// [Axis][Child], empty children have QuantizedMin above QuantizedMax so they are never hit
+	uint8_t QuantizedMin[3][Width];
+	uint8_t QuantizedMax[3][Width];
+
+	// Same meaning as in BVHWideNode
+	uint32_t ChildIndex[Width];
+	uint16_t ChildPacketsCount[Width];
+};
+
+static_assert(sizeof(BVHQuantizedWideNode<4>) == 64, "BVHQuantizedWideNode<4> is expected to fill exactly one cache line.");
+static_assert(sizeof(BVHQuantizedWideNode<8>) == 112, "BVHQuantizedWideNode<8> is expected to fit in two cache lines.");
+
+// Wider tree obtained by collapsing a built binary BVH.
+// Leaf triangles are copied into packets of Width, a leaf is intersected a whole packet at a time.
+template<int32_t Width>
+struct WideBVH
+{
+	// Either Nodes or QuantizedNodes is filled, depending on inQuantize
+	void Build(const struct BVH& inBVH, const bool inQuantize);
+
+	// inTriangleTest is the BVH's own with the flip of the query applied
+	bool Trace(const struct BVH& inBVH, const PathTracingRay& inRay, PathTracePayload& outPayload, const TriangleTestSettings& inTriangleTest) const;
+	bool IsOccluded(const struct BVH& inBVH, const PathTracingRay& inRay, const float inMaxDistance, const TriangleTestSettings& inTriangleTest) const;
+
+	inline bool IsValid() const { return !Nodes.empty() || !QuantizedNodes.empty(); }
+	inline bool IsQuantized() const { return !QuantizedNodes.empty(); }
+	void Clear();
+
+	eastl::vector<BVHWideNode<Width>, AlignedAllocator> Nodes;
+	eastl::vector<BVHQuantizedWideNode<Width>, AlignedAllocator> QuantizedNodes;
+
+	// Each leaf references a contiguous range, the last packet of a leaf may have empty lanes
+	eastl::vector<TrianglePacket<Width>, AlignedAllocator> Packets;
+
+private:
+	uint32_t CollapseNode(const struct BVH& inBVH, const uint32_t inBinaryNodeIndex);
+};
+
+// Resolves EBVHWidth::Auto based on the instruction sets of the current CPU
+EBVHWidth GetSupportedBVHWidth(const EBVHWidth inRequestedWidth);
+
+// Number of triangles intersected at once by a leaf of the given width, 1 for Binary and Auto
+int32_t GetBVHWidthLanes(const EBVHWidth inWidth);
@@ -35,7 +35,10 @@
 #include "imgui.h"
 #include "ShaderTypes.h"
 #include "Math/SphericalHarmonics.h"
+#include "Math/SHSampleSets.h"
 #include "Math/MathUtils.h"
+#include "Renderer/SHTransferBake.h"
+#include "Renderer/SHTransferCache.h"
 
 void InitGI();
 
@@ -125,193 +128,31 @@ static glm::vec3 NormalizedDirLightDir = glm::vec3(0.f, 1.f, 0.f);
 
 bool DeferredRenderer::TriangleTrace(const PathTracingRay& inRay, PathTracePayload& outPayload, glm::vec3& outColor)
 {
-	bool bHit = false;
-	for (const RenderCommand& command : MainCommands)
+	if (!SceneAccStructure.Trace(inRay, outPayload))
 	{
-		if (command.Triangles.size() == 0)
-		{
-			continue;
-		}
-
-		PathTracePayload currMeshPayload;
-		if (command.AccStructure.Trace(inRay, currMeshPayload))
-		{
-			bHit = true;
-			if (currMeshPayload.Distance < outPayload.Distance)
-			{
-				outPayload = currMeshPayload;
-				outColor = command.OverrideColor;
-			}
-		}
+		return false;
 	}
 
-	return bHit;
+	const BVHInstance& instance = SceneAccStructure.Instances[outPayload.InstanceIndex];
+	outColor = MainCommands[instance.UserIndex].OverrideColor;
+
+	return true;
 }
 
 void DeferredRenderer::InitGI()
 {
-	SHSample* samples = new SHSample[SH_TOTAL_SAMPLE_COUNT];
-	SphericalHarmonics::InitSamples(samples);
-
-	int sceneCoeffCount = 0;
-	for (RenderCommand& command : MainCommands)
-	{
-
-		// Precache transforms
-		if (command.Triangles.size() == 0)
-		{
-			continue;
-		}
-
-		const eastl::shared_ptr<const DrawableObject> parent = command.Parent.lock();
-		glm::mat4 model = parent->GetModelMatrix();
-
-		if (!command.AccStructure.IsValid())
-		{
-			eastl::vector<PathTraceTriangle> transformedTriangles = command.Triangles;
-			for (PathTraceTriangle& triangle : transformedTriangles)
-			{
-				triangle.Transform(model);
-			}
-			command.AccStructure.Build(transformedTriangles);
-		}
-
-		// Each vertex has its own SH Probe and SH_COEFFICIENT_COUNT coefficients
-		command.TransferCoeffs.resize(command.Vertices.size() * SH_COEFFICIENT_COUNT);
-	}
-
-	for (RenderCommand& command : MainCommands)
-	{
-		//Ray ray;
-		//// Iterate over vertices
-		//for (int v = 0; v < vertex_count; v++)
-		//{
-		//	// Initialize SH coefficients to 0
-		//	for (int i = 0; i < transfer_coeff_count; i++)
-		//	{
-		//		transfer_coeffs[v * transfer_coeff_count + i] = glm::vec3(0.0f, 0.0f, 0.0f);
-		//	}
-
-		//	// Iterate over SH samples
-		//	for (int s = 0; s < SAMPLE_COUNT; s++)
-		//	{
-		//		float dot = glm::dot(mesh_data->vertices[v].normal, samples[s].direction);
-
-		//		// Only accept samples within the hemisphere defined by the Vertex normal
-		//		if (dot >= 0.0f)
-		//		{
-		//			ray.origin = mesh_data->vertices[v].position + mesh_data->vertices[v].normal * EPSILON;
-		//			ray.direction = samples[s].direction;
-
-		//			bool hit = scene.intersects(ray);
-		//			hits[v * SAMPLE_COUNT + s] = hit;
-
-		//			// If the Ray was not occluded
-		//			if (!hit)
-		//			{
-		//				switch (material.shader.type)
-		//				{
-		//					// For diffuse materials, compose the transfer vector.
-		//					// This vector includes the BDRF, incorporating the albedo colour, a lambertian diffuse factor (dot) and a SH sample
-		//				case MeshShader::Type::DIFFUSE:
-		//				{
-		//					for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
-		//					{
-		//						// Add the contribution of this sample
-		//						transfer_coeffs[v * SH_COEFFICIENT_COUNT + i] += material.albedo * dot * samples[s].coeffs[i];
-		//					}
-		//				} break;
-
-		//				//// For glossy materials, compose the transfer matrix.
-		//				//// This matrix does not include the BDRF, incorporating only two SH samples
-		//				//case MeshShader::Type::GLOSSY: {
-		//				//	for (int j = 0; j < SH_COEFFICIENT_COUNT; j++) {
-		//				//		for (int i = 0; i < SH_COEFFICIENT_COUNT; i++) {
-		//				//			// Add the contribution of this sample
-		//				//			transfer_coeffs[(v * SH_COEFFICIENT_COUNT + j) * SH_COEFFICIENT_COUNT + i] += samples[s].coeffs[j] * samples[s].coeffs[i];
-		//				//		}
-		//				//	}
-		//				//} break;
-		//				}
-		//			}
-		//		}
-		//		else
-		//		{
-		//			hits[v * SAMPLE_COUNT + s] = false;
-		//		}
-		//	}
-
-		//	const float normalization_factor = 4.0f * PI / SAMPLE_COUNT;
-
-		//	// Normalize coefficients
-		//	for (int i = 0; i < transfer_coeff_count; i++) {
-		//		transfer_coeffs[v * transfer_coeff_count + i] *= normalization_factor;
-		//	}
-		//}
-
-		PathTracingRay traceRay;
-		PathTracePayload payload;
-		glm::vec3 color;
-
-		for (int32_t v = 0; v < command.Vertices.size(); ++v)
-		{
-			const Vertex& vert = command.Vertices[v];
-			// For each vertex, evaluate all samples of its SH Sphere
-
-
-			for (int s = 0; s < SH_TOTAL_SAMPLE_COUNT; s++)
-			{
-				float dot = glm::dot(vert.Normal, samples[s].Direction);
-				// Proceed only with samples within the hemisphere defined by the Vertex Normal
-				// all other samples will be 0
-				if (dot >= 0.0f)
-				{
-					traceRay.Origin = vert.Position + vert.Normal * 0.001f;
-					traceRay.Direction = samples[s].Direction;
-
-					bool hit = TriangleTrace(traceRay, payload, color);
-
-					// If the Ray was not occluded
-					if (!hit)
-					{
-						// For diffuse materials, compose the transfer vector.
-						// This vector includes the BDRF, incorporating the albedo colour, a lambertian diffuse factor (dot) and a SH sample
-						for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
-						{
-							// Add the contribution of this sample
-							//transfer_coeffs[v * SH_COEFFICIENT_COUNT + i] += material.albedo * dot * samples[s].coeffs[i];
-							command.TransferCoeffs[v * SH_COEFFICIENT_COUNT + i] += color * dot * samples[s].Coeffs[i];
-						}
-					}
-				}
-			}
-
-			// Probability to sample any point on the surface of the unit sphere is the same for all samples,
-			// meaning that the weighting function is 1/surface area of unit sphere which is 4*PI => probability function p(x) is 1/(4*PI).
-			// => The constant weighting function which we need to multiply our Coeffs by is 1 / p(x) = 4 * PI
-			
-			// Monte Carlo sampling means that we need to normalize all coefficients by N
-			// => normalization factor of (4 * PI) / N multiplied with the Sum of samples.
-
-			const float normalization_factor = 4.0f * PI / SH_TOTAL_SAMPLE_COUNT;
-
-			// Normalize coefficients
-			for (int i = 0; i < SH_COEFFICIENT_COUNT; i++) {
-				command.TransferCoeffs[v * SH_COEFFICIENT_COUNT + i] *= normalization_factor;
-			}
-		}
-
-
-
-
-
-	}
-
-
-
-
-
-
+	const SHSampleSetPtr<GI_SH_BANDS> samples = SHSampleSets::Get<GI_SH_BANDS>(SHSampleSetSettings());
+
+	// Visibility rays leaking through shared edges show up as light bleeding in the transfer coefficients
+	BVHBuildSettings settings;
+	settings.TriangleTest.Intersection = ETriangleIntersection::Watertight;
+	// Traced once per SH sample per vertex, long thin triangles would otherwise make every one of those rays expensive
+	settings.Strategy = EBVHBuildStrategy::SpatialSAH;
+	// Same scene every launch, the spatial split build is the slowest part of startup
+	settings.bUseDiskCache = true;
+	BuildSceneAccStructure(MainCommands, settings, SceneAccStructure);
+
+	SHTransferCache::LoadOrBakeCommands(SceneAccStructure, *samples, ESHTransferType::ShadowedDiffuse, MainCommands);
 }
 
 static bool bBVHDebugDraw = false;
@@ -844,7 +685,7 @@ void DeferredRenderer::DrawCommand(const RenderCommand& inCommand)
 	//	//DrawDebugHelpers::DrawDebugPoint(center, 0.1f);
 
 
-	//	nonConstCommand.AccStructure.Root->DebugDraw();
+	//	nonConstCommand.AccStructure.DebugDraw();
 	//}
 
 	// Path Tracing Debug
@@ -63,6 +63,8 @@ private:
 	EDrawMode::Type CurrentDrawMode = EDrawMode::Default;
 	eastl::unordered_map<eastl::string, eastl::shared_ptr<class MeshDataContainer>> RenderDataContainerMap;
 
+	// Built over the object space BVHs of MainCommands for the GI bake
+	TLAS SceneAccStructure;
 
 	friend Renderer;
 };
@@ -37,6 +37,9 @@
 #include "Math/SphericalHarmonics.h"
 #include "Math/MathUtils.h"
 #include "Math/SphericalHarmonicsRotation.h"
+#include "Math/SHSampleSets.h"
+#include "Renderer/SHTransferBake.h"
+#include "Renderer/SHTransferCache.h"
 
 eastl::shared_ptr<RHIFrameBuffer> GlobalFrameBuffer = nullptr;
 eastl::shared_ptr<RHITexture2D> GlobalRenderTexture = nullptr;
@@ -74,70 +77,35 @@ void ForwardRenderer::InitInternal()
 
 bool ForwardRenderer::TriangleTrace(const PathTracingRay& inRay, PathTracePayload& outPayload, glm::vec3& outColor)
 {
-	bool bHit = false;
-	for (const RenderCommand& command : MainCommands)
+	if (!SceneAccStructure.Trace(inRay, outPayload))
 	{
-		if (command.Triangles.size() == 0)
-		{
-			continue;
-		}
-
-		PathTracePayload currMeshPayload;
-		if (command.AccStructure.Trace(inRay, currMeshPayload))
-		{
-			bHit = true;
-			if (currMeshPayload.Distance < outPayload.Distance)
-			{
-				outPayload = currMeshPayload;
-				outColor = command.OverrideColor;
-			}
-		}
+		return false;
 	}
 
-	return bHit;
+	const BVHInstance& instance = SceneAccStructure.Instances[outPayload.InstanceIndex];
+	outColor = MainCommands[instance.UserIndex].OverrideColor;
+
+	return true;
 }
 
 static eastl::vector<glm::vec4> lightCoeffs;
 void ForwardRenderer::InitGI()
 {
-	SHSample* samples = new SHSample[SH_TOTAL_SAMPLE_COUNT];
-
 	LOG_INFO("Initializing SH Samples");
 
-	SphericalHarmonics::InitSamples(samples);
+	// Shared with any other renderer baking in this run, and identical from one run to the next
+	const SHSampleSetPtr<GI_SH_BANDS> sampleSet = SHSampleSets::Get<GI_SH_BANDS>(SHSampleSetSettings());
+	const eastl::vector<SHSample<GI_SH_BANDS>>& samples = *sampleSet;
 
 	LOG_INFO("Building BVH");
 
-	int sceneCoeffCount = 0;
-	for (RenderCommand& command : MainCommands)
-	{
-
-		// Precache transforms
-		if (command.Triangles.size() == 0)
-		{
-			continue;
-		}
-
-		const eastl::shared_ptr<const DrawableObject> parent = command.Parent.lock();
-		glm::mat4 model = parent->GetModelMatrix();
-
-		if (!command.AccStructure.IsValid())
-		{
-			eastl::vector<PathTraceTriangle> transformedTriangles = command.Triangles;
-			//for (PathTraceTriangle& triangle : transformedTriangles)
-			//{
-			//	triangle.Transform(model);
-			//}
-			command.AccStructure.Build(transformedTriangles);
-		}
-
-		// Each vertex has its own SH Probe and SH_COEFFICIENT_COUNT coefficients
-		command.TransferCoeffs.resize(command.Vertices.size() * SH_COEFFICIENT_COUNT);
-		for (glm::vec3& coeff : command.TransferCoeffs)
-		{
-			coeff = glm::vec3(0.f, 0.f, 0.f);
-		}
-	}
+	// Bake visibility must not slip between triangles
+	BVHBuildSettings settings;
+	settings.TriangleTest.Intersection = ETriangleIntersection::Watertight;
+	// Built once and traced for every sample of every vertex, so the slower spatial split build pays off
+	settings.Strategy = EBVHBuildStrategy::SpatialSAH;
+	settings.bUseDiskCache = true;
+	BuildSceneAccStructure(MainCommands, settings, SceneAccStructure);
 
 #ifdef _DEBUG
 	LOG_INFO("Tracing.. This is a lot faster in Release");
@@ -145,70 +113,13 @@ void ForwardRenderer::InitGI()
 	LOG_INFO("Tracing..");
 #endif // _DEBUG
 
+	SHTransferCache::LoadOrBakeCommands(SceneAccStructure, samples, ESHTransferType::Shadowed, MainCommands);
 
 	for (RenderCommand& command : MainCommands)
 	{
-		PathTracingRay traceRay;
-		PathTracePayload payload;
-		glm::vec3 color;
-
-		command.CoeffsBuffer = RHI::Get()->CreateTextureBuffer(command.Vertices.size() * SH_COEFFICIENT_COUNT * sizeof(glm::vec3));
-
-		for (int32_t v = 0; v < command.Vertices.size(); ++v)
-		{
-			const Vertex& vert = command.Vertices[v];
-			// For each vertex, evaluate all samples of its SH Sphere
-
-			int32_t nrTraces = 0;
-			for (int s = 0; s < SH_TOTAL_SAMPLE_COUNT; s++)
-			{
-				float dot = glm::dot(vert.Normal, samples[s].Direction);
-				// Proceed only with samples within the hemisphere defined by the Vertex Normal
-				// all other samples will be 0
-				if (dot >= 0.0f)
-				{
-					++nrTraces;
-
-					traceRay.Origin = vert.Position + (vert.Normal * 0.001f);
-					traceRay.Direction = samples[s].Direction;
-
-					const bool hit = TriangleTrace(traceRay, payload, color);
-
-					// If the Ray was not occluded
-					if (!hit)
-					{
-						// For diffuse materials, compose the transfer vector.
-						// This vector includes the BDRF, incorporating the albedo colour, a lambertian diffuse factor (dot) and a SH sample
-						for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
-						{
-							// Add the contribution of this sample
-							//command.TransferCoeffs[v * SH_COEFFICIENT_COUNT + i] += command.OverrideColor * dot * samples[s].Coeffs[i];
-							command.TransferCoeffs[v * SH_COEFFICIENT_COUNT + i] += glm::vec3(1.f, 1.f, 1.f) * samples[s].Coeffs[i];
-						}
-						//command.TransferCoeffs[v * SH_COEFFICIENT_COUNT] += glm::vec3(1.f, 1.f, 1.f);
-					}
-				}
-			}
-			//command.TransferCoeffs[v * SH_COEFFICIENT_COUNT] /= float(nrTraces * 10);
-
-
-			// Probability to sample any point on the surface of the unit sphere is the same for all samples,
-			// meaning that the weighting function is 1/surface area of unit sphere which is 4*PI => probability function p(x) is 1/(4*PI).
-			// => The constant weighting function which we need to multiply our Coeffs by is 1 / p(x) = 4 * PI
-
-			// Monte Carlo sampling means that we need to normalize all coefficients by N
-			// => normalization factor of (4 * PI) / N multiplied with the Sum of samples.
-
-			const float normalization_factor = 4.0f * PI / SH_TOTAL_SAMPLE_COUNT;
-
-			//Normalize coefficients
-			for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
-			{
-				command.TransferCoeffs[v * SH_COEFFICIENT_COUNT + i] *= normalization_factor;
-			}
-		}
+		command.CoeffsBuffer = RHI::Get()->CreateTextureBuffer(command.Vertices.size() * SHCoefficientsCount(GI_SH_BANDS) * sizeof(glm::vec3));
 
-		ASSERT(command.TransferCoeffs.size() == command.Vertices.size() * SH_COEFFICIENT_COUNT);
+		ASSERT(command.TransferCoeffs.size() == command.Vertices.size() * SHCoefficientsCount(GI_SH_BANDS));
 		const size_t finalSize = command.TransferCoeffs.size() * sizeof(glm::vec3);
 		RHI::Get()->UploadDataToBuffer(*command.CoeffsBuffer, &command.TransferCoeffs[0], finalSize);
 	}
@@ -216,15 +127,15 @@ void ForwardRenderer::InitGI()
 
 	// Light Coefficients
 	{
-		lightCoeffs.resize(SH_COEFFICIENT_COUNT);
+		lightCoeffs.resize(SHCoefficientsCount(GI_SH_BANDS));
 		// For each sample
-		for (int s = 0; s < SH_TOTAL_SAMPLE_COUNT; s++)
+		for (size_t s = 0; s < samples.size(); s++)
 		{
 			const float theta = samples[s].Theta;
 			const float phi = samples[s].Phi;
 
 			// For each SH coefficient
-			for (int n = 0; n < SH_COEFFICIENT_COUNT; n++)
+			for (int n = 0; n < SHCoefficientsCount(GI_SH_BANDS); n++)
 			{
 				// The reason this works is kind of a happy mistake. Normally, theta would be the angle, starting from the top but because the formulas
 				// to get cartesian from spherical here is based on a coordinate base that has Z as up, theta here is based on Z which points towards the screen
@@ -240,9 +151,9 @@ void ForwardRenderer::InitGI()
 		// Weighed by the area of a 3D unit sphere
 		const float weight = 4.0f * PI;
 		// Divide the result by weight and number of samples
-		const float factor = weight / SH_TOTAL_SAMPLE_COUNT;
+		const float factor = weight / samples.size();
 
-		for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		for (int i = 0; i < SHCoefficientsCount(GI_SH_BANDS); i++)
 		{
 			lightCoeffs[i] *= factor;
 		}
@@ -375,7 +286,7 @@ void ForwardRenderer::SetLightingConstants()
 
 	const glm::quat rotation = glm::quat(glm::radians(lightRot));
 	eastl::vector<glm::vec4> rotatedLightCoeffs;
-	SphericalHarmonicsRotation::Rotate(rotation, lightCoeffs, rotatedLightCoeffs);
+	SphericalHarmonicsRotation::Rotate<GI_SH_BANDS>(rotation, lightCoeffs, rotatedLightCoeffs);
 	UniformsCache["LightCoeffs"] = rotatedLightCoeffs;
 }
 
@@ -503,7 +414,7 @@ void ForwardRenderer::DrawCommand(const RenderCommand& inCommand)
 
 				nonConstCommand.AccStructure.Build(nonConstCommand.Triangles);
 			}
-			nonConstCommand.AccStructure.Root->DebugDraw();
+			nonConstCommand.AccStructure.DebugDraw();
 		}
 	}
 
@@ -88,6 +88,9 @@ private:
 
 	eastl::vector<float> shadowCascadeFarPlanes = { CAMERA_FAR / 10.0f, CAMERA_FAR / 2.0f, CAMERA_FAR };
 
+	// Built over the object space BVHs of MainCommands for the GI bake
+	TLAS SceneAccStructure;
+
 	friend class Renderer;
 
 };
@@ -8,9 +8,7 @@
 
 RenderMaterial_SphereHarmonicsDebug::RenderMaterial_SphereHarmonicsDebug()
 {
-	Samples = new SHSample[SH_TOTAL_SAMPLE_COUNT];
-
-	SphericalHarmonics::InitSamples(Samples);
+	Samples = SHSampleSets::Get<GI_SH_BANDS>(SHSampleSetSettings());
 };
 RenderMaterial_SphereHarmonicsDebug::~RenderMaterial_SphereHarmonicsDebug() = default;
 
@@ -1,7 +1,9 @@
 #pragma once
 #include "EASTL/vector.h"
 #include "EASTL/string.h"
+#include "Math/SHSampleSets.h"
 #include "Renderer/Material/RenderMaterial.h"
+#include "Renderer/ShaderTypes.h"
 
 class RenderMaterial_SphereHarmonicsDebug : public RenderMaterial
 {
@@ -13,5 +15,5 @@ public:
 	virtual void SetUniformsValue(eastl::unordered_map<eastl::string, struct SelfRegisteringUniform>& inUniformsCache, const EShaderType inShaderTypes = Sh_Universal) override;
 
 private:
-	struct SHSample* Samples = nullptr;
+	SHSampleSetPtr<GI_SH_BANDS> Samples;
 };
\ No newline at end of file
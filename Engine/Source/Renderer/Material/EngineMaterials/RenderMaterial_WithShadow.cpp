@@ -5,6 +5,7 @@
 #include "Renderer/RHI/RHI.h"
 
 #include "Math/SphericalHarmonics.h"
+#include "Renderer/ShaderTypes.h"
 
 RenderMaterial_WithShadow::RenderMaterial_WithShadow() = default;
 RenderMaterial_WithShadow::~RenderMaterial_WithShadow() = default;
@@ -27,7 +28,7 @@ void RenderMaterial_WithShadow::SetRequiredUniforms()
 // 
 
 	eastl::vector<UniformWithFlag> GIUniforms = {
-	{"LightCoeffs", SH_COEFFICIENT_COUNT},
+	{"LightCoeffs", SHCoefficientsCount(GI_SH_BANDS)},
 	};
 
 	UBuffers.push_back({ GIUniforms, EShaderType::Sh_Vertex });
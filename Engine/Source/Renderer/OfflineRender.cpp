@@ -0,0 +1,378 @@
+#include "OfflineRender.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include "assimp/Importer.hpp"
+#include "assimp/scene.h"
+#include "assimp/postprocess.h"
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "glm/matrix.hpp"
+#include "EASTL/unique_ptr.h"
+#include "Logger/Logger.h"
+#include "Math/BVH.h"
+#include "Math/TLAS.h"
+#include "Utils/ImageWriting.h"
+#include "Utils/ThreadPool.h"
+
+#define OFFLINE_RENDER_NEAR 0.1f
+#define OFFLINE_RENDER_FAR 1000.f
+
+// Progress is logged this many times over the render
+#define OFFLINE_RENDER_PROGRESS_STEPS 10
+
+static bool ParseVec3(const int32_t inArgc, char** inArgv, int32_t& inOutIndex, OUT glm::vec3& outValue)
+{
+	if (inOutIndex + 3 >= inArgc)
+	{
+		return false;
+	}
+
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		outValue[i] = static_cast<float>(atof(inArgv[++inOutIndex]));
+	}
+
+	return true;
+}
+
+static bool ParseUint(const int32_t inArgc, char** inArgv, int32_t& inOutIndex, OUT uint32_t& outValue)
+{
+	if (inOutIndex + 1 >= inArgc)
+	{
+		return false;
+	}
+
+	outValue = static_cast<uint32_t>(strtoul(inArgv[++inOutIndex], nullptr, 10));
+
+	return true;
+}
+
+void OfflineRender::PrintUsage()
+{
+	LOG_INFO("Offline render: --offline --model <path> [--color r g b] [--model ...] [--size <width> <height>] [--spp <samples>] [--threads <count>] "
+		"[--camera x y z] [--target x y z] [--fov <degrees>] [--light x y z] [--sampler random|stratified|sobol] [--tile <size>] "
+		"[--wavefront] [--no-packets] [--out <path without extension>]");
+}
+
+bool OfflineRender::ParseCommandLine(const int32_t inArgc, char** inArgv, OUT OfflineRenderSettings& outSettings)
+{
+	bool bOffline = false;
+	for (int32_t i = 1; i < inArgc; ++i)
+	{
+		bOffline |= strcmp(inArgv[i], "--offline") == 0;
+	}
+
+	if (!bOffline)
+	{
+		return false;
+	}
+
+	for (int32_t i = 1; i < inArgc; ++i)
+	{
+		const char* argument = inArgv[i];
+		bool bValid = true;
+
+		if (strcmp(argument, "--offline") == 0)
+		{
+			continue;
+		}
+		else if (strcmp(argument, "--model") == 0 && i + 1 < inArgc)
+		{
+			OfflineRenderModel model;
+			model.Path = inArgv[++i];
+			outSettings.Models.push_back(model);
+		}
+		else if (strcmp(argument, "--color") == 0)
+		{
+			// Applies to the model given last
+			bValid = !outSettings.Models.empty() && ParseVec3(inArgc, inArgv, i, outSettings.Models.back().Color);
+		}
+		else if (strcmp(argument, "--size") == 0)
+		{
+			bValid = ParseUint(inArgc, inArgv, i, outSettings.Width) && ParseUint(inArgc, inArgv, i, outSettings.Height);
+		}
+		else if (strcmp(argument, "--spp") == 0)
+		{
+			bValid = ParseUint(inArgc, inArgv, i, outSettings.SamplesPerPixel);
+		}
+		else if (strcmp(argument, "--threads") == 0)
+		{
+			bValid = ParseUint(inArgc, inArgv, i, outSettings.ThreadsCount);
+		}
+		else if (strcmp(argument, "--camera") == 0)
+		{
+			bValid = ParseVec3(inArgc, inArgv, i, outSettings.CameraPosition);
+		}
+		else if (strcmp(argument, "--target") == 0)
+		{
+			bValid = ParseVec3(inArgc, inArgv, i, outSettings.CameraTarget);
+		}
+		else if (strcmp(argument, "--fov") == 0 && i + 1 < inArgc)
+		{
+			outSettings.FieldOfView = static_cast<float>(atof(inArgv[++i]));
+		}
+		else if (strcmp(argument, "--light") == 0)
+		{
+			bValid = ParseVec3(inArgc, inArgv, i, outSettings.LightDirection);
+		}
+		else if (strcmp(argument, "--sampler") == 0 && i + 1 < inArgc)
+		{
+			const char* samplerName = inArgv[++i];
+			if (strcmp(samplerName, "random") == 0)
+			{
+				outSettings.IntegratorSettings.SamplerType = ESamplerType::Random;
+			}
+			else if (strcmp(samplerName, "stratified") == 0)
+			{
+				outSettings.IntegratorSettings.SamplerType = ESamplerType::Stratified;
+			}
+			else if (strcmp(samplerName, "sobol") == 0)
+			{
+				outSettings.IntegratorSettings.SamplerType = ESamplerType::Sobol;
+			}
+			else
+			{
+				bValid = false;
+			}
+		}
+		else if (strcmp(argument, "--tile") == 0)
+		{
+			uint32_t tileSize = 0;
+			bValid = ParseUint(inArgc, inArgv, i, tileSize) && tileSize > 0;
+			outSettings.IntegratorSettings.TileSize = static_cast<int32_t>(tileSize);
+		}
+		else if (strcmp(argument, "--wavefront") == 0)
+		{
+			outSettings.IntegratorSettings.bUseWavefront = true;
+		}
+		else if (strcmp(argument, "--no-packets") == 0)
+		{
+			outSettings.IntegratorSettings.bUsePacketCameraRays = false;
+			outSettings.IntegratorSettings.bUsePacketWavefrontRays = false;
+		}
+		else if (strcmp(argument, "--out") == 0 && i + 1 < inArgc)
+		{
+			outSettings.OutputPath = inArgv[++i];
+		}
+		else
+		{
+			bValid = false;
+		}
+
+		if (!bValid)
+		{
+			LOG_WARNING("Offline render: ignoring invalid argument %s.", argument);
+		}
+	}
+
+	return true;
+}
+
+// Meshes of all the models, every mesh is built once no matter how many nodes reference it
+struct OfflineScene
+{
+	eastl::vector<eastl::unique_ptr<BVH>> Meshes;
+	eastl::vector<BVHInstance> Instances;
+	eastl::vector<glm::vec3> InstanceColors;
+};
+
+static void AddNodeInstances(const aiNode& inNode, const glm::mat4& inParentTransform, const uint32_t inFirstMesh, const glm::vec3& inColor,
+	OfflineScene& inOutScene)
+{
+	// Assimp matrices are row major
+	const glm::mat4 nodeTransform = inParentTransform * glm::transpose(glm::make_mat4(&inNode.mTransformation.a1));
+
+	for (uint32_t i = 0; i < inNode.mNumMeshes; ++i)
+	{
+		const BVH* mesh = inOutScene.Meshes[inFirstMesh + inNode.mMeshes[i]].get();
+		if (!mesh->IsValid())
+		{
+			continue;
+		}
+
+		const uint32_t userIndex = static_cast<uint32_t>(inOutScene.InstanceColors.size());
+		inOutScene.Instances.push_back(BVHInstance(mesh, nodeTransform, userIndex));
+		inOutScene.InstanceColors.push_back(inColor);
+	}
+
+	for (uint32_t i = 0; i < inNode.mNumChildren; ++i)
+	{
+		AddNodeInstances(*inNode.mChildren[i], nodeTransform, inFirstMesh, inColor, inOutScene);
+	}
+}
+
+static bool LoadModel(const OfflineRenderModel& inModel, const BVHBuildSettings& inBuildSettings, OfflineScene& inOutScene)
+{
+	Assimp::Importer modelImporter;
+
+	const aiScene* scene = modelImporter.ReadFile(inModel.Path.c_str(), aiProcess_Triangulate);
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+	{
+		LOG_ERROR("Unable to load model from path %s", inModel.Path.c_str());
+
+		return false;
+	}
+
+	const uint32_t firstMesh = static_cast<uint32_t>(inOutScene.Meshes.size());
+
+	for (uint32_t i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh& mesh = *scene->mMeshes[i];
+
+		eastl::vector<PathTraceTriangle> triangles;
+		triangles.reserve(mesh.mNumFaces);
+
+		for (uint32_t j = 0; j < mesh.mNumFaces; ++j)
+		{
+			const aiFace& face = mesh.mFaces[j];
+
+			// Points and lines left over after triangulation
+			if (face.mNumIndices != 3)
+			{
+				continue;
+			}
+
+			glm::vec3 v[3];
+			for (int32_t k = 0; k < 3; ++k)
+			{
+				const aiVector3D& aiVertex = mesh.mVertices[face.mIndices[k]];
+				v[k] = glm::vec3(aiVertex.x, aiVertex.y, aiVertex.z);
+			}
+
+			triangles.push_back(PathTraceTriangle(v));
+		}
+
+		eastl::unique_ptr<BVH> structure = eastl::make_unique<BVH>();
+		if (triangles.size() > 0)
+		{
+			structure->Build(triangles, inBuildSettings);
+		}
+
+		inOutScene.Meshes.push_back(std::move(structure));
+	}
+
+	AddNodeInstances(*scene->mRootNode, glm::mat4(1.f), firstMesh, inModel.Color, inOutScene);
+
+	return true;
+}
+
+bool OfflineRender::Run(const OfflineRenderSettings& inSettings)
+{
+	using Clock = std::chrono::steady_clock;
+
+	if (inSettings.Models.empty() || inSettings.Width == 0 || inSettings.Height == 0 || inSettings.SamplesPerPixel == 0)
+	{
+		PrintUsage();
+
+		return false;
+	}
+
+	const Clock::time_point loadStart = Clock::now();
+
+	BVHBuildSettings buildSettings;
+	buildSettings.bUseDiskCache = true;
+
+	OfflineScene scene;
+	for (const OfflineRenderModel& model : inSettings.Models)
+	{
+		// A render missing part of the scene is worse than no render, the farm would not notice
+		if (!LoadModel(model, buildSettings, scene))
+		{
+			return false;
+		}
+	}
+
+	if (scene.Instances.empty())
+	{
+		LOG_ERROR("Offline render: nothing to render.");
+
+		return false;
+	}
+
+	const uint32_t instancesCount = static_cast<uint32_t>(scene.Instances.size());
+
+	TLAS sceneAccStructure;
+	sceneAccStructure.Build(std::move(scene.Instances));
+
+	const double loadSeconds = std::chrono::duration<double>(Clock::now() - loadStart).count();
+	LOG_INFO("Offline render: %u instances ready in %.2f s.", instancesCount, loadSeconds);
+
+	const float aspectRatio = float(inSettings.Width) / float(inSettings.Height);
+	const glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(inSettings.FieldOfView), aspectRatio, OFFLINE_RENDER_NEAR, OFFLINE_RENDER_FAR);
+	const glm::mat4 view = glm::lookAtRH(inSettings.CameraPosition, inSettings.CameraTarget, glm::vec3(0.f, 1.f, 0.f));
+
+	PathTraceView traceView;
+	traceView.Width = inSettings.Width;
+	traceView.Height = inSettings.Height;
+	traceView.InvProjection = glm::inverse(projection);
+	traceView.InvView = glm::inverse(view);
+	traceView.CameraPosition = inSettings.CameraPosition;
+
+	PathTraceIntegrator integrator;
+	integrator.Settings = inSettings.IntegratorSettings;
+	integrator.Scene = &sceneAccStructure;
+	integrator.InstanceColors = std::move(scene.InstanceColors);
+	integrator.LightDirection = glm::normalize(inSettings.LightDirection);
+	integrator.Reset(inSettings.Width, inSettings.Height);
+
+	ThreadPool pool(inSettings.ThreadsCount);
+
+	LOG_INFO("Offline render: %ux%u, %u samples per pixel on %u threads.", inSettings.Width, inSettings.Height, inSettings.SamplesPerPixel,
+		pool.GetThreadsCount());
+
+	const Clock::time_point renderStart = Clock::now();
+	uint32_t progressStep = 0;
+
+	for (uint32_t i = 0; i < inSettings.SamplesPerPixel; ++i)
+	{
+		integrator.RenderSample(traceView, i, pool);
+
+		const uint32_t newProgressStep = (i + 1) * OFFLINE_RENDER_PROGRESS_STEPS / inSettings.SamplesPerPixel;
+		if (newProgressStep != progressStep)
+		{
+			progressStep = newProgressStep;
+
+			const double seconds = std::chrono::duration<double>(Clock::now() - renderStart).count();
+			LOG_INFO("Offline render: %u/%u samples, %.2f s.", i + 1, inSettings.SamplesPerPixel, seconds);
+		}
+	}
+
+	const double renderSeconds = glm::max(std::chrono::duration<double>(Clock::now() - renderStart).count(), 1e-6);
+	const double pixelsCount = double(inSettings.Width) * double(inSettings.Height);
+
+	LOG_INFO("Offline render: done in %.2f s, %.2f samples/s per pixel, %.2f MSamples/s, %.2f MRays/s.", renderSeconds,
+		double(inSettings.SamplesPerPixel) / renderSeconds,
+		pixelsCount * double(inSettings.SamplesPerPixel) / renderSeconds * 1e-6,
+		double(integrator.GetRaysCount()) / renderSeconds * 1e-6);
+
+	// The integrator's first row is the bottom of the image, files want the top one first.
+	// The PFM keeps the linear radiance, the PNG gets it gamma encoded
+	eastl::vector<glm::vec4> pixels;
+	eastl::vector<glm::vec4> encodedPixels;
+	pixels.resize(inSettings.Width * inSettings.Height);
+	encodedPixels.resize(inSettings.Width * inSettings.Height);
+	for (uint32_t y = 0; y < inSettings.Height; ++y)
+	{
+		const uint32_t sourceRow = (inSettings.Height - 1 - y) * inSettings.Width;
+		for (uint32_t x = 0; x < inSettings.Width; ++x)
+		{
+			pixels[y * inSettings.Width + x] = integrator.GetPixel(sourceRow + x);
+			encodedPixels[y * inSettings.Width + x] = PathTraceIntegrator::EncodeGamma(pixels[y * inSettings.Width + x]);
+		}
+	}
+
+	const eastl::string pfmPath = inSettings.OutputPath + ".pfm";
+	const eastl::string pngPath = inSettings.OutputPath + ".png";
+
+	bool bWritten = ImageWriting::WritePFM(pfmPath.c_str(), pixels.data(), inSettings.Width, inSettings.Height);
+	bWritten &= ImageWriting::WritePNG(pngPath.c_str(), encodedPixels.data(), inSettings.Width, inSettings.Height);
+
+	if (bWritten)
+	{
+		LOG_INFO("Offline render: written %s and %s.", pfmPath.c_str(), pngPath.c_str());
+	}
+
+	return bWritten;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include "glm/ext/vector_float3.hpp"
+#include "Core/EngineUtils.h"
+#include "EASTL/string.h"
+#include "EASTL/vector.h"
+#include "Renderer/PathTraceIntegrator.h"
+
+struct OfflineRenderModel
+{
+	eastl::string Path;
+	glm::vec3 Color = glm::vec3(0.8f, 0.8f, 0.8f);
+};
+
+struct OfflineRenderSettings
+{
+	eastl::vector<OfflineRenderModel> Models;
+
+	uint32_t Width = 1280;
+	uint32_t Height = 720;
+	uint32_t SamplesPerPixel = 64;
+
+	// 0 uses every hardware thread
+	uint32_t ThreadsCount = 0;
+
+	PathTraceIntegratorSettings IntegratorSettings;
+
+	glm::vec3 CameraPosition = glm::vec3(0.f, 1.f, 10.f);
+	glm::vec3 CameraTarget = glm::vec3(0.f, 0.f, 0.f);
+	// Vertical, in degrees
+	float FieldOfView = 45.f;
+
+	// Direction the light travels in, same as the directional light of the window
+	glm::vec3 LightDirection = glm::vec3(0.f, -1.f, 0.f);
+
+	// Without extension, the linear <OutputPath>.pfm and the gamma encoded <OutputPath>.png are written
+	eastl::string OutputPath = "OfflineRender";
+};
+
+// Path traces a scene straight to image files, without a window, the RHI or the engine's scene.
+// Only depends on the integrator and the acceleration structures, so it can run on render farm machines
+namespace OfflineRender
+{
+	// True if the command line asks for an offline render, --offline followed by its options, see PrintUsage
+	bool ParseCommandLine(const int32_t inArgc, char** inArgv, OUT OfflineRenderSettings& outSettings);
+	void PrintUsage();
+
+	// Returns false if any model could not be loaded or the images could not be written
+	bool Run(const OfflineRenderSettings& inSettings);
+}
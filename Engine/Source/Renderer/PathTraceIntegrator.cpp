@@ -0,0 +1,572 @@
+#include "Renderer/PathTraceIntegrator.h"
+#include <float.h>
+#include "glm/common.hpp"
+#include "glm/exponential.hpp"
+#include "glm/geometric.hpp"
+#include "EASTL/algorithm.h"
+#include "EASTL/sort.h"
+#include "Math/RayPacket.h"
+#include "Utils/CPUFeatures.h"
+#include "Utils/ThreadPool.h"
+
+// Paths in flight at once in wavefront mode, finished ones are replaced by paths of the next pixels
+#define WAVEFRONT_MAX_PATHS (1 << 18)
+
+// Paths handed to a thread at once by each wavefront pass
+#define WAVEFRONT_CHUNK_SIZE 256
+
+static bool near_zero(glm::vec3 inVec) {
+	// Return true if the vector is close to zero in all dimensions.
+	auto s = 1e-8;
+	return (fabs(inVec.x) < s) && (fabs(inVec.y) < s) && (fabs(inVec.z) < s);
+}
+
+// Runs inFunction(index) over [0, inCount) on the pool in chunks, per path work is too small to be a task on its own
+template<typename FunctionType>
+static void ParallelForChunks(ThreadPool& inPool, const uint32_t inCount, const FunctionType& inFunction)
+{
+	const uint32_t chunksCount = (inCount + WAVEFRONT_CHUNK_SIZE - 1) / WAVEFRONT_CHUNK_SIZE;
+	inPool.ParallelFor(chunksCount, [inCount, &inFunction](const uint32_t inChunkIndex)
+	{
+		const uint32_t chunkEnd = glm::min((inChunkIndex + 1) * WAVEFRONT_CHUNK_SIZE, inCount);
+		for (uint32_t i = inChunkIndex * WAVEFRONT_CHUNK_SIZE; i < chunkEnd; ++i)
+		{
+			inFunction(i);
+		}
+	});
+}
+
+// Spreads the low 9 bits of inValue so that two zero bits follow each one
+static inline uint32_t ExpandBits9(uint32_t inValue)
+{
+	inValue = (inValue * 0x00010001u) & 0xFF0000FFu;
+	inValue = (inValue * 0x00000101u) & 0x0F00F00Fu;
+	inValue = (inValue * 0x00000011u) & 0xC30C30C3u;
+	inValue = (inValue * 0x00000005u) & 0x49249249u;
+
+	return inValue;
+}
+
+// Signs of the direction components, rays of the same octant share the traversal order of every node
+static inline uint32_t GetRayOctant(const PathTracingRay& inRay)
+{
+	return static_cast<uint32_t>(inRay.DirIsNegative[0] | (inRay.DirIsNegative[1] << 1) | (inRay.DirIsNegative[2] << 2));
+}
+
+// Rays heading the same way from nearby origins visit the same nodes. Direction octant first, then the origin along a Morton curve
+static uint32_t GetRaySortKey(const PathTracingRay& inRay, const glm::vec3& inSceneMin, const glm::vec3& inSceneInvExtent)
+{
+	const uint32_t octant = GetRayOctant(inRay);
+	const glm::vec3 cell = glm::clamp((inRay.Origin - inSceneMin) * inSceneInvExtent, 0.f, 1.f) * 511.f;
+
+	const uint32_t morton = (ExpandBits9(static_cast<uint32_t>(cell.x)) << 2) | (ExpandBits9(static_cast<uint32_t>(cell.y)) << 1) | ExpandBits9(static_cast<uint32_t>(cell.z));
+
+	return (octant << 27) | morton;
+}
+
+// Position of a cell along the Hilbert curve filling a inGridSize x inGridSize grid, inGridSize is a power of two
+static uint32_t GetHilbertIndex(const uint32_t inGridSize, uint32_t inX, uint32_t inY)
+{
+	uint32_t index = 0;
+	for (uint32_t half = inGridSize / 2; half > 0; half /= 2)
+	{
+		const uint32_t rx = (inX & half) > 0 ? 1 : 0;
+		const uint32_t ry = (inY & half) > 0 ? 1 : 0;
+		index += half * half * ((3 * rx) ^ ry);
+
+		// Rotate the quadrant so the curve stays continuous
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				inX = half - 1 - (inX & (half - 1));
+				inY = half - 1 - (inY & (half - 1));
+			}
+
+			eastl::swap(inX, inY);
+		}
+	}
+
+	return index;
+}
+
+void PathTraceIntegrator::Reset(const uint32_t inWidth, const uint32_t inHeight)
+{
+	if (inWidth != Width || inHeight != Height)
+	{
+		Width = inWidth;
+		Height = inHeight;
+		Tiles.clear();
+	}
+
+	Accumulation.assign(static_cast<size_t>(Width) * Height, glm::vec4(0.f, 0.f, 0.f, 0.f));
+	SamplesCount = 0;
+	RaysCount.store(0, std::memory_order_relaxed);
+}
+
+// Consecutive tiles along a Hilbert curve are always neighbours, so the contiguous runs of tiles each thread gets
+// cover compact areas of the image and its rays keep hitting the same BVH nodes
+void PathTraceIntegrator::BuildTiles()
+{
+	const uint32_t tileSize = static_cast<uint32_t>(glm::max(Settings.TileSize, 1));
+	const uint32_t tilesX = (Width + tileSize - 1) / tileSize;
+	const uint32_t tilesY = (Height + tileSize - 1) / tileSize;
+
+	uint32_t gridSize = 1;
+	while (gridSize < tilesX || gridSize < tilesY)
+	{
+		gridSize *= 2;
+	}
+
+	eastl::vector<eastl::pair<uint32_t, glm::uvec2>> sortedTiles;
+	sortedTiles.reserve(tilesX * tilesY);
+	for (uint32_t y = 0; y < tilesY; ++y)
+	{
+		for (uint32_t x = 0; x < tilesX; ++x)
+		{
+			sortedTiles.push_back({ GetHilbertIndex(gridSize, x, y), glm::uvec2(x * tileSize, y * tileSize) });
+		}
+	}
+
+	eastl::sort(sortedTiles.begin(), sortedTiles.end(), [](const eastl::pair<uint32_t, glm::uvec2>& inA, const eastl::pair<uint32_t, glm::uvec2>& inB)
+	{
+		return inA.first < inB.first;
+	});
+
+	Tiles.clear();
+	Tiles.reserve(sortedTiles.size());
+	for (const eastl::pair<uint32_t, glm::uvec2>& tile : sortedTiles)
+	{
+		Tiles.push_back(tile.second);
+	}
+
+	TilesSize = static_cast<int32_t>(tileSize);
+}
+
+void PathTraceIntegrator::RenderSample(const PathTraceView& inView, const uint32_t inSampleIndex, ThreadPool& inPool)
+{
+	if (!ENSURE_MSG(inView.Width == Width && inView.Height == Height, "Path trace view is %ux%u but the integrator was reset for %ux%u",
+		inView.Width, inView.Height, Width, Height))
+	{
+		return;
+	}
+
+	if (Settings.bUseWavefront)
+	{
+		RenderWavefront(inView, inSampleIndex, inPool);
+	}
+	else
+	{
+		if (Tiles.empty() || TilesSize != Settings.TileSize)
+		{
+			BuildTiles();
+		}
+
+		// 8 lanes only pay off with AVX registers to hold them
+		const int32_t packetWidth = !Settings.bUsePacketCameraRays ? 1 : (CPUFeatures::HasAVX() ? 8 : 4);
+
+		inPool.ParallelFor(static_cast<uint32_t>(Tiles.size()), [this, &inView, inSampleIndex, packetWidth](const uint32_t inTileIndex)
+		{
+			switch (packetWidth)
+			{
+			case 8:
+			{
+				RenderTilePackets<8>(Tiles[inTileIndex], inView, inSampleIndex);
+				break;
+			}
+			case 4:
+			{
+				RenderTilePackets<4>(Tiles[inTileIndex], inView, inSampleIndex);
+				break;
+			}
+			default:
+			{
+				RenderTile(Tiles[inTileIndex], inView, inSampleIndex);
+				break;
+			}
+			}
+		});
+	}
+
+	EndSample();
+}
+
+PathTracingRay PathTraceIntegrator::GenerateCameraRay(const uint32_t x, const uint32_t y, const PathTraceView& inView, PathTraceSampler& inOutSampler)
+{
+	const glm::vec2 pixelOffset = inOutSampler.Get2D();
+	glm::vec2 normalizedCoords = glm::vec2((float(x) + pixelOffset.x) / float(inView.Width) , (float(y) + pixelOffset.y) / float(inView.Height) );
+	normalizedCoords = normalizedCoords * 2.f - 1.f; // 0..1 -> -1..1
+
+	glm::vec4 worldSpace = inView.InvProjection * glm::vec4(normalizedCoords.x, normalizedCoords.y, 1.f, 1.f);
+	worldSpace /= worldSpace.w;
+
+	glm::vec3 firstRayDir = glm::normalize(glm::vec3(worldSpace));
+	//const glm::vec3 pixelPos = glm::vec3(normalizedCoords.x , normalizedCoords.y, 0.f);
+	//glm::vec3 rayDir = glm::normalize(glm::vec3(worldSpace) - pixelPos); // Same thing
+
+	firstRayDir = glm::normalize(glm::vec3(inView.InvView * glm::vec4(firstRayDir.x, firstRayDir.y, firstRayDir.z, 0.f)));
+
+	return PathTracingRay(inView.CameraPosition, firstRayDir);
+}
+
+bool PathTraceIntegrator::TraceRay(const PathTracingRay& inRay, PathTracePayload& outPayload, glm::vec3& outColor) const
+{
+	if (!Scene || !Scene->Trace(inRay, outPayload))
+	{
+		return false;
+	}
+
+	const BVHInstance& instance = Scene->Instances[outPayload.InstanceIndex];
+	outColor = InstanceColors[instance.UserIndex];
+
+	return true;
+}
+
+// One bounce of a path, given what its ray hit. Moves inOutRay on to the next bounce and returns true while the path goes on,
+// otherwise returns false with the final linear color of the path in outPixelColor. All integrators go through this so they render the same image
+bool PathTraceIntegrator::ShadeBounce(const bool inHit, const PathTracePayload& inPayload, const glm::vec3& inHitColor, const int32_t inBounce,
+	PathTraceSampler& inOutSampler, PathTracingRay& inOutRay, glm::vec4& inOutColor, OUT glm::vec4& outPixelColor) const
+{
+	if (!inHit)
+	{
+		if (inBounce == 0)
+		{
+			outPixelColor = glm::vec4(0.f, 0.f, 0.f, 1.f);
+
+			return false;
+		}
+		else
+		{
+			 //Lessen light intensity based on the normal of the first surface the light ray has touched(last before it doesn't hit anything)
+			 //and the amount of rays necessary to reach the point
+
+			const float occlusionScale = 1.f / float(inBounce);
+
+			inOutColor *= /*cosNLightDir * */occlusionScale;
+		}
+
+		outPixelColor = inOutColor;
+
+		return false;
+	}
+
+	const glm::vec3 SourceSurfaceNormal = inPayload.Normal;
+
+	glm::vec3 newRayDir = SourceSurfaceNormal + SampleUniformSphere(inOutSampler.Get2D()); // Lambertian diffuse
+	//glm::vec3 newRayDir = glm::reflect(traceRay.Direction, SourceSurfaceNormal); // Perfect reflection
+
+	if (near_zero(newRayDir))
+	{
+		newRayDir = SourceSurfaceNormal;
+	}
+
+	const glm::vec3 hitPos = inOutRay.Origin + (inOutRay.Direction * inPayload.Distance);
+	inOutRay.Origin = hitPos + SourceSurfaceNormal * 0.0001f;
+	inOutRay.SetDirection(newRayDir);
+
+	const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -LightDirection), 0.1f, 1.f);
+	inOutColor += glm::vec4(inHitColor.x, inHitColor.y, inHitColor.z, 0.f) * cosNLightDir;
+
+	// Paths that never escape the scene get no light
+	if (inBounce + 1 == PATH_TRACE_MAX_BOUNCES)
+	{
+		outPixelColor = glm::vec4(0.f, 0.f, 0.f, 1.f);
+
+		return false;
+	}
+
+	return true;
+}
+
+// Bounces scatter rays in all directions so they are traced one at a time
+glm::vec4 PathTraceIntegrator::ContinuePath(bool inHit, PathTracePayload inPayload, glm::vec3 inHitColor, PathTracingRay& inOutRay, PathTraceSampler& inOutSampler,
+	uint32_t& inOutRaysCount) const
+{
+	glm::vec4 color = glm::vec4(0.f, 0.f, 0.f, 0.f);
+
+	for (int32_t i = 0; ; ++i)
+	{
+		glm::vec4 pixelColor;
+		if (!ShadeBounce(inHit, inPayload, inHitColor, i, inOutSampler, inOutRay, color, pixelColor))
+		{
+			return pixelColor;
+		}
+
+		inPayload = PathTracePayload();
+		inHit = TraceRay(inOutRay, inPayload, inHitColor);
+		++inOutRaysCount;
+	}
+}
+
+glm::vec4 PathTraceIntegrator::EncodeGamma(const glm::vec4& inLinearColor)
+{
+	const glm::vec3 encoded = glm::pow(glm::vec3(inLinearColor), glm::vec3(1.f / PATH_TRACE_DISPLAY_GAMMA));
+
+	return glm::vec4(encoded.x, encoded.y, encoded.z, inLinearColor.w);
+}
+
+void PathTraceIntegrator::AccumulatePixel(const uint32_t inPixelIndex, const glm::vec4& inColor)
+{
+	Accumulation[inPixelIndex] += inColor;
+}
+
+void PathTraceIntegrator::RenderTile(const glm::uvec2& inTile, const PathTraceView& inView, const uint32_t inSampleIndex)
+{
+	const uint32_t tileSize = static_cast<uint32_t>(TilesSize);
+	const uint32_t tileEndY = glm::min(inTile.y + tileSize, Height);
+	const uint32_t tileEndX = glm::min(inTile.x + tileSize, Width);
+
+	uint32_t raysCount = 0;
+
+	for (uint32_t i = inTile.y; i < tileEndY; ++i)
+	{
+		for (uint32_t j = inTile.x; j < tileEndX; ++j)
+		{
+			PathTraceSampler sampler(Settings.SamplerType, (Width * i) + j, inSampleIndex);
+			PathTracingRay ray = GenerateCameraRay(j, i, inView, sampler);
+
+			glm::vec3 hitColor;
+			PathTracePayload payload;
+			const bool bHit = TraceRay(ray, payload, hitColor);
+			++raysCount;
+
+			AccumulatePixel((Width * i) + j, ContinuePath(bHit, payload, hitColor, ray, sampler, raysCount));
+		}
+	}
+
+	RaysCount.fetch_add(raysCount, std::memory_order_relaxed);
+}
+
+// Camera rays of neighbouring pixels go through the same nodes, so the tile is traced in blocks of PacketWidth pixels
+// with one packet per block. Paths split up after the first hit and go on as single rays
+template<int32_t PacketWidth>
+void PathTraceIntegrator::RenderTilePackets(const glm::uvec2& inTile, const PathTraceView& inView, const uint32_t inSampleIndex)
+{
+	// 2x2 or 4x2 pixels, lane index goes along x first
+	const uint32_t blockWidth = PacketWidth / 2;
+	const uint32_t blockHeight = 2;
+
+	const uint32_t tileSize = static_cast<uint32_t>(TilesSize);
+	const uint32_t tileEndY = glm::min(inTile.y + tileSize, Height);
+	const uint32_t tileEndX = glm::min(inTile.x + tileSize, Width);
+
+	uint32_t raysCount = 0;
+
+	for (uint32_t blockY = inTile.y; blockY < tileEndY; blockY += blockHeight)
+	{
+		for (uint32_t blockX = inTile.x; blockX < tileEndX; blockX += blockWidth)
+		{
+			PathTraceSampler samplers[PacketWidth];
+			PathTracingRay rays[PacketWidth];
+			int32_t lanesMask = 0;
+
+			for (int32_t lane = 0; lane < PacketWidth; ++lane)
+			{
+				const uint32_t x = blockX + lane % blockWidth;
+				const uint32_t y = blockY + lane / blockWidth;
+
+				// Blocks on the right and bottom edges of the tile may be partly outside of it
+				if (x >= tileEndX || y >= tileEndY)
+				{
+					continue;
+				}
+
+				samplers[lane] = PathTraceSampler(Settings.SamplerType, (Width * y) + x, inSampleIndex);
+				rays[lane] = GenerateCameraRay(x, y, inView, samplers[lane]);
+				lanesMask |= 1 << lane;
+			}
+
+			PathTracePayload payloads[PacketWidth];
+			const int32_t hitMask = Scene ? Scene->TracePacket(RayPacket<PacketWidth>(rays, lanesMask), payloads) : 0;
+
+			for (int32_t lane = 0; lane < PacketWidth; ++lane)
+			{
+				if (((lanesMask >> lane) & 1) == 0)
+				{
+					continue;
+				}
+
+				++raysCount;
+
+				const bool bHit = ((hitMask >> lane) & 1) != 0;
+				const glm::vec3 hitColor = bHit ? InstanceColors[Scene->Instances[payloads[lane].InstanceIndex].UserIndex] : glm::vec3(0.f, 0.f, 0.f);
+
+				const uint32_t x = blockX + lane % blockWidth;
+				const uint32_t y = blockY + lane / blockWidth;
+				AccumulatePixel((Width * y) + x, ContinuePath(bHit, payloads[lane], hitColor, rays[lane], samplers[lane], raysCount));
+			}
+		}
+	}
+
+	RaysCount.fetch_add(raysCount, std::memory_order_relaxed);
+}
+
+// Breadth first version of the tiles. All paths in flight go through each bounce together: their rays are traced in one pass,
+// then shaded in another, so a pass runs the same code over many rays instead of one path jumping between unrelated parts of the scene.
+// Finished paths are replaced by paths of the next pixels, so the queue stays full until the image runs out of pixels
+void PathTraceIntegrator::RenderWavefront(const PathTraceView& inView, const uint32_t inSampleIndex, ThreadPool& inPool)
+{
+	const uint32_t pixelsCount = Width * Height;
+
+	glm::vec3 sceneMin = glm::vec3(0.f, 0.f, 0.f);
+	glm::vec3 sceneInvExtent = glm::vec3(0.f, 0.f, 0.f);
+	if (Scene && Scene->IsValid())
+	{
+		const BVHLinearNode& root = Scene->Nodes[0];
+		sceneMin = root.Bounds[0];
+		sceneInvExtent = 1.f / glm::max(root.Bounds[1] - root.Bounds[0], glm::vec3(FLT_EPSILON));
+	}
+
+	// 8 lanes only pay off with AVX registers to hold them
+	const int32_t packetWidth = !Settings.bUsePacketWavefrontRays ? 1 : (CPUFeatures::HasAVX() ? 8 : 4);
+
+	WavefrontPaths.clear();
+	WavefrontPaths.reserve(WAVEFRONT_MAX_PATHS);
+
+	uint32_t nextPixel = 0;
+	while (true)
+	{
+		// Regenerate, top the queue up with camera rays of the next pixels
+		const uint32_t alivePathsCount = static_cast<uint32_t>(WavefrontPaths.size());
+		const uint32_t newPathsCount = glm::min(WAVEFRONT_MAX_PATHS - alivePathsCount, pixelsCount - nextPixel);
+		WavefrontPaths.resize(alivePathsCount + newPathsCount);
+
+		ParallelForChunks(inPool, newPathsCount, [this, &inView, inSampleIndex, alivePathsCount, nextPixel](const uint32_t inIndex)
+		{
+			WavefrontPath& path = WavefrontPaths[alivePathsCount + inIndex];
+			const uint32_t pixelIndex = nextPixel + inIndex;
+
+			path.PixelIndex = pixelIndex;
+			path.Bounce = 0;
+			path.Color = glm::vec4(0.f, 0.f, 0.f, 0.f);
+			path.Sampler = PathTraceSampler(Settings.SamplerType, pixelIndex, inSampleIndex);
+			path.Ray = GenerateCameraRay(pixelIndex % Width, pixelIndex / Width, inView, path.Sampler);
+		});
+
+		nextPixel += newPathsCount;
+
+		const uint32_t pathsCount = static_cast<uint32_t>(WavefrontPaths.size());
+		if (pathsCount == 0)
+		{
+			break;
+		}
+
+		if (Settings.bSortWavefrontRays)
+		{
+			WavefrontSortKeys.resize(pathsCount);
+			ParallelForChunks(inPool, pathsCount, [this, &sceneMin, &sceneInvExtent](const uint32_t inIndex)
+			{
+				const uint64_t key = GetRaySortKey(WavefrontPaths[inIndex].Ray, sceneMin, sceneInvExtent);
+				WavefrontSortKeys[inIndex] = (key << 32) | inIndex;
+			});
+
+			eastl::sort(WavefrontSortKeys.begin(), WavefrontSortKeys.end());
+
+			WavefrontSortedPaths.resize(pathsCount);
+			ParallelForChunks(inPool, pathsCount, [this](const uint32_t inIndex)
+			{
+				WavefrontSortedPaths[inIndex] = WavefrontPaths[static_cast<uint32_t>(WavefrontSortKeys[inIndex])];
+			});
+
+			eastl::swap(WavefrontPaths, WavefrontSortedPaths);
+		}
+
+		// Extend, closest hits of the whole queue
+		const uint32_t chunksCount = (pathsCount + WAVEFRONT_CHUNK_SIZE - 1) / WAVEFRONT_CHUNK_SIZE;
+		inPool.ParallelFor(chunksCount, [this, pathsCount, packetWidth](const uint32_t inChunkIndex)
+		{
+			ExtendWavefrontPaths(inChunkIndex * WAVEFRONT_CHUNK_SIZE, glm::min((inChunkIndex + 1) * WAVEFRONT_CHUNK_SIZE, pathsCount), packetWidth);
+		});
+
+		RaysCount.fetch_add(pathsCount, std::memory_order_relaxed);
+
+		// Shade, finished paths write their pixel and are marked for removal
+		ParallelForChunks(inPool, pathsCount, [this](const uint32_t inIndex)
+		{
+			WavefrontPath& path = WavefrontPaths[inIndex];
+
+			glm::vec4 pixelColor;
+			if (ShadeBounce(path.bHit, path.Payload, path.HitColor, path.Bounce, path.Sampler, path.Ray, path.Color, pixelColor))
+			{
+				++path.Bounce;
+			}
+			else
+			{
+				AccumulatePixel(path.PixelIndex, pixelColor);
+				path.Bounce = -1;
+			}
+		});
+
+		WavefrontPaths.erase(eastl::remove_if(WavefrontPaths.begin(), WavefrontPaths.end(), [](const WavefrontPath& inPath)
+		{
+			return inPath.Bounce == -1;
+		}), WavefrontPaths.end());
+	}
+}
+
+template<int32_t PacketWidth>
+void PathTraceIntegrator::ExtendWavefrontPacket(const uint32_t inFirstPath)
+{
+	PathTracingRay rays[PacketWidth];
+	for (int32_t lane = 0; lane < PacketWidth; ++lane)
+	{
+		rays[lane] = WavefrontPaths[inFirstPath + lane].Ray;
+	}
+
+	PathTracePayload payloads[PacketWidth];
+	const int32_t hitMask = Scene ? Scene->TracePacket(RayPacket<PacketWidth>(rays, (1 << PacketWidth) - 1), payloads) : 0;
+
+	for (int32_t lane = 0; lane < PacketWidth; ++lane)
+	{
+		WavefrontPath& path = WavefrontPaths[inFirstPath + lane];
+		path.Payload = payloads[lane];
+		path.bHit = ((hitMask >> lane) & 1) != 0;
+
+		if (path.bHit)
+		{
+			path.HitColor = InstanceColors[Scene->Instances[path.Payload.InstanceIndex].UserIndex];
+		}
+	}
+}
+
+// Runs of consecutive camera rays heading into the same octant go through the tree as packets of inPacketWidth, then of 4, and what is
+// left of each run one ray at a time. Diffuse bounces scatter too much for the rays of a packet to share nodes, even sorted they were
+// slower as packets than on their own, so they are always traced one at a time
+void PathTraceIntegrator::ExtendWavefrontPaths(const uint32_t inBegin, const uint32_t inEnd, const int32_t inPacketWidth)
+{
+	uint32_t pathIndex = inBegin;
+	while (pathIndex < inEnd)
+	{
+		const uint32_t octant = GetRayOctant(WavefrontPaths[pathIndex].Ray);
+		const bool bCameraRays = WavefrontPaths[pathIndex].Bounce == 0;
+
+		uint32_t runEnd = pathIndex + 1;
+		while (runEnd < inEnd && GetRayOctant(WavefrontPaths[runEnd].Ray) == octant && (WavefrontPaths[runEnd].Bounce == 0) == bCameraRays)
+		{
+			++runEnd;
+		}
+
+		if (bCameraRays && inPacketWidth >= 8)
+		{
+			for (; pathIndex + 8 <= runEnd; pathIndex += 8)
+			{
+				ExtendWavefrontPacket<8>(pathIndex);
+			}
+		}
+
+		if (bCameraRays && inPacketWidth >= 4)
+		{
+			for (; pathIndex + 4 <= runEnd; pathIndex += 4)
+			{
+				ExtendWavefrontPacket<4>(pathIndex);
+			}
+		}
+
+		for (; pathIndex < runEnd; ++pathIndex)
+		{
+			WavefrontPath& path = WavefrontPaths[pathIndex];
+			path.Payload = PathTracePayload();
+			path.bHit = TraceRay(path.Ray, path.Payload, path.HitColor);
+		}
+	}
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "glm/ext/vector_float4.hpp"
+#include "glm/ext/vector_uint2.hpp"
+#include "Core/EngineUtils.h"
+#include "EASTL/vector.h"
+#include "Math/PathTracing.h"
+#include "Math/Sampling.h"
+#include "Math/TLAS.h"
+
+class ThreadPool;
+
+// Bounces per path, including the camera ray
+#define PATH_TRACE_MAX_BOUNCES 5
+
+// Gamma the linear accumulation is encoded with for 8 bit outputs
+#define PATH_TRACE_DISPLAY_GAMMA 2.2f
+
+// Camera and image size a sample is rendered for
+struct PathTraceView
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+
+	glm::mat4 InvProjection = glm::mat4(1.f);
+
+	// Camera to world
+	glm::mat4 InvView = glm::mat4(1.f);
+	glm::vec3 CameraPosition = glm::vec3(0.f, 0.f, 0.f);
+};
+
+struct PathTraceIntegratorSettings
+{
+	ESamplerType SamplerType = ESamplerType::Sobol;
+
+	// Side of the square tiles the image is split in, tile integrator only
+	int32_t TileSize = 16;
+
+	// Camera rays of the tile integrator are traced in 2x2 or 4x2 pixel packets
+	bool bUsePacketCameraRays = true;
+
+	// Breadth first integrator instead of the tiles, see RenderWavefront
+	bool bUseWavefront = false;
+	bool bSortWavefrontRays = true;
+
+	// Consecutive camera rays of the wavefront queue heading into the same octant are traced as packets, see ExtendWavefrontPaths
+	bool bUsePacketWavefrontRays = true;
+};
+
+// The CPU path tracer, independent of any window, RHI or UI. Paths are accumulated per pixel in float
+// and whoever drives the integrator decides when and how to present them, in a window or written to a file.
+class PathTraceIntegrator
+{
+public:
+	// Clears the accumulated samples, the next sample rendered is the first of the image
+	void Reset(const uint32_t inWidth, const uint32_t inHeight);
+
+	// Adds one path to every pixel of inView, the inSampleIndex-th of each pixel's sample sequence. inView must match the size given to Reset
+	void RenderSample(const PathTraceView& inView, const uint32_t inSampleIndex, ThreadPool& inPool);
+
+	// Camera ray through the pixel, jittered inside it so that accumulated samples also anti alias.
+	// Takes the first dimension pair of the sampler
+	static PathTracingRay GenerateCameraRay(const uint32_t x, const uint32_t y, const PathTraceView& inView, PathTraceSampler& inOutSampler);
+
+	// Closest hit in the scene and the albedo of the instance hit
+	bool TraceRay(const PathTracingRay& inRay, PathTracePayload& outPayload, glm::vec3& outColor) const;
+
+	// Rest of a path whose camera ray was already traced, on its own or as part of a packet. Returns the color of the path
+	// and adds the rays it traced to inOutRaysCount
+	glm::vec4 ContinuePath(bool inHit, PathTracePayload inPayload, glm::vec3 inHitColor, PathTracingRay& inOutRay, PathTraceSampler& inOutSampler,
+		uint32_t& inOutRaysCount) const;
+
+	// For callers tracing paths themselves, adds one to the pixel. EndSample has to follow once every pixel got its path
+	void AccumulatePixel(const uint32_t inPixelIndex, const glm::vec4& inColor);
+	inline void EndSample() { ++SamplesCount; }
+
+	// Mean of the paths accumulated so far
+	inline glm::vec4 GetPixel(const uint32_t inPixelIndex) const
+	{
+		return SamplesCount > 0 ? Accumulation[inPixelIndex] / float(SamplesCount) : glm::vec4(0.f, 0.f, 0.f, 0.f);
+	}
+
+	// Gamma encoded color for the window texture and PNGs, anything keeping floats like PFMs takes the linear GetPixel
+	static glm::vec4 EncodeGamma(const glm::vec4& inLinearColor);
+
+	inline uint32_t GetWidth() const { return Width; }
+	inline uint32_t GetHeight() const { return Height; }
+	inline uint32_t GetSamplesCount() const { return SamplesCount; }
+
+	// Rays traced since Reset, camera rays and bounces
+	inline uint64_t GetRaysCount() const { return RaysCount.load(std::memory_order_relaxed); }
+
+	PathTraceIntegratorSettings Settings;
+
+	// Must stay valid while samples are rendered
+	const TLAS* Scene = nullptr;
+
+	// Albedo of the instances, indexed by BVHInstance::UserIndex
+	eastl::vector<glm::vec3> InstanceColors;
+
+	// Normalized direction of the directional light
+	glm::vec3 LightDirection = glm::vec3(0.f, 1.f, 0.f);
+
+private:
+	bool ShadeBounce(const bool inHit, const PathTracePayload& inPayload, const glm::vec3& inHitColor, const int32_t inBounce,
+		PathTraceSampler& inOutSampler, PathTracingRay& inOutRay, glm::vec4& inOutColor, OUT glm::vec4& outPixelColor) const;
+
+	void BuildTiles();
+	void RenderTile(const glm::uvec2& inTile, const PathTraceView& inView, const uint32_t inSampleIndex);
+	template<int32_t PacketWidth>
+	void RenderTilePackets(const glm::uvec2& inTile, const PathTraceView& inView, const uint32_t inSampleIndex);
+	void RenderWavefront(const PathTraceView& inView, const uint32_t inSampleIndex, ThreadPool& inPool);
+	void ExtendWavefrontPaths(const uint32_t inBegin, const uint32_t inEnd, const int32_t inPacketWidth);
+	template<int32_t PacketWidth>
+	void ExtendWavefrontPacket(const uint32_t inFirstPath);
+
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	uint32_t SamplesCount = 0;
+
+	eastl::vector<glm::vec4> Accumulation;
+
+	// Top left pixel of every tile, in the order the pool hands them out
+	eastl::vector<glm::uvec2> Tiles;
+	int32_t TilesSize = 0;
+
+	// Everything a path needs between the passes of the wavefront integrator
+	struct WavefrontPath
+	{
+		PathTracingRay Ray;
+		PathTracePayload Payload;
+		PathTraceSampler Sampler;
+		glm::vec4 Color = glm::vec4(0.f, 0.f, 0.f, 0.f);
+		glm::vec3 HitColor = glm::vec3(0.f, 0.f, 0.f);
+		uint32_t PixelIndex = 0;
+		// -1 once the path is done
+		int32_t Bounce = 0;
+		bool bHit = false;
+	};
+
+	eastl::vector<WavefrontPath> WavefrontPaths;
+	eastl::vector<WavefrontPath> WavefrontSortedPaths;
+	eastl::vector<uint64_t> WavefrontSortKeys;
+
+	std::atomic<uint64_t> RaysCount = { 0 };
+};
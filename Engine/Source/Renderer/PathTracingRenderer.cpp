@@ -35,57 +35,21 @@
 #include "imgui.h"
 #include "ShaderTypes.h"
 #include "Utils/ImageLoading.h"
+#include "Math/Sampling.h"
+#include "Utils/ThreadPool.h"
+#include "Renderer/PathTraceIntegrator.h"
 
 #include <algorithm>
-#include <execution>
-#include <random>
 
 #define DRAW_SPHERES 0
 
-inline float random_float() {
-	static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-	static std::mt19937 generator;
-	return distribution(generator);
-}
-
-inline float random_float(float min, float max) {
-	// Returns a random real in [min,max).
-	return min + (max - min) * random_float();
-}
-
-static glm::vec3 randomVec3() {
-	return glm::vec3(random_float(), random_float(), random_float());
-}
-
-static glm::vec3 randomVec3(float min, float max) {
-	return glm::vec3(random_float(min, max), random_float(min, max), random_float(min, max));
-}
-
-inline glm::vec3 random_in_unit_sphere() {
-	while (true) {
-		auto p = randomVec3(-1, 1);
-		if (glm::lengthSquared(p)< 1)
-			return p;
-	}
-}
-
-inline glm::vec3 random_unit_vector() {
-	return glm::normalize(random_in_unit_sphere());
-}
-
-inline glm::vec3 random_on_hemisphere(const glm::vec3& normal) {
-	glm::vec3 on_unit_sphere = random_unit_vector();
-	if (dot(on_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
-		return on_unit_sphere;
-	else
-		return -on_unit_sphere;
-}
-
+#if DRAW_SPHERES
 bool near_zero(glm::vec3 inVec) {
 	// Return true if the vector is close to zero in all dimensions.
 	auto s = 1e-8;
 	return (fabs(inVec.x) < s) && (fabs(inVec.y) < s) && (fabs(inVec.z) < s);
 }
+#endif
 
 static uint32_t ConvertToRGBA(const glm::vec4& color)
 {
@@ -103,11 +67,21 @@ PathTracingRenderer::~PathTracingRenderer() = default;
 eastl::shared_ptr<FullScreenQuad> VisualizeQuad;
 eastl::shared_ptr<RHITexture2D> RHITexture;
 
-glm::vec4* AccumulationData;
 uint32_t* FinalImageData;
-uint32_t AccumulatedFramesCount = 1;
+// Incremented before drawing, the first accumulated frame clears the data
+uint32_t AccumulatedFramesCount = 0;
 bool bUseAccumulation = true;
 
+// Frames drawn so far, gives fresh samples every frame while accumulation is off
+uint32_t FrameIndex = 0;
+
+// 0 uses every hardware thread
+int32_t RenderThreadsCount = 0;
+
+eastl::unique_ptr<ThreadPool> RenderThreadPool;
+
+PathTraceIntegrator Integrator;
+
 void PathTracingRenderer::InitInternal()
 {
 	const WindowsWindow& currentWindow = GEngine->GetMainWindow();
@@ -118,7 +92,7 @@ void PathTracingRenderer::InitInternal()
 	RHITexture = RHI::Get()->CreateTexture2D(props.Width, props.Height);
 
 	VisualizeQuad->GetCommand().Material->ExternalTextures.push_back(RHITexture);
-	AccumulationData = new glm::vec4[props.Width * props.Height];
+	Integrator.Reset(props.Width, props.Height);
 	FinalImageData = new uint32_t[props.Width * props.Height];
 
 #if DRAW_SPHERES
@@ -211,149 +185,19 @@ PathTraceSpherePayload TraceSphere(const PathTracingRay& inRay)
 	return result;
 }
 
-static glm::vec3 NormalizedDirLightDir = glm::vec3(0.f, 1.f, 0.f);
-
-bool PathTracingRenderer::TriangleTrace(const PathTracingRay& inRay, PathTracePayload& outPayload, glm::vec3& outColor)
-{
-	bool bHit = false;
-	for (RenderCommand& command : MainCommands)
-	{
-		if (command.Triangles.size() == 0)
-		{
-			continue;
-		}
-
-#if 0
-		const eastl::shared_ptr<const DrawableObject> parent = command.Parent.lock();
-		glm::mat4 modelMat = parent->GetModelMatrix();
-		// Remove z scale from model for two dimensional shape
-		glm::vec4 thirdColumn = modelMat[2];
-		//modelMat[2] = glm::vec4(0.f, 0.f, 0.f, thirdColumn.w);
-
-		for (PathTraceTriangle tri : command.Triangles)
-		{
-			//tri.Transform(modelMat);
-
-			if (IntersectsTriangle(inRay, tri))
-			{
-				return glm::vec4(0.f, 1.f, 0.f, 1.f);
-			}
-		}
-
-#else
-		PathTracePayload currMeshPayload;
-		if (command.AccStructure.Trace(inRay, currMeshPayload))
-		{
-			bHit = true;
-			if (currMeshPayload.Distance < outPayload.Distance)
-			{
-				outPayload = currMeshPayload;
-				outColor = command.OverrideColor;
-			}
-		}
-#endif
-	}
-
-	return bHit;
-}
-
-glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, const WindowProperties& inProps, const glm::mat4& inInvProj, const glm::mat4& inInvView, const glm::vec3& inCamPos)
+glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, const PathTraceView& inView, PathTraceSampler& inOutSampler)
 {
-	glm::vec2 normalizedCoords = glm::vec2(float(x) / float(inProps.Width) , float(y) / float(inProps.Height) );
-	normalizedCoords = normalizedCoords * 2.f - 1.f; // 0..1 -> -1..1
-
-	glm::vec4 worldSpace = inInvProj * glm::vec4(normalizedCoords.x, normalizedCoords.y, 1.f, 1.f);
-	worldSpace /= worldSpace.w;
-
-	glm::vec3 firstRayDir = glm::normalize(glm::vec3(worldSpace));
-	//const glm::vec3 pixelPos = glm::vec3(normalizedCoords.x , normalizedCoords.y, 0.f);
-	//glm::vec3 rayDir = glm::normalize(glm::vec3(worldSpace) - pixelPos); // Same thing
-
-	firstRayDir = glm::normalize(glm::vec3(inInvView * glm::vec4(firstRayDir.x, firstRayDir.y, firstRayDir.z, 0.f)));
-
+	PathTracingRay traceRay = PathTraceIntegrator::GenerateCameraRay(x, y, inView, inOutSampler);
 	glm::vec4 color = glm::vec4(0.f, 0.f, 0.f, 0.f);
-	PathTracingRay traceRay = { inCamPos, firstRayDir };
 
 #if !DRAW_SPHERES
 
-	PathTracePayload firstHitPayload;
-	glm::vec3 SourceSurfaceNormal;
-	float multiplier = 1.f;
-	const int32_t nrSamples = 5;
-	for (int32_t i = 0; i < nrSamples; ++i)
-	{
-		glm::vec3 hitColor;
-		PathTracePayload payload;
-		const bool bHit = TriangleTrace(traceRay, payload, hitColor);
-
-		if (!bHit)
-		{
-			if (i == 0)
-			{
-				return glm::vec4(0.f, 0.f, 0.f, 1.f);
-			}
-			else
-			{
-				 //Lessen light intensity based on the normal of the first surface the light ray has touched(last before it doesn't hit anything)
-				 //and the amount of rays necessary to reach the point
+	glm::vec3 hitColor;
+	PathTracePayload payload;
+	const bool bHit = Integrator.TraceRay(traceRay, payload, hitColor);
 
-				const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -NormalizedDirLightDir), 0.1f, 1.f);
-				const float occlusionScale = 1.f / float(i);
-
-				color *= /*cosNLightDir * */occlusionScale;
-			}
-
-			color = glm::pow(glm::vec4(color.x, color.y, color.z, color.w), glm::vec4(1.f / 2.2f)); // Gamma correction
-
-			// Shadow trace
-			//glm::vec3 shadowRayOrigin = inCamPos + (firstRayDir * firstHitPayload.Distance);
-			//shadowRayOrigin = shadowRayOrigin + firstHitPayload.Triangle->WSNormalNormalized * 0.0001f;
-			//const glm::vec3 shadowRayDir = -NormalizedDirLightDir;
-
-			//PathTracingRay shadowRay = { shadowRayOrigin, shadowRayDir };
-			//const bool inShadow = TriangleTrace(shadowRay, payload, hitColor);
-			//if (inShadow)
-			//{
-			//	color *= 0.1f;
-			//	//color = glm::vec4(1.f, 0.f, 0.f, 1.f);
-			//}
-
-
-			return color;
-		}
-		else
-		{
-			if (i == 0)
-			{
-				firstHitPayload = payload;
-			}
-
-			SourceSurfaceNormal = payload.Triangle->WSNormalNormalized;;
-
-			glm::vec3 newRayDir = SourceSurfaceNormal + random_unit_vector(); // Lambertian diffuse
-			//glm::vec3 newRayDir = glm::reflect(traceRay.Direction, SourceSurfaceNormal); // Perfect reflection
-
-			if (near_zero(newRayDir))
-			{
-				newRayDir = SourceSurfaceNormal;
-			}
-
-			//const glm::vec3 hitPos = inCamPos + (rayDir * payload.Distance);
-			const glm::vec3 hitPos = traceRay.Origin + (traceRay.Direction * payload.Distance);
-			traceRay.Origin = hitPos + SourceSurfaceNormal * 0.0001f;
-			traceRay.Direction = newRayDir;
-
-			const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -NormalizedDirLightDir), 0.1f, 1.f);
-			color += glm::vec4(hitColor.x, hitColor.y, hitColor.z, 0.f) * cosNLightDir * multiplier;
-
-			//multiplier *= 0.8f;
-		}
-	}
-
-	//SourceSurfaceNormal = (SourceSurfaceNormal * 0.5f) + 0.5f;
-	//return glm::vec4(SourceSurfaceNormal.x, SourceSurfaceNormal.y, SourceSurfaceNormal.z, 1.f);
-	return glm::vec4(0.f, 0.f, 0.f, 1.f);
-	//return color;
+	uint32_t raysCount = 1;
+	return Integrator.ContinuePath(bHit, payload, hitColor, traceRay, inOutSampler, raysCount);
 
 #else
 
@@ -369,20 +213,18 @@ glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, cons
 		{
 			if (i == 0)
 			{
-				float a = 0.5f * (firstRayDir.y + 1.f);
+				float a = 0.5f * (traceRay.Direction.y + 1.f);
 				const glm::vec3 skyColor = (1.f - a) * glm::vec3(1.f, 1.f, 1.f) + a * glm::vec3(0.5f, 0.7f, 1.f);
 				color = glm::vec4(skyColor.x, skyColor.y, skyColor.z, 1.f);
 			}
 			else
 			{
-				const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -NormalizedDirLightDir), 0.1f, 1.f);
+				const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -Integrator.LightDirection), 0.1f, 1.f);
 				const float occlusionScale = 1.f / float(i);
 
 				color *= cosNLightDir * occlusionScale;
 			}
 
-			color = glm::pow(glm::vec4(color.x, color.y, color.z, color.w), glm::vec4(1.f/2.2f)); // Gamma correction
-
 			return color;
 		}
 		else
@@ -390,7 +232,7 @@ glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, cons
 			SourceSurfaceNormal = glm::normalize(result.Location - spheres[result.SphereIndex].Origin);
 			//const glm::vec3 newRayDir = glm::reflect(traceRay.Direction, SourceSurfaceNormal);
 			
-			glm::vec3 newRayDir = SourceSurfaceNormal + random_unit_vector(); // Lambertian diffuse
+			glm::vec3 newRayDir = SourceSurfaceNormal + SampleUniformSphere(inOutSampler.Get2D()); // Lambertian diffuse
 
 			if (near_zero(newRayDir))
 			{
@@ -398,7 +240,7 @@ glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, cons
 			}
 
 			traceRay.Origin = result.Location + SourceSurfaceNormal * 0.0001f;
-			traceRay.Direction = newRayDir;
+			traceRay.SetDirection(newRayDir);
 
 
 			//const glm::vec3 newRayDir = SourceSurfaceNormal;
@@ -411,7 +253,7 @@ glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, cons
 			//color = glm::vec4(result.distance/100.f, result.distance / 100.f, result.distance / 100.f, 1.f);
 
 			const glm::vec3& hitSphereColor = spheres[result.SphereIndex].Color;
-			const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -NormalizedDirLightDir), 0.1f, 1.f);
+			const float cosNLightDir = glm::clamp(glm::dot(SourceSurfaceNormal, -Integrator.LightDirection), 0.1f, 1.f);
 			color += glm::vec4(hitSphereColor.x, hitSphereColor.y, hitSphereColor.z, 0.f) * cosNLightDir * multiplier;
 
 			multiplier *= 0.5f;
@@ -424,23 +266,9 @@ glm::vec4 PathTracingRenderer::PerPixel(const uint32_t x, const uint32_t y, cons
 	return color;
 }
 
-eastl::vector<uint32_t> m_ImageHorizontalIter, m_ImageVerticalIter;
-
 PathTracingRenderer::PathTracingRenderer(const WindowProperties& inMainWindowProperties)
 	: Renderer(inMainWindowProperties)
 {
-	m_ImageHorizontalIter.resize(inMainWindowProperties.Width);
-	m_ImageVerticalIter.resize(inMainWindowProperties.Height);
-
-	for (uint32_t i = 0; i < inMainWindowProperties.Width; i++)
-	{
-		m_ImageHorizontalIter[i] = i;
-	}
-
-	for (uint32_t i = 0; i < inMainWindowProperties.Height; i++)
-	{
-		m_ImageVerticalIter[i] = i;
-	}
 }
 
 void PathTracingRenderer::Draw()
@@ -449,6 +277,32 @@ void PathTracingRenderer::Draw()
 
 	ImGui::Checkbox("Use Accumulation", &bUseAccumulation);
 
+	PathTraceIntegratorSettings& integratorSettings = Integrator.Settings;
+
+	int32_t samplerType = static_cast<int32_t>(integratorSettings.SamplerType);
+	if (ImGui::Combo("Sampler", &samplerType, "Random\0Stratified\0Sobol\0"))
+	{
+		integratorSettings.SamplerType = static_cast<ESamplerType>(samplerType);
+
+		// Samples of different sequences do not add up to either of them
+		AccumulatedFramesCount = 0;
+	}
+
+	ImGui::SliderInt("Tile Size", &integratorSettings.TileSize, 4, 64);
+	ImGui::Checkbox("Wavefront", &integratorSettings.bUseWavefront);
+	if (integratorSettings.bUseWavefront)
+	{
+		ImGui::Checkbox("Sort Rays", &integratorSettings.bSortWavefrontRays);
+		ImGui::Checkbox("Packet Rays", &integratorSettings.bUsePacketWavefrontRays);
+	}
+	else
+	{
+		ImGui::Checkbox("Packet Camera Rays", &integratorSettings.bUsePacketCameraRays);
+	}
+	ImGui::SliderInt("Render Threads", &RenderThreadsCount, 1, static_cast<int32_t>(glm::max(std::thread::hardware_concurrency(), 1u)));
+
+	++FrameIndex;
+
 	if (bUseAccumulation)
 	{
 		++AccumulatedFramesCount;
@@ -458,6 +312,9 @@ void PathTracingRenderer::Draw()
 		AccumulatedFramesCount = 1;
 	}
 
+	// Accumulated frames walk the sequence from its start, so the same view always converges to the same image
+	const uint32_t sampleIndex = bUseAccumulation ? AccumulatedFramesCount - 1 : FrameIndex;
+
 	//int32_t sphereNr = 0;
 	//for (Sphere& sphere : spheres)
 	//{
@@ -474,7 +331,7 @@ void PathTracingRenderer::Draw()
 
 	const eastl::vector<eastl::shared_ptr<LightSource>>& lights = SceneManager::Get().GetCurrentScene().GetLights();
 	const glm::vec3 DirLightDir = lights[0]->GetAbsoluteTransform().Rotation * glm::vec3(0.f, 0.f, 1.f);
-	NormalizedDirLightDir = glm::normalize(DirLightDir);
+	Integrator.LightDirection = glm::normalize(DirLightDir);
 
 	const WindowsWindow& currentWindow = GEngine->GetMainWindow();
 	const WindowProperties& props = currentWindow.GetProperties();
@@ -491,66 +348,58 @@ void PathTracingRenderer::Draw()
 	//const glm::mat4 view = glm::lookAt(glm::vec3(0.f, 0.f, 0.f), forward, glm::vec3(0, 1, 0));
 	//const glm::mat4 invView = glm::inverse(view);
 
-	// Precache transforms
-	for (RenderCommand& command : MainCommands)
+	// Object space BVHs are only built once, the TLAS is cheap enough to rebuild every frame so moved objects are picked up
+	BVHBuildSettings settings;
+	settings.bUseDiskCache = true;
+	BuildSceneAccStructure(MainCommands, settings, SceneAccStructure);
+
+	PathTraceView view;
+	view.Width = props.Width;
+	view.Height = props.Height;
+	view.InvProjection = invProj;
+	view.InvView = invView;
+	view.CameraPosition = camPos;
+
+	Integrator.Scene = &SceneAccStructure;
+	Integrator.InstanceColors.resize(MainCommands.size());
+	for (uint32_t i = 0; i < MainCommands.size(); ++i)
 	{
-		if (command.Triangles.size() == 0)
-		{
-			continue;
-		}
-
-		const eastl::shared_ptr<const DrawableObject> parent = command.Parent.lock();
-		glm::mat4 model = parent->GetModelMatrix();
+		Integrator.InstanceColors[i] = MainCommands[i].OverrideColor;
+	}
 
+	if (AccumulatedFramesCount == 1)
+	{
+		Integrator.Reset(props.Width, props.Height);
+	}
 
-		if (!command.AccStructure.IsValid())
-		{
-			eastl::vector<PathTraceTriangle> transformedTriangles = command.Triangles;
-			for (PathTraceTriangle& triangle : transformedTriangles)
-			{
-				triangle.Transform(model);
-			}
-			command.AccStructure.Build(transformedTriangles);
-		}
+	if (!RenderThreadPool || RenderThreadPool->GetThreadsCount() != static_cast<uint32_t>(RenderThreadsCount))
+	{
+		RenderThreadPool = eastl::make_unique<ThreadPool>(static_cast<uint32_t>(RenderThreadsCount));
+		RenderThreadsCount = static_cast<int32_t>(RenderThreadPool->GetThreadsCount());
 	}
 
 #if 1 // Multithreaded
-	std::for_each(std::execution::par, m_ImageVerticalIter.begin(), m_ImageVerticalIter.end(),
-		[this, props, invProj, invView, camPos](uint32_t i)
-		{
-			std::for_each(std::execution::par, m_ImageHorizontalIter.begin(), m_ImageHorizontalIter.end(),
-			[this, i, props, invProj, invView, camPos](uint32_t j)
-			{
-				if(AccumulatedFramesCount == 1)
-				{
-					AccumulationData[(props.Width * i) + j] = glm::vec4(0.f, 0.f, 0.f, 0.f);
-				}
-
-				AccumulationData[(props.Width * i) + j] += PerPixel(j, i, props, invProj, invView, camPos);
-
-				glm::vec4 finalColor = AccumulationData[(props.Width * i) + j] / glm::vec4(float(AccumulatedFramesCount));
-
-				FinalImageData[(props.Width * i) + j] = ConvertToRGBA(finalColor);
-			});
-		});
+	Integrator.RenderSample(view, sampleIndex, *RenderThreadPool);
 #else
 	for (uint32_t i = 0; i < props.Height; ++i)
 	{
 		for (uint32_t j = 0; j < props.Width; ++j)
 		{
-			if(AccumulatedFramesCount == 1)
-			{
-				AccumulationData[(props.Width * i) + j] = glm::vec4(0.f, 0.f, 0.f, 0.f);
-			}
-
-			AccumulationData[(props.Width * i) + j] += PerPixel(j, i, props, invProj, invView, camPos);
-
-			glm::vec4 finalColor = AccumulationData[(props.Width * i) + j] / glm::vec4(float(AccumulatedFramesCount));
-
-			FinalImageData[(props.Width * i) + j] = ConvertToRGBA(finalColor);
+			PathTraceSampler sampler(integratorSettings.SamplerType, (props.Width * i) + j, sampleIndex);
+			Integrator.AccumulatePixel((props.Width * i) + j, PerPixel(j, i, view, sampler));
 		}
 	}
+	Integrator.EndSample();
 #endif
+
+	RenderThreadPool->ParallelFor(props.Height, [&props](const uint32_t inRow)
+	{
+		for (uint32_t i = inRow * props.Width; i < (inRow + 1) * props.Width; ++i)
+		{
+			FinalImageData[i] = ConvertToRGBA(PathTraceIntegrator::EncodeGamma(Integrator.GetPixel(i)));
+		}
+	});
+
 	ImageData data;
 	data.NrChannels = 4;
 	data.RawData = FinalImageData;
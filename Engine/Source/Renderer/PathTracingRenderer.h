@@ -44,8 +44,7 @@ public:
 protected:
 	void InitInternal() override;
 
-	bool TriangleTrace(const PathTracingRay& inRay, PathTracePayload& outPayload, glm::vec3& outColor);
-	__forceinline glm::vec4 PerPixel(const uint32_t x, const uint32_t y, const WindowProperties& inProps, const glm::mat4& inInvProj, const glm::mat4& inInvView, const glm::vec3& inCamPos);
+	__forceinline glm::vec4 PerPixel(const uint32_t x, const uint32_t y, const struct PathTraceView& inView, class PathTraceSampler& inOutSampler);
 	void DrawCommand(const RenderCommand& inCommand);
 	void SetViewportSizeToMain();
 
@@ -54,6 +53,9 @@ private:
 	eastl::vector<RenderCommand> DecalCommands;
 	eastl::unordered_map<eastl::string, eastl::shared_ptr<class MeshDataContainer>> RenderDataContainerMap;
 
+	// Rebuilt every frame over the object space BVHs of MainCommands
+	TLAS SceneAccStructure;
+
 	friend Renderer;
 };
 
@@ -1 +1,60 @@
 #include "RenderCommand.h"
+#include "EASTL/unordered_map.h"
+#include "Renderer/Drawable/Drawable.h"
+
+void BuildSceneAccStructure(eastl::vector<RenderCommand>& inOutCommands, const BVHBuildSettings& inSettings, OUT TLAS& outSceneAccStructure)
+{
+	eastl::unordered_map<const MeshDataContainer*, const BVH*> sharedStructures;
+
+	for (RenderCommand& command : inOutCommands)
+	{
+		if (command.Triangles.size() == 0)
+		{
+			continue;
+		}
+
+		if (!command.AccStructure.IsValid())
+		{
+			command.AccStructure.Build(command.Triangles, inSettings);
+		}
+
+		if (command.DataContainer)
+		{
+			sharedStructures.insert(eastl::make_pair(command.DataContainer.get(), &command.AccStructure));
+		}
+	}
+
+	eastl::vector<BVHInstance> instances;
+	instances.reserve(inOutCommands.size());
+
+	for (uint32_t i = 0; i < inOutCommands.size(); ++i)
+	{
+		const RenderCommand& command = inOutCommands[i];
+
+		const BVH* structure = nullptr;
+		if (command.Triangles.size() != 0)
+		{
+			structure = &command.AccStructure;
+		}
+		else
+		{
+			const auto foundIt = sharedStructures.find(command.DataContainer.get());
+			if (foundIt == sharedStructures.end())
+			{
+				continue;
+			}
+
+			structure = foundIt->second;
+		}
+
+		const eastl::shared_ptr<const DrawableObject> parent = command.Parent.lock();
+		if (!parent)
+		{
+			continue;
+		}
+
+		instances.push_back(BVHInstance(structure, parent->GetModelMatrix(), i));
+	}
+
+	outSceneAccStructure.Build(std::move(instances));
+}
@@ -4,6 +4,7 @@
 #include "EASTL/vector.h"
 #include "Math/PathTracing.h"
 #include "Math/BVH.h"
+#include "Math/TLAS.h"
 #include "RenderingPrimitives.h"
 
 namespace EDrawMode
@@ -38,8 +39,14 @@ struct RenderCommand
 	eastl::vector<PathTraceTriangle> Triangles;
 	eastl::vector<Vertex> Vertices;
 	eastl::vector<glm::vec3> TransferCoeffs;
+
+	// Object space, traced through the renderer's TLAS with the parent's model matrix
 	BVH AccStructure;
 	glm::vec3 OverrideColor = glm::vec3(0.f, 0.f, 0.f);
 
 };
 
+// Builds the missing object space BVHs of the commands, then a TLAS over all of them with their current model matrices.
+// Commands sharing a MeshDataContainer only carry triangles for the first of them, the others reuse its BVH.
+// The TLAS points into inOutCommands, so it has to be rebuilt whenever the commands array changes.
+void BuildSceneAccStructure(eastl::vector<RenderCommand>& inOutCommands, const BVHBuildSettings& inSettings, OUT TLAS& outSceneAccStructure);
@@ -0,0 +1,342 @@
+#include "SHTransferBake.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "glm/geometric.hpp"
+#include "Math/MathUtils.h"
+#include "Math/PathTracing.h"
+#include "Math/Sampling.h"
+#include "Math/SphericalHarmonics.h"
+#include "Math/TLAS.h"
+#include "Logger/Logger.h"
+#include "Renderer/Drawable/Drawable.h"
+#include "Renderer/RenderCommand.h"
+#include "Renderer/SHTransferCache.h"
+#include "Utils/ThreadPool.h"
+
+static uint32_t GreatestCommonDivisor(uint32_t inA, uint32_t inB)
+{
+	while (inB != 0)
+	{
+		const uint32_t remainder = inA % inB;
+		inA = inB;
+		inB = remainder;
+	}
+
+	return inA;
+}
+
+// Distinct samples of the set, from a random one on with a random stride coprime to the set size
+struct SHSampleSubset
+{
+	SHSampleSubset(const uint64_t inSeed, const uint32_t inVertexIndex, const uint32_t inSamplesCount)
+		: SamplesCount(inSamplesCount)
+	{
+		if (SamplesCount < 2)
+		{
+			return;
+		}
+
+		PCG32 random(inSeed, inVertexIndex);
+
+		Offset = random.NextUint() % SamplesCount;
+		Stride = 1 + random.NextUint() % (SamplesCount - 1);
+		while (GreatestCommonDivisor(Stride, SamplesCount) != 1)
+		{
+			Stride = Stride % (SamplesCount - 1) + 1;
+		}
+	}
+
+	inline uint32_t GetSampleIndex(const uint32_t inIndex) const
+	{
+		return static_cast<uint32_t>((Offset + uint64_t(inIndex) * Stride) % SamplesCount);
+	}
+
+	uint32_t SamplesCount = 1;
+	uint32_t Offset = 0;
+	uint32_t Stride = 1;
+};
+
+template<int32_t Bands>
+static void BakeMeshes(const TLAS& inScene, const eastl::vector<SHSample<Bands>>& inSamples, const eastl::vector<SHTransferBakeMesh>& inMeshes,
+	const SHTransferBakeSettings& inSettings, ThreadPool& inPool)
+{
+	using Clock = std::chrono::steady_clock;
+	constexpr int32_t coefficientsCount = SHSample<Bands>::CoefficientsCount;
+
+	// First vertex of every mesh in the range the tasks are cut from, plus the total at the end
+	eastl::vector<uint32_t> meshStarts;
+	meshStarts.reserve(inMeshes.size() + 1);
+
+	uint32_t verticesCount = 0;
+	for (const SHTransferBakeMesh& mesh : inMeshes)
+	{
+		meshStarts.push_back(verticesCount);
+
+		const uint32_t meshVerticesCount = mesh.Vertices ? static_cast<uint32_t>(mesh.Vertices->size()) : 0;
+		if (mesh.OutTransferCoeffs)
+		{
+			mesh.OutTransferCoeffs->resize(meshVerticesCount * coefficientsCount);
+		}
+
+		verticesCount += meshVerticesCount;
+	}
+	meshStarts.push_back(verticesCount);
+
+	const uint32_t samplesCount = static_cast<uint32_t>(inSamples.size());
+	if (samplesCount == 0)
+	{
+		LOG_WARNING("SH bake: no samples given, transfer coefficients are left at zero");
+	}
+
+	const uint32_t samplesPerVertex = inSettings.SamplesPerVertex > 0 ? glm::min<uint32_t>(inSettings.SamplesPerVertex, samplesCount) : samplesCount;
+	const bool bUseSubset = samplesPerVertex < samplesCount;
+
+	// Subsets are seeded per mesh and per mesh local vertex, a mesh gets the same samples whatever else is baked with it
+	eastl::vector<uint64_t> meshSeeds;
+	if (bUseSubset)
+	{
+		meshSeeds.reserve(inMeshes.size());
+		for (const SHTransferBakeMesh& mesh : inMeshes)
+		{
+			meshSeeds.push_back(inSettings.Seed ^ SHTransferCache::ComputeGeometryKey(mesh));
+		}
+	}
+
+	// Uniform sphere sampling has a pdf of 1 / (4 * PI), the Monte Carlo estimate divides the sum by it and by the number of samples
+	const float normalization = samplesPerVertex > 0 ? 4.f * PI / float(samplesPerVertex) : 0.f;
+
+	const uint32_t verticesPerTask = glm::max(inSettings.VerticesPerTask, 1u);
+	const uint32_t tasksCount = (verticesCount + verticesPerTask - 1) / verticesPerTask;
+
+	const Clock::time_point startTime = Clock::now();
+	std::atomic<uint32_t> verticesDone = { 0 };
+
+	std::mutex progressMutex;
+	Clock::time_point lastProgressTime = startTime;
+
+	const auto reportProgress = [&inSettings, &startTime, verticesCount](const uint32_t inVerticesDone, const Clock::time_point inNow)
+	{
+		SHBakeProgress progress;
+		progress.VerticesDone = inVerticesDone;
+		progress.VerticesCount = verticesCount;
+		progress.ElapsedSeconds = std::chrono::duration<float>(inNow - startTime).count();
+		progress.RemainingSeconds = inVerticesDone > 0 ? progress.ElapsedSeconds * float(verticesCount - inVerticesDone) / float(inVerticesDone) : 0.f;
+
+		inSettings.ProgressCallback.Execute(progress);
+	};
+
+	const bool bReportProgress = inSettings.ProgressCallback.IsBound();
+
+	inPool.ParallelFor(tasksCount, [&](const uint32_t inTaskIndex)
+	{
+		const uint32_t first = inTaskIndex * verticesPerTask;
+		const uint32_t last = glm::min(first + verticesPerTask, verticesCount);
+
+		// Meshes are few, the one holding the task's first vertex is found with a linear walk
+		uint32_t meshIndex = 0;
+		while (meshStarts[meshIndex + 1] <= first)
+		{
+			++meshIndex;
+		}
+
+		// Scratch of this thread, the shared array is only written once per vertex
+		glm::vec3 coeffs[coefficientsCount];
+
+		PathTracingRay traceRay;
+
+		for (uint32_t globalIndex = first; globalIndex < last; ++globalIndex)
+		{
+			while (meshStarts[meshIndex + 1] <= globalIndex)
+			{
+				++meshIndex;
+			}
+
+			const SHTransferBakeMesh& mesh = inMeshes[meshIndex];
+			if (!mesh.OutTransferCoeffs)
+			{
+				continue;
+			}
+
+			const uint32_t vertexIndex = globalIndex - meshStarts[meshIndex];
+			const Vertex& vert = (*mesh.Vertices)[vertexIndex];
+
+			for (glm::vec3& coeff : coeffs)
+			{
+				coeff = glm::vec3(0.f, 0.f, 0.f);
+			}
+
+			traceRay.Origin = glm::vec3(mesh.ObjectToWorld * glm::vec4(vert.Position + vert.Normal * inSettings.NormalOffset, 1.f));
+
+			const SHSampleSubset subset = bUseSubset ? SHSampleSubset(meshSeeds[meshIndex], vertexIndex, samplesCount) : SHSampleSubset(0, 0, samplesCount);
+
+			for (uint32_t i = 0; i < samplesPerVertex; ++i)
+			{
+				const SHSample<Bands>& sample = inSamples[bUseSubset ? subset.GetSampleIndex(i) : i];
+
+				// Samples under the surface see nothing
+				const float cosTheta = glm::dot(vert.Normal, sample.Direction);
+				if (cosTheta < 0.f)
+				{
+					continue;
+				}
+
+				traceRay.SetDirection(glm::vec3(mesh.ObjectToWorld * glm::vec4(sample.Direction, 0.f)));
+
+				// Visibility only needs a yes/no answer
+				if (inScene.IsOccluded(traceRay))
+				{
+					continue;
+				}
+
+				switch (inSettings.Type)
+				{
+				case ESHTransferType::Shadowed:
+				{
+					for (int32_t c = 0; c < coefficientsCount; ++c)
+					{
+						coeffs[c] += glm::vec3(sample.Coeffs[c]);
+					}
+					break;
+				}
+				case ESHTransferType::ShadowedDiffuse:
+				{
+					const glm::vec3 weight = mesh.Albedo * cosTheta;
+					for (int32_t c = 0; c < coefficientsCount; ++c)
+					{
+						coeffs[c] += weight * sample.Coeffs[c];
+					}
+					break;
+				}
+				default:
+				{
+					break;
+				}
+				}
+			}
+
+			glm::vec3* outCoeffs = mesh.OutTransferCoeffs->data() + vertexIndex * coefficientsCount;
+			for (int32_t c = 0; c < coefficientsCount; ++c)
+			{
+				outCoeffs[c] = coeffs[c] * normalization;
+			}
+		}
+
+		const uint32_t newVerticesDone = verticesDone.fetch_add(last - first, std::memory_order_relaxed) + (last - first);
+
+		// Whoever holds the lock reports, the others carry on baking instead of waiting for it
+		if (bReportProgress && progressMutex.try_lock())
+		{
+			const Clock::time_point now = Clock::now();
+			if (std::chrono::duration<float>(now - lastProgressTime).count() >= inSettings.ProgressInterval)
+			{
+				lastProgressTime = now;
+				reportProgress(newVerticesDone, now);
+			}
+
+			progressMutex.unlock();
+		}
+	});
+
+	if (bReportProgress)
+	{
+		reportProgress(verticesCount, Clock::now());
+	}
+}
+
+template<int32_t Bands>
+void SHTransferBake::Bake(const TLAS& inScene, const eastl::vector<SHSample<Bands>>& inSamples, const eastl::vector<SHTransferBakeMesh>& inMeshes, const SHTransferBakeSettings& inSettings,
+	ThreadPool& inPool)
+{
+	if (!inSettings.bUseDiskCache)
+	{
+		BakeMeshes(inScene, inSamples, inMeshes, inSettings, inPool);
+
+		return;
+	}
+
+	const uint64_t sceneKey = SHTransferCache::ComputeSceneKey(inScene);
+	const uint64_t samplesKey = SHTransferCache::ComputeSamplesKey(inSamples);
+
+	eastl::vector<SHTransferBakeMesh> meshesToBake;
+	eastl::vector<uint64_t> meshesToBakeKeys;
+	uint32_t loadedCount = 0;
+
+	for (const SHTransferBakeMesh& mesh : inMeshes)
+	{
+		if (!mesh.OutTransferCoeffs)
+		{
+			continue;
+		}
+
+		const uint64_t key = SHTransferCache::ComputeMeshKey(sceneKey, samplesKey, mesh, inSettings);
+		const uint32_t coeffsCount = mesh.Vertices ? static_cast<uint32_t>(mesh.Vertices->size()) * SHSample<Bands>::CoefficientsCount : 0;
+
+		if (SHTransferCache::TryLoad(key, coeffsCount, *mesh.OutTransferCoeffs))
+		{
+			++loadedCount;
+		}
+		else
+		{
+			meshesToBake.push_back(mesh);
+			meshesToBakeKeys.push_back(key);
+		}
+	}
+
+	LOG_INFO("SH bake: %u meshes loaded from the cache, %u to bake", loadedCount, static_cast<uint32_t>(meshesToBake.size()));
+
+	if (meshesToBake.empty())
+	{
+		return;
+	}
+
+	BakeMeshes(inScene, inSamples, meshesToBake, inSettings, inPool);
+
+	for (size_t i = 0; i < meshesToBake.size(); ++i)
+	{
+		SHTransferCache::Save(meshesToBakeKeys[i], *meshesToBake[i].OutTransferCoeffs);
+	}
+}
+
+#define INSTANTIATE_SH_TRANSFER_BAKE(Bands)																				\
+	template void SHTransferBake::Bake<Bands>(const TLAS& inScene, const eastl::vector<SHSample<Bands>>& inSamples,				\
+		const eastl::vector<SHTransferBakeMesh>& inMeshes, const SHTransferBakeSettings& inSettings, ThreadPool& inPool);
+
+INSTANTIATE_SH_TRANSFER_BAKE(1)
+INSTANTIATE_SH_TRANSFER_BAKE(2)
+INSTANTIATE_SH_TRANSFER_BAKE(3)
+INSTANTIATE_SH_TRANSFER_BAKE(4)
+INSTANTIATE_SH_TRANSFER_BAKE(5)
+
+eastl::vector<SHTransferBakeMesh> SHTransferBake::GetCommandsMeshes(eastl::vector<RenderCommand>& inOutCommands)
+{
+	eastl::vector<SHTransferBakeMesh> meshes;
+	meshes.reserve(inOutCommands.size());
+
+	for (RenderCommand& command : inOutCommands)
+	{
+		if (command.Triangles.size() == 0)
+		{
+			continue;
+		}
+
+		const eastl::shared_ptr<const DrawableObject> parent = command.Parent.lock();
+
+		SHTransferBakeMesh mesh;
+		mesh.Vertices = &command.Vertices;
+		mesh.ObjectToWorld = parent ? parent->GetModelMatrix() : glm::mat4(1.f);
+		mesh.Albedo = command.OverrideColor;
+		mesh.OutTransferCoeffs = &command.TransferCoeffs;
+
+		meshes.push_back(mesh);
+	}
+
+	return meshes;
+}
+
+void SHTransferBake::LogProgress(const SHBakeProgress& inProgress)
+{
+	const float percentage = inProgress.VerticesCount > 0 ? 100.f * float(inProgress.VerticesDone) / float(inProgress.VerticesCount) : 100.f;
+	LOG_INFO("SH bake: %u/%u vertices (%.1f%%), %.1f s elapsed, %.1f s left", inProgress.VerticesDone, inProgress.VerticesCount, percentage,
+		inProgress.ElapsedSeconds, inProgress.RemainingSeconds);
+}
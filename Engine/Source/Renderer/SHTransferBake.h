@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include "glm/ext/matrix_float4x4.hpp"
+#include "glm/ext/vector_float3.hpp"
+#include "Core/EngineUtils.h"
+#include "EASTL/vector.h"
+#include "EventSystem/EventSystem.h"
+#include "Renderer/RenderingPrimitives.h"
+
+class ThreadPool;
+struct TLAS;
+template<int32_t Bands>
+struct SHSample;
+
+enum class ESHTransferType : uint8_t
+{
+	// Visibility only, every unoccluded direction adds its SH sample
+	Shadowed,
+	// Visibility weighted by the albedo and the cosine to the normal
+	ShadowedDiffuse
+};
+
+struct SHBakeProgress
+{
+	uint32_t VerticesDone = 0;
+	uint32_t VerticesCount = 0;
+	float ElapsedSeconds = 0.f;
+	// Extrapolated from the speed so far
+	float RemainingSeconds = 0.f;
+};
+
+using SHBakeProgressCallback = Delegate<void, const SHBakeProgress&>;
+
+// One instance of a mesh, its vertices are in object space and traced through the scene with ObjectToWorld
+struct SHTransferBakeMesh
+{
+	const eastl::vector<Vertex>* Vertices = nullptr;
+	glm::mat4 ObjectToWorld = glm::mat4(1.f);
+	glm::vec3 Albedo = glm::vec3(1.f, 1.f, 1.f);
+
+	// Resized to the coefficient count of the baked bands per vertex
+	eastl::vector<glm::vec3>* OutTransferCoeffs = nullptr;
+};
+
+struct SHTransferBakeSettings
+{
+	ESHTransferType Type = ESHTransferType::Shadowed;
+
+	// Ray origins are pushed this far along the vertex normal, in object space
+	float NormalOffset = 0.001f;
+
+	// 0 traces the whole sample set from every vertex. Otherwise every vertex traces this many samples of it, picked by a generator
+	// seeded from Seed, the mesh and the vertex, so the result only depends on the inputs and never on how vertices were spread over threads
+	// or on which other meshes were baked in the same call
+	uint32_t SamplesPerVertex = 0;
+	uint32_t Seed = 0;
+
+	// Vertices a thread takes at once
+	uint32_t VerticesPerTask = 32;
+
+	// Meshes whose inputs were already baked are loaded from SHTransferCache instead, newly baked ones are saved to it
+	bool bUseDiskCache = false;
+
+	// Called from the worker threads, one call at a time and at most every ProgressInterval seconds, then once more when done
+	SHBakeProgressCallback ProgressCallback;
+	float ProgressInterval = 1.f;
+};
+
+// Precomputed radiance transfer, projects what every vertex sees of the scene on the SH basis of inSamples.
+// Vertices are independent, so they are spread over the pool and each one is accumulated on the stack of the thread baking it
+namespace SHTransferBake
+{
+	template<int32_t Bands>
+	void Bake(const TLAS& inScene, const eastl::vector<SHSample<Bands>>& inSamples, const eastl::vector<SHTransferBakeMesh>& inMeshes, const SHTransferBakeSettings& inSettings,
+		ThreadPool& inPool);
+
+	// Commands owning triangles, baked into their TransferCoeffs with their parent's model matrix and OverrideColor as albedo
+	eastl::vector<SHTransferBakeMesh> GetCommandsMeshes(eastl::vector<struct RenderCommand>& inOutCommands);
+
+	// Logs the progress and the time left, for SHTransferBakeSettings::ProgressCallback
+	void LogProgress(const SHBakeProgress& inProgress);
+}
@@ -0,0 +1,228 @@
+#include "Renderer/SHTransferCache.h"
+#include <stdio.h>
+#include <string.h>
+#include "EASTL/string.h"
+#include "EASTL/unordered_map.h"
+#include "Logger/Logger.h"
+#include "Math/SphericalHarmonics.h"
+#include "Math/TLAS.h"
+#include "Renderer/SHTransferBake.h"
+#include "Utils/HashUtils.h"
+#include "Utils/IOUtils.h"
+#include "Utils/MappedFile.h"
+#include "Utils/ThreadPool.h"
+
+// Bump whenever the bake or the file layout changes, older files are then ignored and baked again
+#define SH_TRANSFER_CACHE_VERSION 3
+
+// "SHTC"
+#define SH_TRANSFER_CACHE_MAGIC 0x43544853u
+
+static const char* const SHTransferCacheDirectory = "../Data/Cache/SHTransfer/";
+static const char* const SHTransferCacheDescription = "SH transfer cache";
+
+struct SHTransferCacheHeader
+{
+	uint32_t Magic = SH_TRANSFER_CACHE_MAGIC;
+	uint32_t Version = SH_TRANSFER_CACHE_VERSION;
+	uint64_t Key = 0;
+
+	uint32_t CoeffSize = 0;
+	uint32_t CoeffsCount = 0;
+};
+
+static eastl::string GetCacheFilePath(const uint64_t inKey)
+{
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "%016llx.sht", static_cast<unsigned long long>(inKey));
+
+	return eastl::string(SHTransferCacheDirectory) + fileName;
+}
+
+namespace SHTransferCache
+{
+	uint64_t ComputeSceneKey(const TLAS& inScene)
+	{
+		// Instances often share a BLAS, each one is only hashed once
+		eastl::unordered_map<const BVH*, uint64_t> blasKeys;
+
+		uint64_t hash = HashUtils::FNVOffsetBasis;
+
+		for (const BVHInstance& instance : inScene.Instances)
+		{
+			uint64_t blasKey = 0;
+			if (instance.BLAS)
+			{
+				const auto iter = blasKeys.find(instance.BLAS);
+				if (iter != blasKeys.end())
+				{
+					blasKey = iter->second;
+				}
+				else
+				{
+					// Leaves order the triangles and spatial splits repeat some of them, both depend on the build settings.
+					// Hashing them in source order, once each, only keeps what the rays can actually hit
+					eastl::vector<const PathTraceTriangle*> sourceTriangles(instance.BLAS->SourceTrianglesCount, nullptr);
+					for (const PathTraceTriangle& triangle : instance.BLAS->Triangles)
+					{
+						if (triangle.SourceIndex < sourceTriangles.size())
+						{
+							sourceTriangles[triangle.SourceIndex] = &triangle;
+						}
+					}
+
+					blasKey = HashUtils::FNVOffsetBasis;
+					for (const PathTraceTriangle* triangle : sourceTriangles)
+					{
+						if (triangle)
+						{
+							HashUtils::HashBytes(blasKey, triangle->V, sizeof(triangle->V));
+						}
+					}
+
+					// Decides which rays slip through shared edges and which back faces occlude
+					HashUtils::HashValue(blasKey, instance.BLAS->TriangleTest.Intersection);
+					HashUtils::HashValue(blasKey, instance.BLAS->TriangleTest.bTwoSided);
+					HashUtils::HashValue(blasKey, instance.BLAS->TriangleTest.bFlipFacing);
+
+					blasKeys[instance.BLAS] = blasKey;
+				}
+			}
+
+			HashUtils::HashValue(hash, blasKey);
+			HashUtils::HashValue(hash, instance.ObjectToWorld);
+		}
+
+		return hash;
+	}
+
+	template<int32_t Bands>
+	uint64_t ComputeSamplesKey(const eastl::vector<SHSample<Bands>>& inSamples)
+	{
+		uint64_t hash = HashUtils::FNVOffsetBasis;
+
+		HashUtils::HashValue(hash, Bands);
+		for (const SHSample<Bands>& sample : inSamples)
+		{
+			HashUtils::HashValue(hash, sample.Direction);
+			HashUtils::HashBytes(hash, sample.Coeffs, sizeof(sample.Coeffs));
+		}
+
+		return hash;
+	}
+
+	template uint64_t ComputeSamplesKey<1>(const eastl::vector<SHSample<1>>& inSamples);
+	template uint64_t ComputeSamplesKey<2>(const eastl::vector<SHSample<2>>& inSamples);
+	template uint64_t ComputeSamplesKey<3>(const eastl::vector<SHSample<3>>& inSamples);
+	template uint64_t ComputeSamplesKey<4>(const eastl::vector<SHSample<4>>& inSamples);
+	template uint64_t ComputeSamplesKey<5>(const eastl::vector<SHSample<5>>& inSamples);
+
+	uint64_t ComputeGeometryKey(const SHTransferBakeMesh& inMesh)
+	{
+		uint64_t hash = HashUtils::FNVOffsetBasis;
+
+		// Only what the bake reads of the vertices
+		if (inMesh.Vertices)
+		{
+			for (const Vertex& vertex : *inMesh.Vertices)
+			{
+				HashUtils::HashValue(hash, vertex.Position);
+				HashUtils::HashValue(hash, vertex.Normal);
+			}
+		}
+
+		HashUtils::HashValue(hash, inMesh.ObjectToWorld);
+
+		return hash;
+	}
+
+	uint64_t ComputeMeshKey(const uint64_t inSceneKey, const uint64_t inSamplesKey, const SHTransferBakeMesh& inMesh, const SHTransferBakeSettings& inSettings)
+	{
+		uint64_t hash = HashUtils::FNVOffsetBasis;
+
+		HashUtils::HashValue(hash, inSceneKey);
+		HashUtils::HashValue(hash, inSamplesKey);
+		HashUtils::HashValue(hash, ComputeGeometryKey(inMesh));
+		HashUtils::HashValue(hash, inSettings.Type);
+		HashUtils::HashValue(hash, inSettings.NormalOffset);
+
+		if (inSettings.Type == ESHTransferType::ShadowedDiffuse)
+		{
+			HashUtils::HashValue(hash, inMesh.Albedo);
+		}
+
+		// The seed only matters when it picks the samples
+		HashUtils::HashValue(hash, inSettings.SamplesPerVertex);
+		const uint32_t seed = inSettings.SamplesPerVertex > 0 ? inSettings.Seed : 0;
+		HashUtils::HashValue(hash, seed);
+
+		return hash;
+	}
+
+	bool TryLoad(const uint64_t inKey, const uint32_t inCoeffsCount, OUT eastl::vector<glm::vec3>& outCoeffs)
+	{
+		const eastl::string filePath = GetCacheFilePath(inKey);
+
+		MappedFile file;
+		if (!IOUtils::TryMapCacheFile(filePath, SH_TRANSFER_CACHE_MAGIC, SH_TRANSFER_CACHE_VERSION, inKey, sizeof(SHTransferCacheHeader), SHTransferCacheDescription, file))
+		{
+			return false;
+		}
+
+		SHTransferCacheHeader header;
+		memcpy(&header, file.GetData(), sizeof(header));
+
+		if (header.CoeffSize != sizeof(glm::vec3) || header.CoeffsCount != inCoeffsCount)
+		{
+			LOG_WARNING("Ignoring outdated SH transfer cache file %s.", filePath.c_str());
+
+			return false;
+		}
+
+		const uint64_t coeffsSize = static_cast<uint64_t>(header.CoeffsCount) * sizeof(glm::vec3);
+		if (!IOUtils::CheckCacheFileSize(filePath, file, sizeof(header), coeffsSize, SHTransferCacheDescription))
+		{
+			return false;
+		}
+
+		outCoeffs.resize(header.CoeffsCount);
+		memcpy(outCoeffs.data(), file.GetData() + sizeof(header), static_cast<size_t>(coeffsSize));
+
+		return true;
+	}
+
+	void Save(const uint64_t inKey, const eastl::vector<glm::vec3>& inCoeffs)
+	{
+		SHTransferCacheHeader header;
+		header.Key = inKey;
+		header.CoeffSize = sizeof(glm::vec3);
+		header.CoeffsCount = static_cast<uint32_t>(inCoeffs.size());
+
+		const eastl::vector<IOUtils::FileBlock> blocks = { IOUtils::FileBlock{ &header, sizeof(header) }, IOUtils::GetArrayBlock(inCoeffs) };
+		IOUtils::WriteFileAtomic(GetCacheFilePath(inKey), blocks, SHTransferCacheDescription);
+	}
+
+	template<int32_t Bands>
+	void LoadOrBakeCommands(const TLAS& inScene, const eastl::vector<SHSample<Bands>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands)
+	{
+		SHTransferBakeSettings bakeSettings;
+		bakeSettings.Type = inType;
+		bakeSettings.bUseDiskCache = true;
+		bakeSettings.ProgressCallback.BindStatic(&SHTransferBake::LogProgress);
+
+		ThreadPool bakePool;
+		SHTransferBake::Bake(inScene, inSamples, SHTransferBake::GetCommandsMeshes(inOutCommands), bakeSettings, bakePool);
+	}
+
+	template void LoadOrBakeCommands<1>(const TLAS& inScene, const eastl::vector<SHSample<1>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands);
+	template void LoadOrBakeCommands<2>(const TLAS& inScene, const eastl::vector<SHSample<2>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands);
+	template void LoadOrBakeCommands<3>(const TLAS& inScene, const eastl::vector<SHSample<3>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands);
+	template void LoadOrBakeCommands<4>(const TLAS& inScene, const eastl::vector<SHSample<4>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands);
+	template void LoadOrBakeCommands<5>(const TLAS& inScene, const eastl::vector<SHSample<5>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include "glm/ext/vector_float3.hpp"
+#include "Core/EngineUtils.h"
+#include "EASTL/vector.h"
+
+struct RenderCommand;
+struct SHTransferBakeMesh;
+struct SHTransferBakeSettings;
+struct TLAS;
+enum class ESHTransferType : uint8_t;
+template<int32_t Bands>
+struct SHSample;
+
+// Baked transfer coefficients stored on disk, one file per mesh, so that later runs and other machines skip its bake.
+// A mesh's key covers everything its coefficients depend on, so any change to the inputs simply leads to another file.
+namespace SHTransferCache
+{
+	// What the visibility rays can hit, the source triangles of every BLAS and the instance transforms, whatever the BVH build settings
+	uint64_t ComputeSceneKey(const TLAS& inScene);
+
+	// Band count, directions and coefficients of the samples
+	template<int32_t Bands>
+	uint64_t ComputeSamplesKey(const eastl::vector<SHSample<Bands>>& inSamples);
+
+	// The mesh's own vertex positions, normals and transform. Also seeds the mesh's sample subsets, so that they never depend on
+	// which other meshes are baked along with it
+	uint64_t ComputeGeometryKey(const SHTransferBakeMesh& inMesh);
+
+	// The geometry key, the albedo, the settings that change the result and the keys above
+	uint64_t ComputeMeshKey(const uint64_t inSceneKey, const uint64_t inSamplesKey, const SHTransferBakeMesh& inMesh, const SHTransferBakeSettings& inSettings);
+
+	// Fails without touching outCoeffs if there is no file for the key or if it does not hold exactly inCoeffsCount coefficients
+	bool TryLoad(const uint64_t inKey, const uint32_t inCoeffsCount, OUT eastl::vector<glm::vec3>& outCoeffs);
+
+	void Save(const uint64_t inKey, const eastl::vector<glm::vec3>& inCoeffs);
+
+	// Fills the TransferCoeffs of every command owning triangles. Relaunches with an unchanged scene load the coefficients
+	// instead of tracing them again, the meshes that had to be baked are saved for the next one
+	template<int32_t Bands>
+	void LoadOrBakeCommands(const TLAS& inScene, const eastl::vector<SHSample<Bands>>& inSamples, const ESHTransferType inType,
+		eastl::vector<RenderCommand>& inOutCommands);
+}
@@ -1,4 +1,8 @@
 #pragma once
+#include "glm/ext/vector_float4.hpp"
+
+// SH bands of the baked GI, SH_NUM_BANDS of the GI shaders has to match it
+#define GI_SH_BANDS 2
 
 struct SPointLight {
 	glm::vec4 position;
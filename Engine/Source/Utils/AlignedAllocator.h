@@ -0,0 +1,50 @@
+#pragma once
+#include "EASTL/allocator.h"
+#include <stdlib.h>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// EASTL allocator that honours the alignment of the contained type.
+// The engine's operator new[] overloads for EASTL ignore alignment, which SIMD loads on over-aligned types depend on.
+class AlignedAllocator
+{
+public:
+	AlignedAllocator(const char* pName = "AlignedAllocator") {}
+	AlignedAllocator(const AlignedAllocator& x, const char* pName) {}
+
+	void* allocate(size_t n, int flags = 0)
+	{
+		return allocate(n, EASTL_ALLOCATOR_MIN_ALIGNMENT, 0, flags);
+	}
+
+	void* allocate(size_t n, size_t alignment, size_t offset, int flags = 0)
+	{
+		if (alignment < sizeof(void*))
+		{
+			alignment = sizeof(void*);
+		}
+
+#if defined(_MSC_VER)
+		return _aligned_malloc(n, alignment);
+#else
+		void* result = nullptr;
+		return posix_memalign(&result, alignment, n) == 0 ? result : nullptr;
+#endif
+	}
+
+	void deallocate(void* p, size_t n)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	const char* get_name() const { return "AlignedAllocator"; }
+	void set_name(const char* pName) {}
+};
+
+inline bool operator==(const AlignedAllocator&, const AlignedAllocator&) { return true; }
+inline bool operator!=(const AlignedAllocator&, const AlignedAllocator&) { return false; }
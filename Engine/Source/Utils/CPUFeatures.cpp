@@ -0,0 +1,103 @@
+#include "Utils/CPUFeatures.h"
+#include <stdint.h>
+
+#if PLATFORM_X64
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace CPUFeatures
+{
+	struct CPUInfo
+	{
+		bool bSSE41 = false;
+		bool bAVX = false;
+		bool bAVX2 = false;
+	};
+
+#if PLATFORM_X64
+	static void CPUID(const int32_t inLeaf, const int32_t inSubLeaf, int32_t outRegisters[4])
+	{
+#if defined(_MSC_VER)
+		__cpuidex(outRegisters, inLeaf, inSubLeaf);
+#else
+		uint32_t eax, ebx, ecx, edx;
+		__cpuid_count(inLeaf, inSubLeaf, eax, ebx, ecx, edx);
+		outRegisters[0] = eax;
+		outRegisters[1] = ebx;
+		outRegisters[2] = ecx;
+		outRegisters[3] = edx;
+#endif
+	}
+
+	static uint64_t GetEnabledXSaveFeatures()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+	}
+#endif
+
+	static CPUInfo DetectCPUInfo()
+	{
+		CPUInfo info;
+
+#if PLATFORM_X64
+		int32_t registers[4];
+		CPUID(0, 0, registers);
+		const int32_t maxLeaf = registers[0];
+
+		CPUID(1, 0, registers);
+		const uint32_t ecx = static_cast<uint32_t>(registers[2]);
+
+		info.bSSE41 = (ecx & (1 << 19)) != 0;
+
+		// AVX also needs the OS to save the YMM registers on context switches
+		const bool bOSXSave = (ecx & (1 << 27)) != 0;
+		const bool bCPUAVX = (ecx & (1 << 28)) != 0;
+		if (bOSXSave && bCPUAVX)
+		{
+			const uint64_t xcr0 = GetEnabledXSaveFeatures();
+			info.bAVX = (xcr0 & 0x6) == 0x6;
+		}
+
+		if (info.bAVX && maxLeaf >= 7)
+		{
+			CPUID(7, 0, registers);
+			const bool bFMA = (ecx & (1 << 12)) != 0;
+			info.bAVX2 = bFMA && (static_cast<uint32_t>(registers[1]) & (1 << 5)) != 0;
+		}
+#endif
+
+		return info;
+	}
+
+	static const CPUInfo& GetCPUInfo()
+	{
+		static const CPUInfo Info = DetectCPUInfo();
+
+		return Info;
+	}
+
+	bool HasSSE41()
+	{
+		return GetCPUInfo().bSSE41;
+	}
+
+	bool HasAVX()
+	{
+		return GetCPUInfo().bAVX;
+	}
+
+	bool HasAVX2()
+	{
+		return GetCPUInfo().bAVX2;
+	}
+}
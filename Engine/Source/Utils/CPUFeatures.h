@@ -0,0 +1,22 @@
+#pragma once
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PLATFORM_X64 1
+#else
+#define PLATFORM_X64 0
+#endif
+
+// MSVC allows intrinsics of any instruction set in any function, GCC and Clang need the function to opt in
+#if defined(_MSC_VER) || !PLATFORM_X64
+#define TARGET_AVX
+#else
+#define TARGET_AVX __attribute__((target("avx")))
+#endif
+
+// Runtime detection of the instruction sets SIMD code paths are allowed to use
+namespace CPUFeatures
+{
+	bool HasSSE41();
+	bool HasAVX();
+	bool HasAVX2();
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a, for the keys of the disk caches. Same on every run and machine, as long as the hashed values have the same bytes
+namespace HashUtils
+{
+	constexpr uint64_t FNVOffsetBasis = 0xCBF29CE484222325ull;
+
+	inline void HashBytes(uint64_t& inOutHash, const void* inData, const size_t inSize)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(inData);
+		for (size_t i = 0; i < inSize; ++i)
+		{
+			inOutHash ^= bytes[i];
+			inOutHash *= 0x100000001B3ull;
+		}
+	}
+
+	template<typename T>
+	inline void HashValue(uint64_t& inOutHash, const T& inValue)
+	{
+		HashBytes(inOutHash, &inValue, sizeof(T));
+	}
+}
@@ -1,8 +1,18 @@
 #include "Utils/IOUtils.h"
+#include <string.h>
 #include <fstream>
 #include <filesystem>
 #include "Logger/Logger.h"
 #include "Core/EngineUtils.h"
+#include "Utils/MappedFile.h"
+
+// Leading members of every cache header
+struct CacheFileHeader
+{
+	uint32_t Magic = 0;
+	uint32_t Version = 0;
+	uint64_t Key = 0;
+};
 
 namespace IOUtils
 {
@@ -27,4 +37,88 @@ namespace IOUtils
 
 		return true;
 	}
+
+	bool WriteFileAtomic(const eastl::string& inFilePath, const eastl::vector<FileBlock>& inBlocks, const char* inDescription)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(inFilePath.c_str()).parent_path(), error);
+
+		const eastl::string tempFilePath = inFilePath + ".tmp";
+		{
+			std::ofstream fileStream(tempFilePath.c_str(), std::ios::binary | std::ios::trunc);
+			if (!fileStream.is_open())
+			{
+				LOG_WARNING("Failed to write %s file %s.", inDescription, inFilePath.c_str());
+
+				return false;
+			}
+
+			for (const FileBlock& block : inBlocks)
+			{
+				fileStream.write(static_cast<const char*>(block.Data), static_cast<std::streamsize>(block.Size));
+			}
+
+			if (!fileStream)
+			{
+				LOG_WARNING("Failed to write %s file %s.", inDescription, inFilePath.c_str());
+
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tempFilePath.c_str(), inFilePath.c_str(), error);
+		if (error)
+		{
+			LOG_WARNING("Failed to write %s file %s.", inDescription, inFilePath.c_str());
+
+			return false;
+		}
+
+		return true;
+	}
+
+	bool TryMapCacheFile(const eastl::string& inFilePath, const uint32_t inMagic, const uint32_t inVersion, const uint64_t inKey, const size_t inHeaderSize,
+		const char* inDescription, OUT MappedFile& outFile)
+	{
+		ASSERT(inHeaderSize >= sizeof(CacheFileHeader));
+
+		if (!outFile.Open(inFilePath))
+		{
+			return false;
+		}
+
+		if (outFile.GetSize() < inHeaderSize)
+		{
+			LOG_WARNING("%s file %s is truncated.", inDescription, inFilePath.c_str());
+			outFile.Close();
+
+			return false;
+		}
+
+		CacheFileHeader header;
+		memcpy(&header, outFile.GetData(), sizeof(header));
+
+		if (header.Magic != inMagic || header.Version != inVersion || header.Key != inKey)
+		{
+			LOG_WARNING("Ignoring outdated %s file %s.", inDescription, inFilePath.c_str());
+			outFile.Close();
+
+			return false;
+		}
+
+		return true;
+	}
+
+	bool CheckCacheFileSize(const eastl::string& inFilePath, const MappedFile& inFile, const size_t inHeaderSize, const uint64_t inPayloadSize,
+		const char* inDescription)
+	{
+		if (static_cast<uint64_t>(inFile.GetSize()) != static_cast<uint64_t>(inHeaderSize) + inPayloadSize)
+		{
+			LOG_WARNING("%s file %s does not match the sizes in its header.", inDescription, inFilePath.c_str());
+
+			return false;
+		}
+
+		return true;
+	}
 }
@@ -1,7 +1,40 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "Core/EngineUtils.h"
 #include "EASTL/string.h"
+#include "EASTL/vector.h"
+
+class MappedFile;
 
 namespace IOUtils
 {
 	bool TryFastReadFile(const eastl::string& inFilePath, eastl::string& outData);
+
+	// Contiguous bytes of a file being written
+	struct FileBlock
+	{
+		const void* Data = nullptr;
+		size_t Size = 0;
+	};
+
+	template<typename VectorType>
+	inline FileBlock GetArrayBlock(const VectorType& inArray)
+	{
+		return FileBlock{ inArray.data(), inArray.size() * sizeof(typename VectorType::value_type) };
+	}
+
+	// Writes the blocks one after the other to a file next to inFilePath and moves it over inFilePath once complete, so that a crash
+	// half way never leaves a truncated file under the real name. Missing directories are created, inDescription names the file in warnings
+	bool WriteFileAtomic(const eastl::string& inFilePath, const eastl::vector<FileBlock>& inBlocks, const char* inDescription);
+
+	// Cache files start with a header of inHeaderSize bytes whose first members are a uint32_t magic, a uint32_t version and the uint64_t key.
+	// Maps the file and checks these three, fails quietly if there is no file and with a warning if it is too small or written for something else
+	bool TryMapCacheFile(const eastl::string& inFilePath, const uint32_t inMagic, const uint32_t inVersion, const uint64_t inKey, const size_t inHeaderSize,
+		const char* inDescription, OUT MappedFile& outFile);
+
+	// True if the file is exactly the header followed by inPayloadSize bytes. The payload size is computed by the caller from the counts of
+	// the header, in 64 bits so that corrupted counts cannot wrap around to a size that passes
+	bool CheckCacheFileSize(const eastl::string& inFilePath, const MappedFile& inFile, const size_t inHeaderSize, const uint64_t inPayloadSize,
+		const char* inDescription);
 }
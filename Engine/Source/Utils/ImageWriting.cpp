@@ -0,0 +1,170 @@
+#include "ImageWriting.h"
+#include "EASTL/vector.h"
+#include "glm/common.hpp"
+#include "Logger/Logger.h"
+#include <fstream>
+
+bool ImageWriting::WritePFM(const char* inFilePath, const glm::vec4* inPixels, const uint32_t inWidth, const uint32_t inHeight)
+{
+	std::ofstream fileStream(inFilePath, std::ios::binary | std::ios::trunc);
+	if (!fileStream.is_open())
+	{
+		LOG_WARNING("Failed to open %s for writing.", inFilePath);
+
+		return false;
+	}
+
+	// Negative scale marks the data as little endian
+	fileStream << "PF\n" << inWidth << " " << inHeight << "\n-1.0\n";
+
+	eastl::vector<float> row;
+	row.resize(inWidth * 3);
+
+	// Rows are stored bottom to top
+	for (uint32_t y = inHeight; y-- > 0;)
+	{
+		for (uint32_t x = 0; x < inWidth; ++x)
+		{
+			const glm::vec4& pixel = inPixels[y * inWidth + x];
+			row[x * 3 + 0] = pixel.r;
+			row[x * 3 + 1] = pixel.g;
+			row[x * 3 + 2] = pixel.b;
+		}
+
+		fileStream.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(float));
+	}
+
+	return fileStream.good();
+}
+
+static uint32_t ComputeCRC32(const uint8_t* inData, const size_t inSize, uint32_t inCRC = 0)
+{
+	static uint32_t table[256];
+	static const bool bTableBuilt = []()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t value = i;
+			for (int32_t bit = 0; bit < 8; ++bit)
+			{
+				value = (value & 1u) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+			}
+			table[i] = value;
+		}
+
+		return true;
+	}();
+	(void)bTableBuilt;
+
+	uint32_t crc = ~inCRC;
+	for (size_t i = 0; i < inSize; ++i)
+	{
+		crc = table[(crc ^ inData[i]) & 0xFFu] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+static void PushBigEndian(eastl::vector<uint8_t>& inOutData, const uint32_t inValue)
+{
+	inOutData.push_back(static_cast<uint8_t>(inValue >> 24));
+	inOutData.push_back(static_cast<uint8_t>(inValue >> 16));
+	inOutData.push_back(static_cast<uint8_t>(inValue >> 8));
+	inOutData.push_back(static_cast<uint8_t>(inValue));
+}
+
+static void WritePNGChunk(std::ofstream& inStream, const char inType[4], const eastl::vector<uint8_t>& inData)
+{
+	eastl::vector<uint8_t> chunk;
+	chunk.reserve(inData.size() + 12);
+
+	PushBigEndian(chunk, static_cast<uint32_t>(inData.size()));
+	chunk.insert(chunk.end(), inType, inType + 4);
+	chunk.insert(chunk.end(), inData.begin(), inData.end());
+
+	// Covers the type and the data, not the length
+	PushBigEndian(chunk, ComputeCRC32(chunk.data() + 4, inData.size() + 4));
+
+	inStream.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+bool ImageWriting::WritePNG(const char* inFilePath, const glm::vec4* inPixels, const uint32_t inWidth, const uint32_t inHeight)
+{
+	std::ofstream fileStream(inFilePath, std::ios::binary | std::ios::trunc);
+	if (!fileStream.is_open())
+	{
+		LOG_WARNING("Failed to open %s for writing.", inFilePath);
+
+		return false;
+	}
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fileStream.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	eastl::vector<uint8_t> header;
+	PushBigEndian(header, inWidth);
+	PushBigEndian(header, inHeight);
+	header.push_back(8); // Bit depth
+	header.push_back(6); // RGBA
+	header.push_back(0); // Deflate
+	header.push_back(0); // Adaptive filtering
+	header.push_back(0); // Not interlaced
+	WritePNGChunk(fileStream, "IHDR", header);
+
+	// Every row starts with its filter type, 0 leaves the row as is
+	const size_t rowSize = inWidth * 4 + 1;
+	eastl::vector<uint8_t> rawData;
+	rawData.resize(rowSize * inHeight);
+
+	for (uint32_t y = 0; y < inHeight; ++y)
+	{
+		uint8_t* row = rawData.data() + y * rowSize;
+		row[0] = 0;
+
+		for (uint32_t x = 0; x < inWidth; ++x)
+		{
+			const glm::vec4 pixel = glm::clamp(inPixels[y * inWidth + x], 0.f, 1.f);
+			for (int32_t c = 0; c < 4; ++c)
+			{
+				row[1 + x * 4 + c] = static_cast<uint8_t>(pixel[c] * 255.f + 0.5f);
+			}
+		}
+	}
+
+	// Zlib stream made of stored deflate blocks, at most 65535 bytes each
+	constexpr size_t maxBlockSize = 65535;
+	const size_t blocksCount = glm::max<size_t>((rawData.size() + maxBlockSize - 1) / maxBlockSize, 1);
+
+	eastl::vector<uint8_t> compressedData;
+	compressedData.reserve(rawData.size() + blocksCount * 5 + 6);
+	compressedData.push_back(0x78);
+	compressedData.push_back(0x01);
+
+	for (size_t i = 0; i < blocksCount; ++i)
+	{
+		const size_t start = i * maxBlockSize;
+		const uint16_t blockSize = static_cast<uint16_t>(glm::min(maxBlockSize, rawData.size() - start));
+		const uint16_t blockSizeComplement = static_cast<uint16_t>(~blockSize);
+
+		compressedData.push_back(i == blocksCount - 1 ? 1 : 0);
+		compressedData.push_back(static_cast<uint8_t>(blockSize));
+		compressedData.push_back(static_cast<uint8_t>(blockSize >> 8));
+		compressedData.push_back(static_cast<uint8_t>(blockSizeComplement));
+		compressedData.push_back(static_cast<uint8_t>(blockSizeComplement >> 8));
+		compressedData.insert(compressedData.end(), rawData.begin() + start, rawData.begin() + start + blockSize);
+	}
+
+	uint32_t adlerA = 1;
+	uint32_t adlerB = 0;
+	for (const uint8_t value : rawData)
+	{
+		adlerA = (adlerA + value) % 65521u;
+		adlerB = (adlerB + adlerA) % 65521u;
+	}
+	PushBigEndian(compressedData, (adlerB << 16) | adlerA);
+
+	WritePNGChunk(fileStream, "IDAT", compressedData);
+	WritePNGChunk(fileStream, "IEND", {});
+
+	return fileStream.good();
+}
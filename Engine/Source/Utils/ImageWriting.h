@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "glm/ext/vector_float4.hpp"
+#include "Core/EngineUtils.h"
+
+/**
+ * Writers for rendered images, without any dependency on the RHI or a window
+ */
+
+namespace ImageWriting
+{
+	// Portable float map, RGB 32 bit float per channel, alpha is dropped. inPixels are top row first
+	bool WritePFM(const char* inFilePath, const glm::vec4* inPixels, const uint32_t inWidth, const uint32_t inHeight);
+
+	// 8 bit RGBA PNG, channels are clamped to [0, 1]. inPixels are top row first.
+	// Compression is left out, the data is stored as is
+	bool WritePNG(const char* inFilePath, const glm::vec4* inPixels, const uint32_t inWidth, const uint32_t inHeight);
+}
@@ -0,0 +1,112 @@
+#include "Utils/MappedFile.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const eastl::string& inFilePath)
+{
+	Close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(inFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+
+		return false;
+	}
+
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+
+		return false;
+	}
+
+	FileHandle = file;
+	MappingHandle = mapping;
+	Data = static_cast<const uint8_t*>(view);
+	Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	const int fileDescriptor = open(inFilePath.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(fileDescriptor);
+
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+	// The mapping keeps the file alive on its own
+	close(fileDescriptor);
+
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+
+	Data = static_cast<const uint8_t*>(view);
+	Size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!Data)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(Data);
+	CloseHandle(static_cast<HANDLE>(MappingHandle));
+	CloseHandle(static_cast<HANDLE>(FileHandle));
+
+	FileHandle = nullptr;
+	MappingHandle = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(Data), Size);
+#endif
+
+	Data = nullptr;
+	Size = 0;
+}
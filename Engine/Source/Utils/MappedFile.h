@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "EASTL/string.h"
+
+// Read only view of a whole file, mapped instead of read so that the OS pages in what is touched straight from its cache
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Fails for missing and empty files
+	bool Open(const eastl::string& inFilePath);
+	void Close();
+
+	inline const uint8_t* GetData() const { return Data; }
+	inline size_t GetSize() const { return Size; }
+
+private:
+	const uint8_t* Data = nullptr;
+	size_t Size = 0;
+
+	// Win32 file and mapping handles, unused elsewhere
+	void* FileHandle = nullptr;
+	void* MappingHandle = nullptr;
+};
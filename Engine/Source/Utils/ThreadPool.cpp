@@ -0,0 +1,190 @@
+#include "Utils/ThreadPool.h"
+
+static inline uint64_t PackRange(const uint32_t inBegin, const uint32_t inEnd)
+{
+	return static_cast<uint64_t>(inBegin) | (static_cast<uint64_t>(inEnd) << 32);
+}
+
+ThreadPool::ThreadPool(const uint32_t inThreadsCount)
+{
+	uint32_t threadsCount = inThreadsCount != 0 ? inThreadsCount : std::thread::hardware_concurrency();
+	if (threadsCount == 0)
+	{
+		threadsCount = 1;
+	}
+
+	Ranges.reset(new WorkRange[threadsCount]);
+	for (uint32_t i = 0; i < threadsCount; ++i)
+	{
+		Ranges[i].Packed.store(0, std::memory_order_relaxed);
+	}
+
+	Workers.reserve(threadsCount - 1);
+	for (uint32_t i = 0; i < threadsCount - 1; ++i)
+	{
+		Workers.emplace_back([this, i]() { WorkerLoop(i); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		bStopping = true;
+	}
+
+	JobStartedCondition.notify_all();
+
+	for (std::thread& worker : Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Run(const uint32_t inCount, const JobFunction inFunction, const void* inContext)
+{
+	if (inCount == 0)
+	{
+		return;
+	}
+
+	if (Workers.empty() || inCount == 1)
+	{
+		for (uint32_t i = 0; i < inCount; ++i)
+		{
+			inFunction(inContext, i);
+		}
+
+		return;
+	}
+
+	// Contiguous slices, so that a thread keeps working on neighbouring indices until it has to steal
+	const uint32_t rangesCount = GetThreadsCount();
+	for (uint32_t i = 0; i < rangesCount; ++i)
+	{
+		const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(inCount) * i / rangesCount);
+		const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(inCount) * (i + 1) / rangesCount);
+		Ranges[i].Packed.store(PackRange(begin, end), std::memory_order_relaxed);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		CurrentFunction = inFunction;
+		CurrentContext = inContext;
+		BusyWorkersCount = static_cast<uint32_t>(Workers.size());
+		++JobGeneration;
+	}
+
+	JobStartedCondition.notify_all();
+
+	ProcessRanges(rangesCount - 1);
+
+	// Every index has been popped once all ranges are empty, but workers may still be running their last ones
+	std::unique_lock<std::mutex> lock(Mutex);
+	JobDoneCondition.wait(lock, [this]() { return BusyWorkersCount == 0; });
+
+	CurrentFunction = nullptr;
+	CurrentContext = nullptr;
+}
+
+void ThreadPool::WorkerLoop(const uint32_t inRangeIndex)
+{
+	uint64_t doneGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			JobStartedCondition.wait(lock, [this, doneGeneration]() { return bStopping || JobGeneration != doneGeneration; });
+
+			if (bStopping)
+			{
+				return;
+			}
+
+			doneGeneration = JobGeneration;
+		}
+
+		ProcessRanges(inRangeIndex);
+
+		bool bLastWorker = false;
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			bLastWorker = --BusyWorkersCount == 0;
+		}
+
+		if (bLastWorker)
+		{
+			JobDoneCondition.notify_one();
+		}
+	}
+}
+
+void ThreadPool::ProcessRanges(const uint32_t inRangeIndex)
+{
+	uint32_t index = 0;
+
+	do
+	{
+		while (PopIndex(inRangeIndex, index))
+		{
+			CurrentFunction(CurrentContext, index);
+		}
+	} while (StealRange(inRangeIndex));
+}
+
+bool ThreadPool::PopIndex(const uint32_t inRangeIndex, OUT uint32_t& outIndex)
+{
+	std::atomic<uint64_t>& range = Ranges[inRangeIndex].Packed;
+	uint64_t packed = range.load(std::memory_order_acquire);
+
+	while (true)
+	{
+		const uint32_t begin = static_cast<uint32_t>(packed);
+		const uint32_t end = static_cast<uint32_t>(packed >> 32);
+		if (begin >= end)
+		{
+			return false;
+		}
+
+		if (range.compare_exchange_weak(packed, PackRange(begin + 1, end), std::memory_order_acq_rel))
+		{
+			outIndex = begin;
+
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::StealRange(const uint32_t inRangeIndex)
+{
+	const uint32_t rangesCount = GetThreadsCount();
+
+	for (uint32_t offset = 1; offset < rangesCount; ++offset)
+	{
+		std::atomic<uint64_t>& victim = Ranges[(inRangeIndex + offset) % rangesCount].Packed;
+		uint64_t packed = victim.load(std::memory_order_acquire);
+
+		while (true)
+		{
+			const uint32_t begin = static_cast<uint32_t>(packed);
+			const uint32_t end = static_cast<uint32_t>(packed >> 32);
+			if (begin >= end)
+			{
+				break;
+			}
+
+			// The back half, the victim keeps going through the front of its slice undisturbed
+			const uint32_t middle = begin + (end - begin) / 2;
+			if (victim.compare_exchange_weak(packed, PackRange(begin, middle), std::memory_order_acq_rel))
+			{
+				// Our own range is empty, other thieves skip it until this store lands
+				Ranges[inRangeIndex].Packed.store(PackRange(middle, end), std::memory_order_release);
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
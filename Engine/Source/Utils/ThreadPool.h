@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+#include "Core/EngineUtils.h"
+#include "EASTL/unique_ptr.h"
+#include "EASTL/vector.h"
+
+// Persistent worker threads running parallel loops over an index range.
+// Each thread starts on its own contiguous slice of the range, so neighbouring indices stay on the same core,
+// and steals the back half of another slice once its own runs out. The calling thread works as well.
+class ThreadPool
+{
+public:
+	// 0 picks one thread per hardware thread, the caller included
+	explicit ThreadPool(const uint32_t inThreadsCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Calls inFunction(index) for every index in [0, inCount) and returns once all of them are done.
+	// Not reentrant, inFunction must not call ParallelFor on the same pool
+	template<typename FunctionType>
+	void ParallelFor(const uint32_t inCount, const FunctionType& inFunction)
+	{
+		Run(inCount, [](const void* inContext, const uint32_t inIndex)
+		{
+			(*static_cast<const FunctionType*>(inContext))(inIndex);
+		}, &inFunction);
+	}
+
+	// Workers plus the calling thread
+	inline uint32_t GetThreadsCount() const { return static_cast<uint32_t>(Workers.size()) + 1; }
+
+private:
+	using JobFunction = void(*)(const void* inContext, const uint32_t inIndex);
+
+	// Begin in the low 32 bits and end in the high ones, so that popping and stealing are both a single compare exchange
+	struct alignas(64) WorkRange
+	{
+		std::atomic<uint64_t> Packed;
+	};
+
+	void Run(const uint32_t inCount, const JobFunction inFunction, const void* inContext);
+	void WorkerLoop(const uint32_t inRangeIndex);
+	void ProcessRanges(const uint32_t inRangeIndex);
+	bool PopIndex(const uint32_t inRangeIndex, OUT uint32_t& outIndex);
+	bool StealRange(const uint32_t inRangeIndex);
+
+	eastl::vector<std::thread> Workers;
+
+	// One per worker, the last one belongs to the calling thread
+	eastl::unique_ptr<WorkRange[]> Ranges;
+
+	std::mutex Mutex;
+	std::condition_variable JobStartedCondition;
+	std::condition_variable JobDoneCondition;
+
+	// Bumped for every job, wakes the workers
+	uint64_t JobGeneration = 0;
+	uint32_t BusyWorkersCount = 0;
+	bool bStopping = false;
+
+	JobFunction CurrentFunction = nullptr;
+	const void* CurrentContext = nullptr;
+};
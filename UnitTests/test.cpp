@@ -1,6 +1,15 @@
+#include <atomic>
+#include <random>
 #include "gtest/gtest.h"
+#include "glm/ext/matrix_transform.hpp"
 #include "EventSystem/EventSystem.h"
-
+#include "Math/BVH.h"
+#include "Math/MathUtils.h"
+#include "Math/RayPacket.h"
+#include "Math/SphericalHarmonics.h"
+#include "Math/TLAS.h"
+#include "Utils/CPUFeatures.h"
+#include "Utils/ThreadPool.h"
 namespace DelegatesTests
 {
     const int BoundDelegateSize = 24;
@@ -201,3 +210,595 @@ namespace DelegatesTests
 
 
 }
+
+namespace ThreadPoolTests
+{
+	TEST(ThreadPool, ParallelForVisitsEveryIndexOnce)
+	{
+		for (const uint32_t threadsCount : { 1u, 2u, 4u })
+		{
+			ThreadPool pool(threadsCount);
+
+			// Odd counts leave uneven slices to steal from, the pool is reused so that leftover state from a job would show up in the next one
+			for (const uint32_t count : { 0u, 1u, 3u, 1000u, 4099u })
+			{
+				eastl::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[count > 0 ? count : 1]);
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					visits[i] = 0;
+				}
+
+				pool.ParallelFor(count, [&visits](const uint32_t inIndex)
+				{
+					visits[inIndex].fetch_add(1, std::memory_order_relaxed);
+				});
+
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					EXPECT_EQ(visits[i].load(), 1u) << "Index " << i << " of " << count << " with " << threadsCount << " threads";
+				}
+			}
+		}
+	}
+}
+
+namespace BVHTests
+{
+	// Small triangles scattered over a cube, the same ones for the same seed
+	eastl::vector<PathTraceTriangle> CreateScatteredTriangles(const uint32_t inCount, const uint32_t inSeed)
+	{
+		std::mt19937 generator(inSeed);
+		std::uniform_real_distribution<float> position(-10.f, 10.f);
+		std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+
+		eastl::vector<PathTraceTriangle> triangles;
+		triangles.reserve(inCount);
+
+		for (uint32_t i = 0; i < inCount; ++i)
+		{
+			const glm::vec3 center(position(generator), position(generator), position(generator));
+
+			glm::vec3 vertices[3];
+			for (glm::vec3& vertex : vertices)
+			{
+				vertex = center + glm::vec3(offset(generator), offset(generator), offset(generator));
+			}
+
+			triangles.push_back(PathTraceTriangle(vertices));
+		}
+
+		return triangles;
+	}
+
+	// Moves every triangle as a whole by up to inDistance on each axis
+	eastl::vector<PathTraceTriangle> MoveTriangles(const eastl::vector<PathTraceTriangle>& inTriangles, const float inDistance, const uint32_t inSeed)
+	{
+		std::mt19937 generator(inSeed);
+		std::uniform_real_distribution<float> offset(-inDistance, inDistance);
+
+		eastl::vector<PathTraceTriangle> movedTriangles;
+		movedTriangles.reserve(inTriangles.size());
+
+		for (const PathTraceTriangle& triangle : inTriangles)
+		{
+			const glm::vec3 move(offset(generator), offset(generator), offset(generator));
+
+			glm::vec3 vertices[3] = { triangle.V[0] + move, triangle.V[1] + move, triangle.V[2] + move };
+			movedTriangles.push_back(PathTraceTriangle(vertices));
+		}
+
+		return movedTriangles;
+	}
+
+	bool Contains(const BVHLinearNode& inNode, const glm::vec3& inMin, const glm::vec3& inMax)
+	{
+		return glm::all(glm::lessThanEqual(inNode.Bounds[0], inMin)) && glm::all(glm::greaterThanEqual(inNode.Bounds[1], inMax));
+	}
+
+	TEST(BVHRefit, RefitBoundsContainMovedTriangles)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 1);
+		const eastl::vector<PathTraceTriangle> movedTriangles = MoveTriangles(triangles, 0.2f, 2);
+
+		BVH bvh;
+		bvh.Build(triangles);
+
+		const uint32_t nodesCount = static_cast<uint32_t>(bvh.Nodes.size());
+
+		EXPECT_FALSE(bvh.Refit(movedTriangles));
+		ASSERT_EQ(bvh.Nodes.size(), nodesCount);
+
+		for (const PathTraceTriangle& triangle : bvh.Triangles)
+		{
+			const PathTraceTriangle& movedTriangle = movedTriangles[triangle.SourceIndex];
+			EXPECT_EQ(triangle.V[0], movedTriangle.V[0]);
+			EXPECT_EQ(triangle.V[1], movedTriangle.V[1]);
+			EXPECT_EQ(triangle.V[2], movedTriangle.V[2]);
+		}
+
+		for (uint32_t i = 0; i < nodesCount; ++i)
+		{
+			const BVHLinearNode& node = bvh.Nodes[i];
+			if (node.IsLeaf())
+			{
+				for (uint32_t t = node.TrianglesOffset; t < node.TrianglesOffset + node.TrianglesCount; ++t)
+				{
+					const AABB triangleBounds = bvh.Triangles[t].GetBoundingBox();
+					EXPECT_TRUE(Contains(node, triangleBounds.Min, triangleBounds.Max));
+				}
+			}
+			else
+			{
+				const BVHLinearNode& firstChild = bvh.Nodes[i + 1];
+				const BVHLinearNode& secondChild = bvh.Nodes[node.SecondChildIndex];
+				EXPECT_TRUE(Contains(node, firstChild.Bounds[0], firstChild.Bounds[1]));
+				EXPECT_TRUE(Contains(node, secondChild.Bounds[0], secondChild.Bounds[1]));
+			}
+		}
+
+		// Refitting is exact, the root is as tight as the one of a tree built over the moved triangles
+		BVH builtBVH;
+		builtBVH.Build(movedTriangles);
+
+		EXPECT_EQ(bvh.Nodes[0].Bounds[0], builtBVH.Nodes[0].Bounds[0]);
+		EXPECT_EQ(bvh.Nodes[0].Bounds[1], builtBVH.Nodes[0].Bounds[1]);
+	}
+
+	TEST(BVHRefit, RefitRebuildsPastCostGrowth)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 1);
+
+		// Triangles moved across the whole mesh leave every node overlapping its siblings
+		const eastl::vector<PathTraceTriangle> scrambledTriangles = MoveTriangles(triangles, 10.f, 3);
+
+		BVH bvh;
+		bvh.Build(triangles);
+
+		const float builtCost = bvh.BuiltCost;
+
+		EXPECT_TRUE(bvh.Refit(scrambledTriangles));
+		EXPECT_LE(bvh.BuiltCost, builtCost * bvh.BuildSettings.MaxRefitCostGrowth);
+
+		// The same move stays a refit once the threshold allows it
+		BVHBuildSettings permissiveSettings;
+		permissiveSettings.MaxRefitCostGrowth = INFINITY;
+
+		BVH permissiveBVH;
+		permissiveBVH.Build(triangles, permissiveSettings);
+
+		EXPECT_FALSE(permissiveBVH.Refit(scrambledTriangles));
+		EXPECT_EQ(permissiveBVH.BuiltCost, builtCost);
+	}
+
+	TEST(BVHRefit, RefitRebuildsChangedTopology)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 1);
+		const eastl::vector<PathTraceTriangle> movedTriangles = MoveTriangles(triangles, 0.2f, 2);
+
+		BVH bvh;
+		bvh.Build(triangles);
+
+		eastl::vector<PathTraceTriangle> fewerTriangles = movedTriangles;
+		fewerTriangles.pop_back();
+
+		EXPECT_TRUE(bvh.Refit(fewerTriangles));
+		EXPECT_EQ(bvh.SourceTrianglesCount, fewerTriangles.size());
+
+		BVHBuildSettings spatialSettings;
+		spatialSettings.Strategy = EBVHBuildStrategy::SpatialSAH;
+
+		BVH spatialBVH;
+		spatialBVH.Build(triangles, spatialSettings);
+
+		EXPECT_TRUE(spatialBVH.Refit(movedTriangles));
+	}
+
+	// Closest hit over every triangle, what any acceleration structure has to find
+	bool TraceBruteForce(const PathTracingRay& inRay, const eastl::vector<PathTraceTriangle>& inTriangles, const TriangleTestSettings& inSettings, PathTracePayload& outPayload)
+	{
+		bool bHit = false;
+		for (const PathTraceTriangle& triangle : inTriangles)
+		{
+			PathTracePayload payload;
+			if (TraceTriangle(inRay, triangle, payload, inSettings) && payload.Distance < outPayload.Distance)
+			{
+				outPayload = payload;
+				bHit = true;
+			}
+		}
+
+		return bHit;
+	}
+
+	// Rays from all around the triangles towards them, so that most of them hit something
+	eastl::vector<PathTracingRay> CreateRays(const uint32_t inCount, const uint32_t inSeed)
+	{
+		std::mt19937 generator(inSeed);
+		std::uniform_real_distribution<float> position(-20.f, 20.f);
+		std::uniform_real_distribution<float> target(-8.f, 8.f);
+
+		eastl::vector<PathTracingRay> rays;
+		rays.reserve(inCount);
+
+		for (uint32_t i = 0; i < inCount; ++i)
+		{
+			const glm::vec3 origin(position(generator), position(generator), position(generator));
+			const glm::vec3 aimedAt(target(generator), target(generator), target(generator));
+			rays.push_back(PathTracingRay(origin, glm::normalize(aimedAt - origin)));
+		}
+
+		return rays;
+	}
+
+	void ExpectSameHit(const bool inHit, const PathTracePayload& inPayload, const bool inExpectedHit, const PathTracePayload& inExpectedPayload, const float inTolerance)
+	{
+		ASSERT_EQ(inHit, inExpectedHit);
+		if (inHit)
+		{
+			EXPECT_NEAR(inPayload.Distance, inExpectedPayload.Distance, inTolerance * glm::max(1.f, inExpectedPayload.Distance));
+			EXPECT_NEAR(inPayload.U, inExpectedPayload.U, inTolerance);
+			EXPECT_NEAR(inPayload.V, inExpectedPayload.V, inTolerance);
+			EXPECT_NEAR(glm::dot(inPayload.Normal, inExpectedPayload.Triangle->WSNormalNormalized), 1.f, inTolerance);
+		}
+	}
+
+	// Trace and IsOccluded of inTraced, a BVH or a TLAS, against a loop over inTriangles as they are in world space
+	template<typename TracedType>
+	void ExpectTraceMatchesBruteForce(const TracedType& inTraced, const eastl::vector<PathTraceTriangle>& inTriangles, const TriangleTestSettings& inSettings,
+		const eastl::vector<PathTracingRay>& inRays, const float inTolerance)
+	{
+		for (const PathTracingRay& ray : inRays)
+		{
+			PathTracePayload payload;
+			const bool bHit = inTraced.Trace(ray, payload);
+
+			PathTracePayload expectedPayload;
+			const bool bExpectedHit = TraceBruteForce(ray, inTriangles, inSettings, expectedPayload);
+
+			ExpectSameHit(bHit, payload, bExpectedHit, expectedPayload, inTolerance);
+			EXPECT_EQ(inTraced.IsOccluded(ray, 25.f), bExpectedHit && expectedPayload.Distance <= 25.f);
+		}
+	}
+
+	TEST(BVHTrace, WideTraceMatchesBruteForce)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 4);
+		const eastl::vector<PathTracingRay> rays = CreateRays(2000, 5);
+
+		// Eight falls back to Four without AVX
+		for (const EBVHWidth width : { EBVHWidth::Binary, EBVHWidth::Four, EBVHWidth::Eight })
+		{
+			BVHBuildSettings settings;
+			settings.TraversalWidth = width;
+
+			BVH bvh;
+			bvh.Build(triangles, settings);
+
+			ExpectTraceMatchesBruteForce(bvh, triangles, settings.TriangleTest, rays, 1e-4f);
+		}
+	}
+
+	TEST(BVHTrace, SpatialSplitTraceMatchesBruteForce)
+	{
+		// Long slanted slivers crossing a cloud of small triangles, the case spatial splits are for
+		std::mt19937 generator(10);
+		std::uniform_real_distribution<float> position(-10.f, 10.f);
+		std::uniform_real_distribution<float> offset(-0.1f, 0.1f);
+		std::uniform_real_distribution<float> axis(-1.f, 1.f);
+
+		eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 4);
+		for (uint32_t i = 0; i < 300; ++i)
+		{
+			const glm::vec3 center(position(generator), position(generator), position(generator));
+			const glm::vec3 length = 8.f * glm::normalize(glm::vec3(axis(generator), axis(generator), axis(generator)));
+
+			glm::vec3 vertices[3] = { center - length, center + length, center + glm::vec3(offset(generator), offset(generator), offset(generator)) };
+			triangles.push_back(PathTraceTriangle(vertices));
+		}
+
+		const eastl::vector<PathTracingRay> rays = CreateRays(2000, 11);
+
+		for (const EBVHWidth width : { EBVHWidth::Binary, EBVHWidth::Four, EBVHWidth::Eight })
+		{
+			BVHBuildSettings settings;
+			settings.Strategy = EBVHBuildStrategy::SpatialSAH;
+			settings.TraversalWidth = width;
+
+			BVH bvh;
+			bvh.Build(triangles, settings);
+
+			// Split triangles are referenced by both sides, clipped to each
+			EXPECT_GT(bvh.Triangles.size(), triangles.size());
+
+			ExpectTraceMatchesBruteForce(bvh, triangles, settings.TriangleTest, rays, 1e-4f);
+		}
+	}
+
+	TEST(BVHTrace, QuantizedWideTraceMatchesBruteForce)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 4);
+		const eastl::vector<PathTracingRay> rays = CreateRays(2000, 12);
+
+		for (const EBVHWidth width : { EBVHWidth::Four, EBVHWidth::Eight })
+		{
+			for (const bool bQuantize : { false, true })
+			{
+				BVHBuildSettings settings;
+				settings.TraversalWidth = width;
+				settings.bQuantizeWideNodes = bQuantize;
+
+				BVH bvh;
+				bvh.Build(triangles, settings);
+
+				const bool bQuantized = bvh.TraversalWidth == EBVHWidth::Eight ? bvh.Wide8.IsQuantized() : bvh.Wide4.IsQuantized();
+				EXPECT_EQ(bQuantized, bQuantize);
+
+				// Quantized boxes only ever grow, hits are the same as with the full precision ones
+				ExpectTraceMatchesBruteForce(bvh, triangles, settings.TriangleTest, rays, 1e-4f);
+			}
+		}
+	}
+
+	// Instances of inBLAS at each of inTransforms, along with the world space triangles they amount to
+	void CreateScene(const BVH& inBLAS, const eastl::vector<PathTraceTriangle>& inTriangles, const eastl::vector<glm::mat4>& inTransforms,
+		OUT TLAS& outScene, OUT eastl::vector<PathTraceTriangle>& outWorldTriangles)
+	{
+		eastl::vector<BVHInstance> instances;
+		for (uint32_t i = 0; i < inTransforms.size(); ++i)
+		{
+			instances.push_back(BVHInstance(&inBLAS, inTransforms[i], i));
+
+			for (const PathTraceTriangle& triangle : inTriangles)
+			{
+				glm::vec3 vertices[3];
+				for (int32_t v = 0; v < 3; ++v)
+				{
+					vertices[v] = glm::vec3(inTransforms[i] * glm::vec4(triangle.V[v], 1.f));
+				}
+
+				outWorldTriangles.push_back(PathTraceTriangle(vertices));
+			}
+		}
+
+		outScene.Build(instances);
+	}
+
+	TEST(TLASTrace, TraceMatchesBruteForce)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(1000, 7);
+
+		BVH blas;
+		blas.Build(triangles);
+
+		// Scaled and rotated copies next to each other, rays go through them in object space with an unnormalized direction
+		const eastl::vector<glm::mat4> transforms =
+		{
+			glm::mat4(1.f),
+			glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(15.f, 0.f, 5.f)), glm::vec3(0.5f)),
+			glm::rotate(glm::translate(glm::mat4(1.f), glm::vec3(-12.f, 4.f, 0.f)), 0.7f, glm::vec3(0.f, 1.f, 0.f))
+		};
+
+		TLAS scene;
+		eastl::vector<PathTraceTriangle> worldTriangles;
+		CreateScene(blas, triangles, transforms, scene, worldTriangles);
+
+		// Transformed vertices round differently from the object space test
+		ExpectTraceMatchesBruteForce(scene, worldTriangles, blas.TriangleTest, CreateRays(2000, 8), 1e-3f);
+	}
+
+	TEST(TLASTrace, MirroredInstancesMatchBruteForce)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(1000, 7);
+
+		// Negative scales reverse the winding, back faces and normals must still be the ones of the world space triangles
+		const eastl::vector<glm::mat4> transforms =
+		{
+			glm::scale(glm::mat4(1.f), glm::vec3(-1.f, 1.f, 1.f)),
+			glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(15.f, 0.f, 5.f)), glm::vec3(0.5f, -0.5f, 0.5f)),
+			glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(-12.f, 4.f, 0.f)), glm::vec3(-1.f, -1.f, 1.f))
+		};
+
+		const eastl::vector<PathTracingRay> rays = CreateRays(2000, 9);
+
+		for (const ETriangleIntersection intersection : { ETriangleIntersection::MollerTrumbore, ETriangleIntersection::Watertight })
+		{
+			for (const EBVHWidth width : { EBVHWidth::Binary, EBVHWidth::Four, EBVHWidth::Eight })
+			{
+				BVHBuildSettings settings;
+				settings.TraversalWidth = width;
+				settings.TriangleTest.Intersection = intersection;
+
+				BVH blas;
+				blas.Build(triangles, settings);
+
+				TLAS scene;
+				eastl::vector<PathTraceTriangle> worldTriangles;
+				CreateScene(blas, triangles, transforms, scene, worldTriangles);
+
+				EXPECT_TRUE(scene.Instances[0].bMirrored);
+				EXPECT_FALSE(scene.Instances[2].bMirrored);
+
+				ExpectTraceMatchesBruteForce(scene, worldTriangles, settings.TriangleTest, rays, 1e-3f);
+			}
+		}
+	}
+
+	// Rays of a pinhole camera looking at the triangles, in the row order packets of neighbouring pixels are made from
+	eastl::vector<PathTracingRay> CreateCameraRays(const uint32_t inCount)
+	{
+		const glm::vec3 origin(0.f, 0.f, -30.f);
+
+		eastl::vector<PathTracingRay> rays;
+		rays.reserve(inCount);
+
+		const uint32_t rowSize = 64;
+		for (uint32_t i = 0; i < inCount; ++i)
+		{
+			const float x = (static_cast<float>(i % rowSize) / rowSize) * 2.f - 1.f;
+			const float y = (static_cast<float>(i / rowSize) / (inCount / rowSize)) * 2.f - 1.f;
+			rays.push_back(PathTracingRay(origin, glm::normalize(glm::vec3(x * 0.4f, y * 0.4f, 1.f))));
+		}
+
+		return rays;
+	}
+
+	// Traces inRays Width at a time, with every other packet missing its last lane, against Trace of each ray on its own
+	template<int32_t Width, typename TracedType>
+	void ExpectPacketsMatchTrace(const TracedType& inTraced, const eastl::vector<PathTracingRay>& inRays)
+	{
+		for (uint32_t first = 0; first + Width <= inRays.size(); first += Width)
+		{
+			const int32_t lanesMask = (first / Width) % 2 == 0 ? (1 << Width) - 1 : (1 << (Width - 1)) - 1;
+
+			PathTracePayload payloads[Width];
+			const int32_t hitMask = inTraced.TracePacket(RayPacket<Width>(&inRays[first], lanesMask), payloads);
+
+			EXPECT_EQ(hitMask & ~lanesMask, 0);
+
+			for (int32_t lane = 0; lane < Width; ++lane)
+			{
+				if ((lanesMask & (1 << lane)) == 0)
+				{
+					continue;
+				}
+
+				PathTracePayload payload;
+				const bool bHit = inTraced.Trace(inRays[first + lane], payload);
+
+				ASSERT_EQ((hitMask & (1 << lane)) != 0, bHit);
+				if (bHit)
+				{
+					EXPECT_NEAR(payloads[lane].Distance, payload.Distance, 1e-4f * glm::max(1.f, payload.Distance));
+					EXPECT_EQ(payloads[lane].Triangle, payload.Triangle);
+					EXPECT_EQ(payloads[lane].InstanceIndex, payload.InstanceIndex);
+					EXPECT_NEAR(glm::dot(payloads[lane].Normal, payload.Normal), 1.f, 1e-4f);
+				}
+			}
+		}
+	}
+
+	// The 8 lane packets need AVX, like in the integrator
+	template<typename TracedType>
+	void ExpectAllPacketsMatchTrace(const TracedType& inTraced, const eastl::vector<PathTracingRay>& inRays)
+	{
+		ExpectPacketsMatchTrace<4>(inTraced, inRays);
+
+		if (CPUFeatures::HasAVX())
+		{
+			ExpectPacketsMatchTrace<8>(inTraced, inRays);
+		}
+	}
+
+	TEST(BVHTrace, PacketsMatchTrace)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(2000, 4);
+
+		BVH bvh;
+		bvh.Build(triangles);
+
+		// Camera rays are what packets are meant for, scattered ones cover lanes going different ways
+		ExpectAllPacketsMatchTrace(bvh, CreateCameraRays(4096));
+		ExpectAllPacketsMatchTrace(bvh, CreateRays(2048, 6));
+	}
+
+	TEST(TLASTrace, PacketsMatchTrace)
+	{
+		const eastl::vector<PathTraceTriangle> triangles = CreateScatteredTriangles(1000, 7);
+
+		BVH blas;
+		blas.Build(triangles);
+
+		const eastl::vector<glm::mat4> transforms =
+		{
+			glm::mat4(1.f),
+			glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(15.f, 0.f, 5.f)), glm::vec3(0.5f, -0.5f, 0.5f)),
+			glm::rotate(glm::translate(glm::mat4(1.f), glm::vec3(-12.f, 4.f, 0.f)), 0.7f, glm::vec3(0.f, 1.f, 0.f))
+		};
+
+		TLAS scene;
+		eastl::vector<PathTraceTriangle> worldTriangles;
+		CreateScene(blas, triangles, transforms, scene, worldTriangles);
+
+		ExpectAllPacketsMatchTrace(scene, CreateCameraRays(4096));
+		ExpectAllPacketsMatchTrace(scene, CreateRays(2048, 8));
+	}
+}
+
+namespace SphericalHarmonicsTests
+{
+	glm::vec3 GetDirection(const float inTheta, const float inPhi)
+	{
+		return glm::vec3(sinf(inTheta) * cosf(inPhi), sinf(inTheta) * sinf(inPhi), cosf(inTheta));
+	}
+
+	template<int32_t Bands>
+	void ExpectEvaluateDirectionMatchesEvaluate()
+	{
+		std::mt19937 generator(9);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+		for (int32_t i = 0; i < 1000; ++i)
+		{
+			// Poles included, where phi is meaningless and only the m = 0 functions are not zero
+			const float theta = i < 2 ? i * PI : acosf(1.f - 2.f * uniform(generator));
+			const float phi = 2.f * PI * uniform(generator);
+
+			float coeffs[SHCoefficientsCount(Bands)];
+			SphericalHarmonics::EvaluateDirection<Bands>(GetDirection(theta, phi), coeffs);
+
+			for (int32_t l = 0; l < Bands; ++l)
+			{
+				for (int32_t m = -l; m <= l; ++m)
+				{
+					EXPECT_NEAR(coeffs[SHIndex(l, m)], SphericalHarmonics::Evaluate<Bands>(l, m, theta, phi), 1e-4f) << "l " << l << " m " << m << " theta " << theta << " phi " << phi;
+				}
+			}
+		}
+	}
+
+	// A count which is not a multiple of the packet width, so that the remainder lanes are covered too
+	template<int32_t Bands>
+	void ExpectEvaluateDirectionsMatchesEvaluateDirection()
+	{
+		std::mt19937 generator(11);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+		const int32_t count = 1003;
+		eastl::vector<glm::vec3> directions;
+		directions.reserve(count);
+		for (int32_t i = 0; i < count; ++i)
+		{
+			directions.push_back(GetDirection(acosf(1.f - 2.f * uniform(generator)), 2.f * PI * uniform(generator)));
+		}
+
+		eastl::vector<float> coeffs(count * SHCoefficientsCount(Bands));
+		SphericalHarmonics::EvaluateDirections<Bands>(directions.data(), count, coeffs.data());
+
+		for (int32_t i = 0; i < count; ++i)
+		{
+			float expected[SHCoefficientsCount(Bands)];
+			SphericalHarmonics::EvaluateDirection<Bands>(directions[i], expected);
+
+			for (int32_t c = 0; c < SHCoefficientsCount(Bands); ++c)
+			{
+				EXPECT_NEAR(coeffs[i * SHCoefficientsCount(Bands) + c], expected[c], 1e-5f) << "direction " << i << " coefficient " << c;
+			}
+		}
+	}
+
+	TEST(SphericalHarmonics, EvaluateDirectionMatchesEvaluate)
+	{
+		ExpectEvaluateDirectionMatchesEvaluate<1>();
+		ExpectEvaluateDirectionMatchesEvaluate<2>();
+		ExpectEvaluateDirectionMatchesEvaluate<3>();
+		ExpectEvaluateDirectionMatchesEvaluate<4>();
+		ExpectEvaluateDirectionMatchesEvaluate<5>();
+	}
+
+	TEST(SphericalHarmonics, EvaluateDirectionsMatchesEvaluateDirection)
+	{
+		ExpectEvaluateDirectionsMatchesEvaluateDirection<1>();
+		ExpectEvaluateDirectionsMatchesEvaluateDirection<3>();
+		ExpectEvaluateDirectionsMatchesEvaluateDirection<5>();
+	}
+}